@@ -0,0 +1,268 @@
+// hd44780.c - HD44780 controller model, see hd44780.h
+
+#include <string.h>
+#include "hd44780.h"
+
+// Built-in font, the characters of cgrom.bin: code and 8 rows of 5 dots
+static const uint8_t HD44780_Font[][9] = {
+    {' ', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {'!', 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00},
+    {'"', 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {'#', 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A, 0x00},
+    {'$', 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04, 0x00},
+    {'%', 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00},
+    {'&', 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D, 0x00},
+    {'\'', 0x0C, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {'(', 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00},
+    {')', 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00},
+    {'*', 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00, 0x00, 0x00},
+    {'+', 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00, 0x00},
+    {',', 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08, 0x00},
+    {'-', 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00},
+    {'.', 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00},
+    {'/', 0x00, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},
+    {'0', 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E, 0x00},
+    {'1', 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x1F, 0x00},
+    {'2', 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F, 0x00},
+    {'3', 0x1F, 0x02, 0x04, 0x02, 0x01, 0x01, 0x1E, 0x00},
+    {'4', 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02, 0x00},
+    {'5', 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E, 0x00},
+    {'6', 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E, 0x00},
+    {'7', 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00},
+    {'8', 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E, 0x00},
+    {'9', 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C, 0x00},
+    {':', 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00, 0x00},
+    {';', 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08, 0x00},
+    {'<', 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00},
+    {'=', 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00, 0x00},
+    {'>', 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00},
+    {'?', 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00},
+    {'@', 0x0E, 0x11, 0x00, 0x0D, 0x15, 0x15, 0x0E, 0x00},
+    {'A', 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x00},
+    {'B', 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E, 0x00},
+    {'C', 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E, 0x00},
+    {'D', 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C, 0x00},
+    {'E', 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F, 0x00},
+    {'F', 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10, 0x00},
+    {'G', 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F, 0x00},
+    {'H', 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00},
+    {'I', 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x1F, 0x00},
+    {'J', 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C, 0x00},
+    {'K', 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00},
+    {'L', 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F, 0x00},
+    {'M', 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00},
+    {'N', 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00},
+    {'O', 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00},
+    {'P', 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10, 0x00},
+    {'Q', 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D, 0x00},
+    {'R', 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11, 0x00},
+    {'S', 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E, 0x00},
+    {'T', 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00},
+    {'U', 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00},
+    {'V', 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00},
+    {'W', 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A, 0x00},
+    {'X', 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11, 0x00},
+    {'Y', 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x00},
+    {'Z', 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F, 0x00},
+    {'[', 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E, 0x00},
+    {'\\', 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00},
+    {']', 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E, 0x00},
+    {'^', 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {'_', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x00},
+    {'`', 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {'a', 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00},
+    {'b', 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E, 0x00},
+    {'c', 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E, 0x00},
+    {'d', 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F, 0x00},
+    {'e', 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00},
+    {'f', 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08, 0x00},
+    {'g', 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E, 0x00},
+    {'h', 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00},
+    {'i', 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E, 0x00},
+    {'j', 0x02, 0x00, 0x02, 0x02, 0x02, 0x12, 0x0C, 0x00},
+    {'k', 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00},
+    {'l', 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00},
+    {'m', 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11, 0x00},
+    {'n', 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00},
+    {'o', 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00},
+    {'p', 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10, 0x00},
+    {'q', 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01, 0x00},
+    {'r', 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00},
+    {'s', 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E, 0x00},
+    {'t', 0x08, 0x1C, 0x08, 0x08, 0x08, 0x09, 0x06, 0x00},
+    {'u', 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D, 0x00},
+    {'v', 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00},
+    {'w', 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A, 0x00},
+    {'x', 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00},
+    {'y', 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E, 0x00},
+    {'z', 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F, 0x00},
+    {'{', 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00},
+    {'|', 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00},
+    {'}', 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00},
+};
+
+void HD44780_Reset(HD44780 *self) {
+
+    unsigned int i;
+    memset(self, 0, sizeof(*self));     // counters at 0, cursor off, CGRAM blank
+    self->LCD_EntryMode = 0x02;
+    self->LCD_CursorBlink = FIXED;
+    self->LCD_DisplayEnable = 1;
+    self->RAM_current = DDR;
+    for (i = 0; i < sizeof(HD44780_Font) / sizeof(HD44780_Font[0]); i++)
+        memcpy(self->CGROM[HD44780_Font[i][0]], &HD44780_Font[i][1], 8);
+    memset(self->DDRAM, 0x20, sizeof(self->DDRAM));
+    self->CGRAM_changed = 0x1FF;
+
+}
+
+void HD44780_Instruction(HD44780 *self, uint16_t instruction) {
+
+    uint8_t i, n, m;
+    if (instruction & HD44780_DATA) {
+        if (self->RAM_current == CGR) {
+            n = self->CGRAM_counter / 8;
+            m = self->CGRAM_counter % 8;
+            self->CGROM[n][m] = instruction & 0xFF;
+            self->CGRAM_changed |= 1 << n;
+            if (self->CGRAM_counter < 64)
+                self->CGRAM_counter++;
+        } else {
+            if (self->DDRAM_counter < sizeof(self->DDRAM)) // 0x68-0x7F would land in CGROM
+                self->DDRAM[self->DDRAM_counter] = instruction & 0xFF;
+            if (self->LCD_EntryMode & 0x02) {
+                if (self->DDRAM_counter < 104) {
+                    if (self->DDRAM_counter == 0x27)
+                        self->DDRAM_counter = 0x40;
+                    else
+                        self->DDRAM_counter++;
+                }
+                if (self->LCD_EntryMode & 0x01) {
+                    if (self->DDRAM_display < 24)
+                        self->DDRAM_display++;
+                }
+            } else {
+                if (self->DDRAM_counter > 0) {
+                    if (self->DDRAM_counter == 0x40)
+                        self->DDRAM_counter = 0x27;
+                    else
+                        self->DDRAM_counter--;
+                }
+                if (self->LCD_EntryMode & 0x01) {
+                    if (self->DDRAM_display > 0)
+                        self->DDRAM_display--;
+                }
+            }
+        }
+    } else {
+        for (i = 0; i < 8; i++)
+            if (instruction & (0x80 >> i))
+                break;
+        switch (i) {
+            // SET DDRAM ADDRESS
+            case 0:
+                self->DDRAM_counter = instruction & 0x7F;
+                self->RAM_current = DDR;
+                break;
+            // SET CGRAM ADDRESS
+            case 1:
+                self->CGRAM_counter = instruction & 0x3F;
+                self->RAM_current = CGR;
+                break;
+            // CURSOR/DISPLAY SHIFT
+            case 3:
+                if (instruction & 0x08) {
+                    if (instruction & 0x04) {
+                        if (self->DDRAM_display < 24)
+                            self->DDRAM_display++;
+                    } else {
+                        if (self->DDRAM_display > 0)
+                            self->DDRAM_display--;
+                    }
+                } else {
+                    if (instruction & 0x04) {
+                        if (self->DDRAM_counter < 104) {
+                            if (self->DDRAM_counter == 0x27)
+                                self->DDRAM_counter = 0x40;
+                            else
+                                self->DDRAM_counter++;
+                        }
+                    } else {
+                        if (self->DDRAM_counter > 0) {
+                            if (self->DDRAM_counter == 0x40)
+                                self->DDRAM_counter = 0x27;
+                            else
+                                self->DDRAM_counter--;
+                        }
+                    }
+                }
+                break;
+            // DISPLAY ON/OFF CONTROL
+            case 4:
+                self->LCD_CursorBlink = instruction & 0x01;
+                self->LCD_CursorEnable = (instruction & 0x02) >> 1;
+                self->LCD_DisplayEnable = (instruction & 0x04) >> 2;
+                self->LCD_CursorState = 0;
+                break;
+            // ENTRY MODE SET
+            case 5:
+                self->LCD_EntryMode = instruction & 0x03;
+                break;
+            // HOME
+            case 6:
+                self->DDRAM_counter = 0;
+                self->DDRAM_display = 0;
+                break;
+            // CLEAR
+            case 7:
+                for (i = 0; i < 80; i++)
+                    self->DDRAM[i] = 0x20;
+                self->DDRAM_counter = 0;
+                self->DDRAM_display = 0;
+                break;
+        }
+    }
+
+}
+
+uint8_t HD44780_Address(const HD44780 *self, uint8_t row, uint8_t column) {
+
+    return self->DDRAM_display + column + row * 0x40;
+
+}
+
+int HD44780_CursorAt(const HD44780 *self, uint8_t row, uint8_t column) {
+
+    return (self->LCD_CursorState || self->LCD_CursorBlink == FIXED) && self->LCD_DisplayEnable
+        && self->LCD_CursorEnable && self->DDRAM_counter == HD44780_Address(self, row, column);
+
+}
+
+void HD44780_GetLine(const HD44780 *self, uint8_t row, char line[HD44780_COLUMNS + 1], char unprintable) {
+
+    uint8_t column, c;
+    for (column = 0; column < HD44780_COLUMNS; column++) {
+        c = self->LCD_DisplayEnable ? self->DDRAM[HD44780_Address(self, row, column)] : ' ';
+        line[column] = (c >= 0x20 && c < 0x7F) ? (char)c : unprintable;
+    }
+    line[HD44780_COLUMNS] = '\0';
+
+}
+
+void HD44780_GetPixels(const HD44780 *self, uint8_t pixels[HD44780_PIXEL_HEIGHT][HD44780_PIXEL_WIDTH]) {
+
+    uint8_t row, column, x, y, pattern;
+    for (row = 0; row < HD44780_ROWS; row++) {
+        for (column = 0; column < HD44780_COLUMNS; column++) {
+            const uint8_t *glyph = self->CGROM[self->DDRAM[HD44780_Address(self, row, column)] & 0x7F];
+            int cursor = HD44780_CursorAt(self, row, column);
+            for (y = 0; y < HD44780_CHAR_HEIGHT; y++) {
+                pattern = !self->LCD_DisplayEnable ? 0 : cursor ? 0x1F : glyph[y];
+                for (x = 0; x < HD44780_CHAR_WIDTH; x++)
+                    pixels[row * HD44780_CHAR_HEIGHT + y][column * HD44780_CHAR_WIDTH + x] =
+                        (pattern >> (HD44780_CHAR_WIDTH - 1 - x)) & 0x01;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,72 @@
+#ifndef HD44780_H_INCLUDED
+#define HD44780_H_INCLUDED
+
+// hd44780.h - the HD44780 controller of a 16x2 LCD, without any graphics
+//
+// DDRAM, CGRAM, entry mode, display shift and cursor, driven by the same
+// instruction words as LCDSim_Instruction (bit 8 set = data register). The
+// built-in font is the one in cgrom.bin, so nothing is read from disk and
+// SDL is not needed: a test can feed it thousands of writes and then read
+// back the visible text or dots. LCDSim draws an HD44780 on screen.
+
+#include <stdint.h>
+
+#define CLEAR_DISPLAY        0x01
+#define LCD_HOME             0x02
+#define LCD_START            0x03
+#define ENTRY_MODE_SET       0x06
+#define DISPLAY              0x08
+#define SHIFT_CURSOR_LEFT    0x10
+#define SHIFT_CURSOR_RIGHT   0x14
+#define SHIFT_DISPLAY_LEFT   0x18
+#define SHIFT_DISPLAY_RIGHT  0x1C
+#define FUNCTION_SET         0x28
+#define SET_DDRAM_AD         0x80
+#define SET_CGRAM_AD         0x40
+
+#define HD44780_DATA         0x0100  // instruction bit selecting the data register
+#define HD44780_COLUMNS      16
+#define HD44780_ROWS         2
+#define HD44780_CHAR_WIDTH   5
+#define HD44780_CHAR_HEIGHT  8
+#define HD44780_PIXEL_WIDTH  (HD44780_COLUMNS * HD44780_CHAR_WIDTH)   // 80
+#define HD44780_PIXEL_HEIGHT (HD44780_ROWS * HD44780_CHAR_HEIGHT)     // 16
+
+typedef enum Cursor Cursor;
+enum Cursor { FIXED, BLINK };
+
+typedef enum Actual Actual;
+enum Actual { CGR, DDR };
+
+typedef struct {
+        Actual RAM_current;
+        uint8_t DDRAM[104];
+        uint8_t CGROM[128][8];          // character patterns, 0-7 are CGRAM
+        uint8_t DDRAM_counter;
+        uint8_t CGRAM_counter;
+        uint8_t DDRAM_display;
+        uint8_t LCD_EntryMode;
+        uint8_t LCD_DisplayEnable;
+        uint8_t LCD_CursorEnable;
+        uint8_t LCD_CursorState;        // blink phase, toggled by whoever draws
+        Cursor LCD_CursorBlink;
+        uint16_t CGRAM_changed;         // bit n: CGROM[n] was written, cleared by the reader
+} HD44780;
+
+// Power-on state with the built-in font
+void    HD44780_Reset(HD44780 *self);
+void    HD44780_Instruction(HD44780 *self, uint16_t instruction);
+
+// DDRAM address shown at a row and column of the display, after shifting
+uint8_t HD44780_Address(const HD44780 *self, uint8_t row, uint8_t column);
+// Whether the cursor block covers that position right now
+int     HD44780_CursorAt(const HD44780 *self, uint8_t row, uint8_t column);
+
+// Visible text of one row, 16 character codes and a terminating 0. Codes
+// that are not printable ASCII (CGRAM characters 0-7 among them) read as
+// `unprintable`. A display switched off reads as spaces.
+void    HD44780_GetLine(const HD44780 *self, uint8_t row, char line[HD44780_COLUMNS + 1], char unprintable);
+// The 80x16 dot matrix as the panel shows it, cursor included: 1 = dot on
+void    HD44780_GetPixels(const HD44780 *self, uint8_t pixels[HD44780_PIXEL_HEIGHT][HD44780_PIXEL_WIDTH]);
+
+#endif // HD44780_H_INCLUDED
@@ -15,6 +15,7 @@ LCDSim* LCDSim_Create(SDL_Surface *screen, int x, int y, const char* base_path)
         self->gu.on_screen.x = x;
         self->gu.on_screen.y = y;
         self->lastTime = SDL_GetTicks();
+        self->dirty = 1;
     }
 
     self->lastTime = SDL_GetTicks();
@@ -36,121 +37,27 @@ LCDSim* LCDSim_Create(SDL_Surface *screen, int x, int y, const char* base_path)
 void LCDSim_Draw(LCDSim *self) {
 
     Uint32 nowTime = SDL_GetTicks();
-    SDL_BlitSurface(self->gu.image, NULL, self->gu.temp_screen, &self->gu.position);
     if (nowTime - self->lastTime > 500) {
         self->mcu.LCD_CursorState = !self->mcu.LCD_CursorState;
         self->lastTime = nowTime;
     }
-    Pixel_Refresh(self->mcu, self->gu.pixel);
-    Pixel_Draw(&self->gu);
+    Cell_Draw(&self->gu, &self->mcu);
     SDL_BlitSurface(self->gu.temp_screen, NULL, self->gu.screen, &self->gu.on_screen);
+    self->dirty = 0;
+
+}
+
+int LCDSim_Blinking(LCDSim *self) {
+
+    return self->mcu.LCD_CursorBlink == BLINK && self->mcu.LCD_DisplayEnable && self->mcu.LCD_CursorEnable
+        && SDL_GetTicks() - self->lastTime > 500;
 
 }
 
 void LCDSim_Instruction(LCDSim *self, Uint16 instruction) {
 
-    Uint8 i, n, m;
-    if (instruction & 0x0100) {
-        if (self->mcu.RAM_current == CGR) {
-            n = self->mcu.CGRAM_counter / 8;
-            m = self->mcu.CGRAM_counter % 8;
-            self->mcu.CGROM[n][m] = instruction & 0xFF;
-            if (self->mcu.CGRAM_counter < 64)
-                self->mcu.CGRAM_counter++;
-        } else {
-            self->mcu.DDRAM[self->mcu.DDRAM_counter] = instruction & 0xFF;
-            if (self->mcu.LCD_EntryMode & 0x02) {
-                if (self->mcu.DDRAM_counter < 104) {
-                    if (self->mcu.DDRAM_counter == 0x27)
-                        self->mcu.DDRAM_counter = 0x40;
-                    else
-                        self->mcu.DDRAM_counter++;
-                }
-                if (self->mcu.LCD_EntryMode & 0x01) {
-                    if (self->mcu.DDRAM_display < 24)
-                        self->mcu.DDRAM_display++;
-                }
-            } else {
-                if (self->mcu.DDRAM_counter > 0) {
-                    if (self->mcu.DDRAM_counter == 0x40)
-                        self->mcu.DDRAM_counter = 0x27;
-                    else
-                        self->mcu.DDRAM_counter--;
-                }
-                if (self->mcu.LCD_EntryMode & 0x01) {
-                    if (self->mcu.DDRAM_display > 0)
-                        self->mcu.DDRAM_display--;
-                }
-            }
-        }
-    } else {
-        for (i = 0; i < 8; i++)
-            if (instruction & (0x80 >> i))
-                break;
-        switch (i) {
-            // SET DDRAM ADDRESS
-            case 0:
-                self->mcu.DDRAM_counter = instruction & 0x7F;
-                self->mcu.RAM_current = DDR;
-                break;
-            // SET CGRAM ADDRESS
-            case 1:
-                self->mcu.CGRAM_counter = instruction & 0x3F;
-                self->mcu.RAM_current = CGR;
-                break;
-            // CURSOR/DISPLAY SHIFT
-            case 3:
-                if (instruction & 0x08) {
-                    if (instruction & 0x04) {
-                        if (self->mcu.DDRAM_display < 24)
-                            self->mcu.DDRAM_display++;
-                    } else {
-                        if (self->mcu.DDRAM_display > 0)
-                            self->mcu.DDRAM_display--;
-                    }
-                } else {
-                    if (instruction & 0x04) {
-                        if (self->mcu.DDRAM_counter < 104) {
-                            if (self->mcu.DDRAM_counter == 0x27)
-                                self->mcu.DDRAM_counter = 0x40;
-                            else
-                                self->mcu.DDRAM_counter++;
-                        }
-                    } else {
-                        if (self->mcu.DDRAM_counter > 0) {
-                            if (self->mcu.DDRAM_counter == 0x40)
-                                self->mcu.DDRAM_counter = 0x27;
-                            else
-                                self->mcu.DDRAM_counter--;
-                        }
-                    }
-                }
-                break;
-            // DISPLAY ON/OFF CONTROL
-            case 4:
-                self->mcu.LCD_CursorBlink = instruction & 0x01;
-                self->mcu.LCD_CursorEnable = (instruction & 0x02) >> 1;
-                self->mcu.LCD_DisplayEnable = (instruction & 0x04) >> 2;
-                self->mcu.LCD_CursorState = 0;
-                break;
-            // ENTRY MODE SET
-            case 5:
-                self->mcu.LCD_EntryMode = instruction & 0x03;
-                break;
-            // HOME
-            case 6:
-                self->mcu.DDRAM_counter = 0;
-                self->mcu.DDRAM_display = 0;
-                break;
-            // CLEAR
-            case 7:
-                for (i = 0; i < 80; i++)
-                    self->mcu.DDRAM[i] = 0x20;
-                self->mcu.DDRAM_counter = 0;
-                self->mcu.DDRAM_display = 0;
-                break;
-        }
-    }
+    HD44780_Instruction(&self->mcu, instruction);
+    self->dirty = 1;
 
 }
 
@@ -160,6 +67,7 @@ LCDSim* LCDSim_Destroy(LCDSim *self) {
     SDL_FreeSurface(self->gu.color[1]);
     SDL_FreeSurface(self->gu.image);
     SDL_FreeSurface(self->gu.temp_screen);
+    SDL_FreeSurface(self->gu.atlas);
     free(self);
     return NULL;
 
@@ -167,44 +75,27 @@ LCDSim* LCDSim_Destroy(LCDSim *self) {
 
 void HD44780_Init(HD44780 *self, const char* base_path) {
     char full_path[MAX_PATH_LENGTH];
+    Uint16 i;
+    Uint8 j, cgrom_array[1152] = {0};
 
-    // Init counter
-    self->CGRAM_counter = 0;
-    self->DDRAM_counter = 0;
-    self->DDRAM_display = 0;
-    self->LCD_EntryMode = 0x02;
-    self->LCD_CursorEnable = 0;
-    self->LCD_CursorBlink = FIXED;
-    self->LCD_CursorState = 0;
-    self->LCD_DisplayEnable = 1;
-    self->RAM_current = DDR;
-
-    int chars_written = snprintf(full_path, MAX_PATH_LENGTH, "%s%s", base_path, "cgrom.bin");
+    HD44780_Reset(self);
 
-    // Init CGROM
-    Uint16 i;
-    Uint8 j, cgrom_array[1152];
+    // Same font as the built-in one, but an edited cgrom.bin still wins
+    snprintf(full_path, MAX_PATH_LENGTH, "%s%s", base_path, "cgrom.bin");
     FILE *cgrom = fopen(full_path, "rb");
     if (cgrom == NULL) {
-        perror("Error opening cgrom.bin");
-        exit(EXIT_FAILURE);
+        perror("Error opening cgrom.bin, using the built-in font");
+        return;
     }
-    fread(cgrom_array, sizeof(cgrom_array), 1, cgrom);
-    for (int row = 0; row < 8; ++row)
-        self->CGROM['H'][row] = 0b11111;  // Make "H" a solid block for test
-
+    fread(cgrom_array, 1, sizeof(cgrom_array), cgrom);
     for (i = 0; i < 1152; i += 9) {
         if (cgrom_array[i] != 0) {
             for (j = 0; j < 8; j++)
-                self->CGROM[cgrom_array[i]][j] = cgrom_array[i+j+1];
+                self->CGROM[cgrom_array[i] & 0x7F][j] = cgrom_array[i+j+1];
         } else break;
     }
     fclose(cgrom);
 
-    // Init DDRAM
-    for (i = 0; i < 104; i++)
-        self->DDRAM[i] = 0x20;
-
 }
 
 void GraphicUnit_Init_old(GraphicUnit *self, const char* base_path) {
@@ -228,7 +119,7 @@ void GraphicUnit_Init_old(GraphicUnit *self, const char* base_path) {
 
 
     self->image = SDL_LoadBMP(full_path);
-    Pixel_Init(self->pixel);
+    Cell_Init(self->cell);
 
 }
 
@@ -254,69 +145,106 @@ void GraphicUnit_Init(GraphicUnit *self, const char* base_path) {
                                              0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
 
     self->image = SDL_LoadBMP(full_path);
-    Pixel_Init(self->pixel);
+    Cell_Init(self->cell);
+
+    // The first Cell_Draw renders all 128 glyphs into the atlas (every
+    // glyph_stale flag starts set); later calls only redo changed CGRAM ones
+    self->atlas = SDL_CreateRGBSurface(0, GLYPH_SLOTS * CASE_WIDTH * PIXEL_DIM, CASE_HEIGHT * PIXEL_DIM, 32,
+                                       0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    for (i = 0; i < GLYPH_COUNT; i++)
+        self->glyph_stale[i] = 1;
+    for (i = 0; i < CELL_COUNT; i++)
+        self->cell_glyph[i] = GLYPH_UNKNOWN;
+    self->full_redraw = 1;
+    if (self->atlas) {
+        Uint8 block[CASE_HEIGHT] = {0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F};
+        Uint8 blank[CASE_HEIGHT] = {0};
+        Glyph_Render(self, GLYPH_CURSOR, block);
+        Glyph_Render(self, GLYPH_BLANK, blank);
+    }
 }
 
 
 
-void Pixel_Init(Pixel pixel[][CASE_WIDTH][CASE_HEIGHT]) {
+void Cell_Init(SDL_Rect cell[CELL_COUNT]) {
 
-    Uint8 z, x , y;
-    for (z = 0; z < 32; z++) {
-        for(x = 0 ; x < CASE_WIDTH; x++) {
-            for(y = 0 ; y < CASE_HEIGHT; y++) {
-                pixel[z][x][y].position.x = OFFSET_X + (z % 16) * 16 + x*PIXEL_DIM;
-                pixel[z][x][y].position.y = OFFSET_Y + (z >= 16) * 25 + y*PIXEL_DIM;
-                pixel[z][x][y].color = GREEN;
-            }
-        }
+    Uint8 z;
+    for (z = 0; z < CELL_COUNT; z++) {
+        cell[z].x = OFFSET_X + (z % 16) * 16;
+        cell[z].y = OFFSET_Y + (z >= 16) * 25;
+        cell[z].w = CASE_WIDTH * PIXEL_DIM;
+        cell[z].h = CASE_HEIGHT * PIXEL_DIM;
     }
 
 }
 
-void Pixel_Refresh(HD44780 mcu, Pixel pixel[][CASE_WIDTH][CASE_HEIGHT]) {
-
-    Uint8 z, x ,y, n;
-    for (z = 0; z < 32; z++) {
-        for (x = 0; x < CASE_WIDTH; x++) {
-            for (y = 0; y < CASE_HEIGHT; y++) {
-                if (!mcu.LCD_DisplayEnable)
-                    pixel[z][x][y].color = GREEN;
-                else {
-                    n = mcu.DDRAM_display + z%16 + (z >= 16) * 0x40;
-                    if ((mcu.CGROM[mcu.DDRAM[n]][y] >> (CASE_WIDTH - 1 - x)) & 0x01)
-                        pixel[z][x][y].color = BLACK;
-                    else
-                        pixel[z][x][y].color = GREEN;
-                }
-            }
-        }
-    }
-    if ((mcu.LCD_CursorState || mcu.LCD_CursorBlink == FIXED) && mcu.LCD_DisplayEnable && mcu.LCD_CursorEnable) {
-        if ((mcu.DDRAM_display <= mcu.DDRAM_counter) && ((mcu.DDRAM_display + 0x0F) >= mcu.DDRAM_counter)) {
-            for (x = 0; x < CASE_WIDTH; x++)
-                for (y = 0; y < CASE_HEIGHT; y++)
-                    pixel[mcu.DDRAM_counter - mcu.DDRAM_display][x][y].color = BLACK;
-        }
-        if ((0x40 + mcu.DDRAM_display <= mcu.DDRAM_counter) && ((mcu.DDRAM_display + 0x4F) >= mcu.DDRAM_counter)) {
-            for (x = 0; x < CASE_WIDTH; x++)
-                for (y = 0; y < CASE_HEIGHT; y++)
-                    pixel[16 + mcu.DDRAM_counter - mcu.DDRAM_display - 0x40][x][y].color = BLACK;
+// Renders a 5x8 pattern into its atlas slot, lit pixels in color[BLACK]
+void Glyph_Render(GraphicUnit *self, Uint8 slot, const Uint8 pattern[CASE_HEIGHT]) {
+
+    Uint8 x, y;
+    SDL_Rect dot;
+    for (x = 0; x < CASE_WIDTH; x++) {
+        for (y = 0; y < CASE_HEIGHT; y++) {
+            dot.x = (slot * CASE_WIDTH + x) * PIXEL_DIM;
+            dot.y = y * PIXEL_DIM;
+            dot.w = PIXEL_DIM;
+            dot.h = PIXEL_DIM;
+            SDL_BlitSurface(self->color[((pattern[y] >> (CASE_WIDTH - 1 - x)) & 0x01) ? BLACK : GREEN],
+                            NULL, self->atlas, &dot);
         }
     }
 
 }
 
-void Pixel_Draw(GraphicUnit *self) {
+// Atlas slot cell z shows: its character, the cursor block or blank
+static Uint8 Cell_Glyph(HD44780 *mcu, Uint8 z) {
 
-    Uint8 z, x, y;
-    for (z = 0; z < 32; z++) {
-        for (x = 0; x < CASE_WIDTH; x++) {
-            for (y = 0; y < CASE_HEIGHT; y++) {
-                SDL_BlitSurface(self->color[self->pixel[z][x][y].color], NULL, self->temp_screen, &self->pixel[z][x][y].position);
-            }
+    if (!mcu->LCD_DisplayEnable)
+        return GLYPH_BLANK;
+    if (HD44780_CursorAt(mcu, z / 16, z % 16))
+        return GLYPH_CURSOR;
+    return mcu->DDRAM[HD44780_Address(mcu, z / 16, z % 16)] & 0x7F;
+
+}
+
+// Draws the panel into temp_screen from the glyph atlas. Only cells showing
+// a different glyph than last time, or one whose CGRAM pattern changed, are
+// blitted again; the background image is only redrawn after a reset.
+void Cell_Draw(GraphicUnit *self, HD44780 *mcu) {
+
+    Uint8 z, slot;
+    SDL_Rect src, dest;
+    for (slot = 0; slot < 16; slot++)
+        if (mcu->CGRAM_changed & (1 << slot))
+            self->glyph_stale[slot] = 1;
+    mcu->CGRAM_changed = 0;
+    for (slot = 0; slot < GLYPH_COUNT; slot++) {
+        if (self->glyph_stale[slot]) {
+            Glyph_Render(self, slot, mcu->CGROM[slot]);
+            for (z = 0; z < CELL_COUNT; z++)
+                if (self->cell_glyph[z] == slot)
+                    self->cell_glyph[z] = GLYPH_UNKNOWN;
+            self->glyph_stale[slot] = 0;
         }
     }
+    if (self->full_redraw) {
+        SDL_BlitSurface(self->image, NULL, self->temp_screen, &self->position);
+        for (z = 0; z < CELL_COUNT; z++)
+            self->cell_glyph[z] = GLYPH_UNKNOWN;
+        self->full_redraw = 0;
+    }
+    src.y = 0;
+    src.w = CASE_WIDTH * PIXEL_DIM;
+    src.h = CASE_HEIGHT * PIXEL_DIM;
+    for (z = 0; z < CELL_COUNT; z++) {
+        slot = Cell_Glyph(mcu, z);
+        if (slot == self->cell_glyph[z])
+            continue;
+        src.x = slot * CASE_WIDTH * PIXEL_DIM;
+        dest = self->cell[z];
+        SDL_BlitSurface(self->atlas, &src, self->temp_screen, &dest);
+        self->cell_glyph[z] = slot;
+    }
 
 }
 
@@ -4,24 +4,19 @@
 // lcdsim.h, by Dylan GAGEOT
 
 #include <SDL2/SDL.h>
+#include "hd44780.h"
 
-#define CLEAR_DISPLAY        0x01
-#define LCD_HOME             0x02
-#define LCD_START            0x03
-#define ENTRY_MODE_SET       0x06
-#define DISPLAY              0x08
-#define SHIFT_CURSOR_LEFT    0x10
-#define SHIFT_CURSOR_RIGHT   0x14
-#define SHIFT_DISPLAY_LEFT   0x18
-#define SHIFT_DISPLAY_RIGHT  0x1C
-#define FUNCTION_SET         0x28
-#define SET_DDRAM_AD         0x80
-#define SET_CGRAM_AD         0x40
-#define CASE_WIDTH 5
-#define CASE_HEIGHT 8
+#define CASE_WIDTH HD44780_CHAR_WIDTH
+#define CASE_HEIGHT HD44780_CHAR_HEIGHT
 #define OFFSET_X 38
 #define OFFSET_Y 50
 #define PIXEL_DIM 3
+#define CELL_COUNT 32
+#define GLYPH_COUNT 128
+#define GLYPH_CURSOR 128        // atlas slot of the block cursor
+#define GLYPH_BLANK 129         // atlas slot of an unlit cell (display off)
+#define GLYPH_SLOTS 130
+#define GLYPH_UNKNOWN 0xFF      // cell_glyph value forcing a redraw
 
 
 #define MAX_PATH_LENGTH 512
@@ -29,47 +24,27 @@
 typedef enum Color Color;
 enum Color { BLACK, GREEN };
 
-typedef enum Cursor Cursor;
-enum Cursor { FIXED, BLINK };
-
-typedef enum Actual Actual;
-enum Actual { CGR, DDR };
-
 
 //{ Structures
 
 typedef struct {
-        SDL_Rect position;
-        Color color;
-} Pixel;
-
-typedef struct {
-        Actual RAM_current;
-        Uint8 DDRAM[104];
-        Uint8 CGROM[128][8];
-        Uint8 DDRAM_counter;
-        Uint8 CGRAM_counter;
-        Uint8 DDRAM_display;
-        Uint8 LCD_EntryMode;
-        Uint8 LCD_DisplayEnable;
-        Uint8 LCD_CursorEnable;
-        Uint8 LCD_CursorState;
-        Cursor LCD_CursorBlink;
-} HD44780;
-
-typedef struct {
-        Pixel pixel[32][CASE_WIDTH][CASE_HEIGHT];
+        SDL_Rect cell[CELL_COUNT];              // each character's place on temp_screen
         SDL_Rect position, on_screen;
         SDL_Surface *screen;
         SDL_Surface *temp_screen;
         SDL_Surface *image;
         SDL_Surface *color[2];
+        SDL_Surface *atlas;                     // every glyph pre-rendered, GLYPH_SLOTS cells in a row
+        Uint8 glyph_stale[GLYPH_COUNT];         // CGROM/CGRAM pattern changed, re-render before use
+        Uint8 cell_glyph[CELL_COUNT];           // atlas slot drawn in each cell of temp_screen
+        Uint8 full_redraw;                      // temp_screen needs the background image again
 } GraphicUnit;
 
 typedef struct {
         HD44780 mcu;
         GraphicUnit gu;
         Uint32 lastTime;
+        Uint8 dirty;            // the display changed since the last LCDSim_Draw
 } LCDSim;
 
 //}
@@ -77,10 +52,14 @@ typedef struct {
 //{ Functions
 
 // To create the emulator and exploit it
+// LCDSim_Instruction only updates the controller state and sets dirty, so a
+// program sending many instructions can call LCDSim_Draw once per frame.
+// LCDSim_Blinking tells whether the blinking cursor is due to change.
 LCDSim* LCDSim_Create(SDL_Surface *screen, int x, int y, const char* base_path);
 void    LCDSim_Draw(LCDSim *self);
 void    LCDSim_Instruction(LCDSim *self, Uint16 instruction);
 LCDSim* LCDSim_Destroy(LCDSim *self);
+int     LCDSim_Blinking(LCDSim *self);
 
 // For the easy usage of the LCD
 void    LCD_PutChar(LCDSim *self, char car);
@@ -101,11 +80,12 @@ void    LCD_SetCursor(LCDSim *self, Uint8 line, Uint8 column);
 void    LCD_CustomChar(LCDSim *self, Uint8 char_number, Uint8* custom);
 
 // For deeper usage
+// HD44780_Reset plus the font from base_path/cgrom.bin
 void    HD44780_Init(HD44780 *self, const char* base_path);
 void    GraphicUnit_Init(GraphicUnit *self, const char* base_path);
-void    Pixel_Init(Pixel pixel[][CASE_WIDTH][CASE_HEIGHT]);
-void    Pixel_Refresh(HD44780 mcu, Pixel pixel[][CASE_WIDTH][CASE_HEIGHT]);
-void    Pixel_Draw(GraphicUnit *self);
+void    Cell_Init(SDL_Rect cell[CELL_COUNT]);
+void    Glyph_Render(GraphicUnit *self, Uint8 slot, const Uint8 pattern[CASE_HEIGHT]);
+void    Cell_Draw(GraphicUnit *self, HD44780 *mcu);
 
 //}
 
@@ -0,0 +1,187 @@
+// disasm6502.h - one line 6502 disassembler shared by the simulator and tracefmt
+//
+// Prints "PC: opcode operands  MNEMONIC operand" followed by a newline, the
+// format trace.log has always used and tools/tracer/tracer.py parses. The
+// caller supplies the three instruction bytes, so it works on live RAM as
+// well as on a memory image rebuilt from a binary trace.
+
+#ifndef DISASM6502_H
+#define DISASM6502_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+static void disasm6502(FILE *stream, uint16_t pc, uint8_t opcode, uint8_t op1, uint8_t op2) {
+    // Print PC and opcode byte(s)
+    fprintf(stream, "%04X: %02X ", pc, opcode);
+
+    // This is a simplified disassembler for common opcodes.
+    // A complete one would be much larger.
+    switch (opcode) {
+        case 0x00: fprintf(stream, "         BRK"); break; // Implied
+        case 0x01: fprintf(stream, "%02X       ORA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0x05: fprintf(stream, "%02X       ORA $%02X", op1, op1); break;     // Zero Page
+        case 0x06: fprintf(stream, "%02X       ASL $%02X", op1, op1); break;     // Zero Page
+        case 0x08: fprintf(stream, "         PHP"); break; // Implied
+        case 0x09: fprintf(stream, "%02X       ORA #$%02X", op1, op1); break;   // Immediate
+        case 0x0A: fprintf(stream, "         ASL A"); break; // Accumulator
+        case 0x0D: fprintf(stream, "%02X %02X    ORA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x0E: fprintf(stream, "%02X %02X    ASL $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x10: fprintf(stream, "%02X       BPL $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0x11: fprintf(stream, "%02X       ORA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0x15: fprintf(stream, "%02X       ORA $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x16: fprintf(stream, "%02X       ASL $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x18: fprintf(stream, "         CLC"); break; // Implied
+        case 0x19: fprintf(stream, "%02X %02X    ORA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0x1D: fprintf(stream, "%02X %02X    ORA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0x1E: fprintf(stream, "%02X %02X    ASL $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0x20: fprintf(stream, "%02X %02X    JSR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x21: fprintf(stream, "%02X       AND ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0x24: fprintf(stream, "%02X       BIT $%02X", op1, op1); break;     // Zero Page
+        case 0x25: fprintf(stream, "%02X       AND $%02X", op1, op1); break;     // Zero Page
+        case 0x26: fprintf(stream, "%02X       ROL $%02X", op1, op1); break;     // Zero Page
+        case 0x28: fprintf(stream, "         PLP"); break; // Implied
+        case 0x29: fprintf(stream, "%02X       AND #$%02X", op1, op1); break;   // Immediate
+        case 0x2A: fprintf(stream, "         ROL A"); break; // Accumulator
+        case 0x2C: fprintf(stream, "%02X %02X    BIT $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x2D: fprintf(stream, "%02X %02X    AND $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x2E: fprintf(stream, "%02X %02X    ROL $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x30: fprintf(stream, "%02X       BMI $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0x31: fprintf(stream, "%02X       AND ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0x35: fprintf(stream, "%02X       AND $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x36: fprintf(stream, "%02X       ROL $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x38: fprintf(stream, "         SEC"); break; // Implied
+        case 0x39: fprintf(stream, "%02X %02X    AND $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0x3D: fprintf(stream, "%02X %02X    AND $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0x3E: fprintf(stream, "%02X %02X    ROL $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0x40: fprintf(stream, "         RTI"); break; // Implied
+        case 0x41: fprintf(stream, "%02X       EOR ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0x45: fprintf(stream, "%02X       EOR $%02X", op1, op1); break;     // Zero Page
+        case 0x46: fprintf(stream, "%02X       LSR $%02X", op1, op1); break;     // Zero Page
+        case 0x48: fprintf(stream, "         PHA"); break; // Implied
+        case 0x49: fprintf(stream, "%02X       EOR #$%02X", op1, op1); break;   // Immediate
+        case 0x4A: fprintf(stream, "         LSR A"); break; // Accumulator
+        case 0x4C: fprintf(stream, "%02X %02X    JMP $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x4D: fprintf(stream, "%02X %02X    EOR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x4E: fprintf(stream, "%02X %02X    LSR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x50: fprintf(stream, "%02X       BVC $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0x51: fprintf(stream, "%02X       EOR ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0x55: fprintf(stream, "%02X       EOR $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x56: fprintf(stream, "%02X       LSR $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x58: fprintf(stream, "         CLI"); break; // Implied
+        case 0x59: fprintf(stream, "%02X %02X    EOR $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0x5D: fprintf(stream, "%02X %02X    EOR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0x5E: fprintf(stream, "%02X %02X    LSR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0x60: fprintf(stream, "         RTS"); break; // Implied
+        case 0x61: fprintf(stream, "%02X       ADC ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0x65: fprintf(stream, "%02X       ADC $%02X", op1, op1); break;     // Zero Page
+        case 0x66: fprintf(stream, "%02X       ROR $%02X", op1, op1); break;     // Zero Page
+        case 0x68: fprintf(stream, "         PLA"); break; // Implied
+        case 0x69: fprintf(stream, "%02X       ADC #$%02X", op1, op1); break;   // Immediate
+        case 0x6A: fprintf(stream, "         ROR A"); break; // Accumulator
+        case 0x6C: fprintf(stream, "%02X %02X    JMP ($%04X)", op1, op2, (op2 << 8) | op1); break; // Indirect Absolute
+        case 0x6D: fprintf(stream, "%02X %02X    ADC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x6E: fprintf(stream, "%02X %02X    ROR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x70: fprintf(stream, "%02X       BVS $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0x71: fprintf(stream, "%02X       ADC ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0x75: fprintf(stream, "%02X       ADC $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x76: fprintf(stream, "%02X       ROR $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x78: fprintf(stream, "         SEI"); break; // Implied
+        case 0x79: fprintf(stream, "%02X %02X    ADC $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0x7D: fprintf(stream, "%02X %02X    ADC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0x7E: fprintf(stream, "%02X %02X    ROR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0x81: fprintf(stream, "%02X       STA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0x84: fprintf(stream, "%02X       STY $%02X", op1, op1); break;     // Zero Page
+        case 0x85: fprintf(stream, "%02X       STA $%02X", op1, op1); break;     // Zero Page
+        case 0x86: fprintf(stream, "%02X       STX $%02X", op1, op1); break;     // Zero Page
+        case 0x88: fprintf(stream, "         DEY"); break; // Implied
+        case 0x8A: fprintf(stream, "         TXA"); break; // Implied
+        case 0x8C: fprintf(stream, "%02X %02X    STY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x8D: fprintf(stream, "%02X %02X    STA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x8E: fprintf(stream, "%02X %02X    STX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0x90: fprintf(stream, "%02X       BCC $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0x91: fprintf(stream, "%02X       STA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0x94: fprintf(stream, "%02X       STY $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x95: fprintf(stream, "%02X       STA $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0x96: fprintf(stream, "%02X       STX $%02X,Y", op1, op1); break;   // Zero Page,Y
+        case 0x98: fprintf(stream, "         TYA"); break; // Implied
+        case 0x99: fprintf(stream, "%02X %02X    STA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0x9A: fprintf(stream, "         TXS"); break; // Implied
+        case 0x9D: fprintf(stream, "%02X %02X    STA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0xA0: fprintf(stream, "%02X       LDY #$%02X", op1, op1); break;   // Immediate
+        case 0xA1: fprintf(stream, "%02X       LDA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0xA2: fprintf(stream, "%02X       LDX #$%02X", op1, op1); break;   // Immediate
+        case 0xA4: fprintf(stream, "%02X       LDY $%02X", op1, op1); break;     // Zero Page
+        case 0xA5: fprintf(stream, "%02X       LDA $%02X", op1, op1); break;     // Zero Page
+        case 0xA6: fprintf(stream, "%02X       LDX $%02X", op1, op1); break;     // Zero Page
+        case 0xA8: fprintf(stream, "         TAY"); break; // Implied
+        case 0xA9: fprintf(stream, "%02X       LDA #$%02X", op1, op1); break;   // Immediate
+        case 0xAA: fprintf(stream, "         TAX"); break; // Implied
+        case 0xAC: fprintf(stream, "%02X %02X    LDY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xAD: fprintf(stream, "%02X %02X    LDA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xAE: fprintf(stream, "%02X %02X    LDX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xB0: fprintf(stream, "%02X       BCS $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0xB1: fprintf(stream, "%02X       LDA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0xB4: fprintf(stream, "%02X       LDY $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xB5: fprintf(stream, "%02X       LDA $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xB6: fprintf(stream, "%02X       LDX $%02X,Y", op1, op1); break;   // Zero Page,Y
+        case 0xB8: fprintf(stream, "         CLV"); break; // Implied
+        case 0xB9: fprintf(stream, "%02X %02X    LDA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0xBA: fprintf(stream, "         TSX"); break; // Implied
+        case 0xBC: fprintf(stream, "%02X %02X    LDY $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0xBD: fprintf(stream, "%02X %02X    LDA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0xBE: fprintf(stream, "%02X %02X    LDX $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+
+        case 0xC0: fprintf(stream, "%02X       CPY #$%02X", op1, op1); break;   // Immediate
+        case 0xC1: fprintf(stream, "%02X       CMP ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0xC4: fprintf(stream, "%02X       CPY $%02X", op1, op1); break;     // Zero Page
+        case 0xC5: fprintf(stream, "%02X       CMP $%02X", op1, op1); break;     // Zero Page
+        case 0xC6: fprintf(stream, "%02X       DEC $%02X", op1, op1); break;     // Zero Page
+        case 0xC8: fprintf(stream, "         INY"); break; // Implied
+        case 0xC9: fprintf(stream, "%02X       CMP #$%02X", op1, op1); break;   // Immediate
+        case 0xCA: fprintf(stream, "         DEX"); break; // Implied
+        case 0xCC: fprintf(stream, "%02X %02X    CPY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xCD: fprintf(stream, "%02X %02X    CMP $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xCE: fprintf(stream, "%02X %02X    DEC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xD0: fprintf(stream, "%02X       BNE $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0xD1: fprintf(stream, "%02X       CMP ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0xD5: fprintf(stream, "%02X       CMP $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xD6: fprintf(stream, "%02X       DEC $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xD8: fprintf(stream, "         CLD"); break; // Implied
+        case 0xD9: fprintf(stream, "%02X %02X    CMP $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0xDD: fprintf(stream, "%02X %02X    CMP $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0xDE: fprintf(stream, "%02X %02X    DEC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        case 0xE0: fprintf(stream, "%02X       CPX #$%02X", op1, op1); break;   // Immediate
+        case 0xE1: fprintf(stream, "%02X       SBC ($%02X,X)", op1, op1); break; // Indexed Indirect, X
+        case 0xE4: fprintf(stream, "%02X       CPX $%02X", op1, op1); break;     // Zero Page
+        case 0xE5: fprintf(stream, "%02X       SBC $%02X", op1, op1); break;     // Zero Page
+        case 0xE6: fprintf(stream, "%02X       INC $%02X", op1, op1); break;     // Zero Page
+        case 0xE8: fprintf(stream, "         INX"); break; // Implied
+        case 0xE9: fprintf(stream, "%02X       SBC #$%02X", op1, op1); break;   // Immediate
+        case 0xEA: fprintf(stream, "         NOP"); break; // Implied
+        case 0xEC: fprintf(stream, "%02X %02X    CPX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xED: fprintf(stream, "%02X %02X    SBC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xEE: fprintf(stream, "%02X %02X    INC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
+        case 0xF0: fprintf(stream, "%02X       BEQ $%04X", op1, (pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
+        case 0xF1: fprintf(stream, "%02X       SBC ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
+        case 0xF5: fprintf(stream, "%02X       SBC $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xF6: fprintf(stream, "%02X       INC $%02X,X", op1, op1); break;   // Zero Page,X
+        case 0xF8: fprintf(stream, "         SED"); break; // Implied
+        case 0xF9: fprintf(stream, "%02X %02X    SBC $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
+        case 0xFD: fprintf(stream, "%02X %02X    SBC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+        case 0xFE: fprintf(stream, "%02X %02X    INC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
+
+        default:
+            fprintf(stream, "         ??? (0x%02X)", opcode); // Unknown opcode
+            break;
+    }
+    fprintf(stream, "\n");
+}
+
+#endif
@@ -0,0 +1,131 @@
+// scheduler.h - cycle scheduled events for the simulator
+//
+// Devices post "at cycle N, call fn(user, now)" events; the run loop asks for
+// the next due cycle, runs the CPU up to it with exec6502(budget) and then
+// calls sched_run_due(). Events are kept in a binary min-heap ordered by cycle,
+// ties run in the order they were posted. Callbacks may post new events
+// (a periodic timer simply posts itself again).
+//
+// Included once from simulator.c, like the rest of the simulator it is not a
+// separate translation unit.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SCHED_NEVER UINT64_MAX
+
+typedef void (*sched_fn)(void *user, uint64_t now);
+
+typedef struct {
+    uint64_t when;      // cycle the event is due at
+    uint64_t seq;       // post order, breaks ties
+    sched_fn fn;
+    void *user;
+} ScheduledEvent;
+
+typedef struct {
+    ScheduledEvent *heap;
+    int count;
+    int capacity;
+    uint64_t next_seq;
+} Scheduler;
+
+static inline void sched_init(Scheduler *s) {
+    s->heap = NULL;
+    s->count = 0;
+    s->capacity = 0;
+    s->next_seq = 0;
+}
+
+static inline void sched_free(Scheduler *s) {
+    free(s->heap);
+    sched_init(s);
+}
+
+static inline int sched_before(const ScheduledEvent *a, const ScheduledEvent *b) {
+    return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static inline void sched_sift_up(Scheduler *s, int i) {
+    ScheduledEvent ev = s->heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sched_before(&ev, &s->heap[parent])) break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = ev;
+}
+
+static inline void sched_sift_down(Scheduler *s, int i) {
+    ScheduledEvent ev = s->heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->count) break;
+        if (child + 1 < s->count && sched_before(&s->heap[child + 1], &s->heap[child])) child++;
+        if (!sched_before(&s->heap[child], &ev)) break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    s->heap[i] = ev;
+}
+
+// Returns 0 on success, -1 if out of memory.
+static inline int sched_post(Scheduler *s, uint64_t when, sched_fn fn, void *user) {
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 16;
+        ScheduledEvent *heap = realloc(s->heap, capacity * sizeof(*heap));
+        if (!heap) {
+            printf("Error: out of memory posting scheduler event\n");
+            return -1;
+        }
+        s->heap = heap;
+        s->capacity = capacity;
+    }
+    s->heap[s->count].when = when;
+    s->heap[s->count].seq = s->next_seq++;
+    s->heap[s->count].fn = fn;
+    s->heap[s->count].user = user;
+    sched_sift_up(s, s->count++);
+    return 0;
+}
+
+// Removes every pending event with this callback and user pointer.
+static inline void sched_cancel(Scheduler *s, sched_fn fn, void *user) {
+    int i = 0;
+    while (i < s->count) {
+        if (s->heap[i].fn == fn && s->heap[i].user == user) {
+            s->heap[i] = s->heap[--s->count];
+            if (i < s->count) {
+                sched_sift_down(s, i);
+                sched_sift_up(s, i);
+            }
+            i = 0; // the heap moved around, rescan
+        } else {
+            i++;
+        }
+    }
+}
+
+// Cycle of the earliest pending event, SCHED_NEVER if there is none.
+static inline uint64_t sched_next(const Scheduler *s) {
+    return s->count ? s->heap[0].when : SCHED_NEVER;
+}
+
+// Runs every event due at or before now, in order. Returns how many ran.
+static inline int sched_run_due(Scheduler *s, uint64_t now) {
+    int ran = 0;
+    while (s->count && s->heap[0].when <= now) {
+        ScheduledEvent ev = s->heap[0];
+        s->heap[0] = s->heap[--s->count];
+        if (s->count) sched_sift_down(s, 0);
+        ev.fn(ev.user, now);
+        ran++;
+    }
+    return ran;
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _XOPEN_SOURCE 600 // usleep(), nanosleep() and pthreads under -std=c99
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -5,6 +6,7 @@
 #include <time.h>    // For clock() and CLOCKS_PER_SEC (though less critical now)
 #include <unistd.h>  // For usleep() on Linux/WSL for real-time pacing
 #include <ctype.h>   // For isxdigit(), isspace()
+#include <strings.h> // For strncasecmp()
 #include <limits.h>  // Make sure to include this header for UINT_MAX
 #include <stdbool.h>
 #include <SDL2/SDL.h>
@@ -12,6 +14,10 @@
 
 // Include the fake6502 emulator core
 #include "fake6502.h"
+#include "bus6502.h"
+#include "scheduler.h"
+#include "disasm6502.h"
+#include "trace6502.h"
 #include <signal.h>
 
 
@@ -31,12 +37,17 @@ volatile sig_atomic_t quit_flag = 0;
 
 #define JSR 0x20
 #define RTS 0x60
+#define BRK 0x00
 
 
 // --- Emulated 6502 Memory (64KB) ---
 // This array represents the 6502's 64KB address space.
 uint8_t RAM[65536];
 
+// Paged bus in front of RAM: every page maps straight onto RAM except the
+// I/O pages, which go through a device handler. See setup_bus().
+bus6502_t bus;
+
 LCDSim *lcd = NULL;
 SDL_Window *window = NULL;
 SDL_Surface *screen = NULL;
@@ -46,42 +57,132 @@ SDL_Surface *screen = NULL;
 char *hex_file_path = NULL;
 char *list_file_path = NULL;
 char *break_symbol_name = NULL;
+char *key_script_path = NULL;
+int headless = 0;           // --headless: no SDL, in-memory LCD, no pacing
+int trace_enabled = 1;      // per-instruction trace.bin, off when headless unless --trace
+uint64_t max_cycles = 0;    // --max-cycles: stop after this many cycles (0 = no limit)
+uint64_t clock_hz = 1000000; // --clock-hz: emulated clock rate, Ben Eater's board runs at 1 MHz
+int turbo = 0;              // --turbo: run unthrottled (default under --headless)
+unsigned int lcd_refresh_hz = 60; // --lcd-hz: LCD window frames per second at most
+char *profile_path = NULL;  // --profile: per-PC cycle counts, report written here at exit
+char *folded_path = NULL;   // --folded: call stacks with their cycles, for flamegraph.pl
+char *chrome_trace_path = NULL; // --chrome-trace: every call as a Chrome/Perfetto trace event
+double frame_budget_ms = 0; // --frame-budget: flag marked frames longer than this (0 = no budget)
+char *coverage_prefix = NULL; // --coverage: executed lines and branch directions, <prefix>.map/.info/.html
+int reverse_debugging = 1;  // --no-reverse: no journal, so no rs, rc or who in the debugger
 //unsigned int break_address = 0;
 
-// --- Data Structure for the symbol_list (Linked List) ---
+// --- Symbol table ---
+// Built once from the list file. All names live in one arena and the entries
+// in one array sorted by address, so the nearest symbol at or before a PC is
+// a binary search; an open addressing hash finds a symbol by name. Nothing
+// is allocated or walked per lookup, the run loop can use both freely.
 typedef struct SymbolEntry {
-    char *symbol_name;
+    char *symbol_name;      // points into SymbolTable.names
     unsigned int address;
-    struct SymbolEntry *next;
 } SymbolEntry;
 
+typedef struct {
+    SymbolEntry *entries;   // sorted by address, aliases in list file order
+    int count;
+    char *names;            // arena, every symbol_name back to back
+    int *slots;             // hash slots: entry index + 1, 0 = empty
+    unsigned int slot_mask; // slot count - 1, a power of two
+} SymbolTable;
+
 
 // --- External CPU state variables (from fake6502.h) ---
 // These are declared in fake6502.h and updated by the emulator core.
 extern unsigned char   a, x, y, sp, status;
 extern unsigned short  pc;
 extern unsigned int    clockticks6502; // Total emulated CPU cycles (from fake6502 core)
+extern unsigned int    clockgoal6502;  // exec6502() target, lowered by the hook to end a run early
 
-SymbolEntry *symbol_list = NULL;
+SymbolTable symbols = { NULL, 0, NULL, NULL, 0 };
 
 // Breakpoints storage
-#define MAX_BREAKPOINTS 50
+// One bit per address and kind says whether a breakpoint is set there, so
+// the check made for every instruction (and, for read/write breakpoints,
+// every memory access) is a single bit test. The list with labels,
+// conditions and hit counts is only searched when the bit is set.
+typedef enum { BP_EXEC, BP_READ, BP_WRITE, BP_KINDS } BreakKind;
+
+typedef enum { COND_NONE, COND_A, COND_X, COND_Y, COND_SP, COND_P, COND_MEM, COND_HITS } CondOperand;
+typedef enum { COND_EQ, COND_NE, COND_LT, COND_LE, COND_GT, COND_GE } CondOp;
+
 typedef struct {
-    unsigned int address;
-    char *label;
-} Breakpoint;
+    CondOperand what;
+    uint16_t address;       // COND_MEM: the byte compared
+    CondOp op;
+    unsigned long value;
+    char text[40];          // as typed, for listing
+} BreakCondition;
 
-#define MAX_CALL_STACK 50
 typedef struct {
     unsigned int address;
     char *label;
-} Subroutine;
+    BreakKind kind;
+    BreakCondition cond;    // COND_NONE: always stop
+    unsigned long hits;     // times the address was reached (or accessed)
+} Breakpoint;
+
+#define BP_SET(kind, addr) (bp_bitmap[kind][(addr) >> 3] & (1 << ((addr) & 7)))
+
+#define MAX_CALL_STACK 256     // a frame takes at least 2 bytes of the 256 byte stack
+
+typedef enum { FRAME_ROOT, FRAME_JSR, FRAME_BRK, FRAME_IRQ } FrameKind;
 
-static Subroutine call_stack[MAX_CALL_STACK];
-static int call_stack_depth = 0;
+typedef struct {
+    FrameKind kind;
+    uint16_t call_pc;       // the JSR or BRK, or the instruction an IRQ came before
+    uint16_t target;        // routine entered
+    uint16_t return_pc;     // where its RTS/RTI goes back to
+    int sp;                 // SP once the return address was pushed, 0x100 for the root
+    uint64_t start;         // total_cycles when the call began
+    uint64_t child_cycles;  // inclusive cycles of the calls it made
+    int node;               // its CallNode, -1 when calls are not timed
+} CallFrame;
+
+static CallFrame call_stack[MAX_CALL_STACK]; // see "Shadow call stack"
+static int call_stack_depth = 0;            // frames, the root included
 
-static Breakpoint breakpoints[MAX_BREAKPOINTS];
+typedef struct {
+    uint16_t routine;
+    FrameKind kind;
+    int parent, first_child, next_sibling;  // call tree, -1 for none
+    uint64_t calls;
+    uint64_t inclusive;     // cycles from the call to the return
+    uint64_t exclusive;     // less the cycles of its own calls
+} CallNode;
+
+static CallNode *call_nodes = NULL;
+static int call_node_count = 0;
+static int call_node_capacity = 0;
+static int call_timing = 0;             // keep the call tree: --profile, --folded or --chrome-trace
+static FILE *chrome_trace = NULL;
+static unsigned long chrome_trace_events = 0;
+
+static Breakpoint *breakpoints = NULL; // grown as needed, no fixed limit
 static int breakpoint_count = 0;
+static int breakpoint_capacity = 0;
+static uint8_t bp_bitmap[BP_KINDS][65536 / 8];
+
+static uint64_t total_cycles; // emulated cycles so far, see the run loop
+
+// Read/write breakpoint that fired during the current instruction
+static struct {
+    int pending;
+    BreakKind kind;
+    uint16_t address;
+    uint8_t value;
+} access_break;
+static void note_access_breakpoint(BreakKind kind, uint16_t address, uint8_t value);
+
+// Reverse execution journal, see that section
+static int journaling = 0;              // journal_write() sees every memory write
+static int journal_replaying = 0;       // redoing the journal: devices only, no IRQ entry
+static void journal_instruction(void);
+static void journal_write(uint16_t address, uint8_t value);
 
 // --- LCD Cursor Tracking (New Global/Static Variables) ---
 static int lcd_current_row = 0; // LCD has 2 rows (0 and 1)
@@ -122,30 +223,72 @@ typedef struct {
     TTF_Font *font;
     char **lines;           // Array of strings for list file lines
     int total_lines;        // Total number of lines in list file
+    int *pc_lines;          // 65536 entries: line number (1-based) of each PC, 0 if not listed
     int current_pc_line;    // Line number of current PC (1-based)
     int display_start;      // First line to display (0-based)
     int visible_lines;      // Number of lines that fit in window
     int is_active;          // Whether tracer window is open
+    int redraw;             // Window contents lost (opened, resized, exposed)
+    int drawn_width, drawn_height; // window size the rows below were laid out for
+    SDL_Texture *atlas;     // printable ASCII rendered once, white, one cell per glyph
+    int glyph_width;        // monospace advance
+    int glyph_height;
+    int line_height;        // row pitch in pixels
+    SDL_Texture *canvas;    // render target keeping the rows between frames, NULL if unsupported
+    int *row_drawn;         // per row: what is drawn there, see tracer_row_key()
+    int rows;               // entries in row_drawn
+    int columns;            // characters that fit in a row
+    SDL_Vertex *vertices;   // glyph quads of one frame, rows * columns of them
+    int *indices;
+    Uint32 last_frame_ms;   // when the tracer last followed the running CPU
 } TracerWindow;
 
+#define TRACER_GLYPH_FIRST ' '
+#define TRACER_GLYPH_LAST '~'
+#define TRACER_GLYPHS (TRACER_GLYPH_LAST - TRACER_GLYPH_FIRST + 1)
+#define TRACER_TAB_WIDTH 8
+#define TRACER_REFRESH_HZ 60    // frames per second while the CPU runs freely
+
 // up/down key function + initial window + font increase - Structure to hold trace history
+// One compact snapshot per stepped instruction in a power of two ring, the
+// oldest overwritten once it is full. The TRACE lines are only formatted
+// for the entry shown with [ and ].
 typedef struct {
-    char instruction[128];
-    char cpu_state[256];
-    char ram_state[512];
-    uint16_t pc_value;
+    uint16_t insn_pc;       // instruction that ran
+    uint16_t pc_value;      // PC after it
+    uint8_t opcode, op1, op2;
+    uint8_t a, x, y, sp, status;
+    uint8_t ram[4];         // $0000-$0003 after it
 } TraceEntry;
 
+typedef char trace_entry_is_16_bytes[sizeof(TraceEntry) == 16 ? 1 : -1];
+
+#define TRACE_HISTORY_ENTRIES (1u << 20) // 16 MiB, must be a power of two
+
 static TraceEntry *trace_history = NULL;
-static int trace_history_size = 0;
-static int trace_history_capacity = 0;
+static uint32_t trace_history_head = 0;  // entries ever added
+static int trace_history_size = 0;       // entries kept, oldest is index 0
 static int trace_scroll_index = -1;  // -1 means current (not scrolling)
 static int scroll_mode = 0;
 
 // tracer in SDL2 - Global tracer window instance
 static TracerWindow tracer = {0};
 
+// Value of the 4 upper case hex digits at text, -1 if they aren't
+static int parse_hex4(const char *text) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = text[i];
+        if (c >= '0' && c <= '9') value = value * 16 + (c - '0');
+        else if (c >= 'A' && c <= 'F') value = value * 16 + (c - 'A' + 10);
+        else return -1;
+    }
+    return value;
+}
+
 // tracer in SDL2 - Load list file into memory
+// Also indexes it by PC: lines like "00:822D ..." give the address, the
+// first line listing an address is the one the tracer shows for it.
 int load_list_file(const char *filename) {
     FILE *file = fopen(filename, "r");
     if (!file) {
@@ -162,7 +305,12 @@ int load_list_file(const char *filename) {
     
     // Allocate memory for lines
     tracer.lines = malloc(tracer.total_lines * sizeof(char*));
-    if (!tracer.lines) {
+    tracer.pc_lines = calloc(65536, sizeof(int));
+    if (!tracer.lines || !tracer.pc_lines) {
+        free(tracer.lines);
+        free(tracer.pc_lines);
+        tracer.lines = NULL;
+        tracer.pc_lines = NULL;
         fclose(file);
         return 0;
     }
@@ -175,6 +323,10 @@ int load_list_file(const char *filename) {
         buffer[strcspn(buffer, "\r\n")] = 0;
         tracer.lines[i] = malloc(strlen(buffer) + 1);
         strcpy(tracer.lines[i], buffer);
+        if (strlen(buffer) >= 7 && buffer[2] == ':') {
+            int address = parse_hex4(buffer + 3);
+            if (address >= 0 && !tracer.pc_lines[address]) tracer.pc_lines[address] = i + 1;
+        }
         i++;
     }
     
@@ -185,18 +337,39 @@ int load_list_file(const char *filename) {
 
 // tracer in SDL2 - Find line number for given PC
 int find_pc_line(uint16_t pc_value) {
-    char pc_hex[5];
-    sprintf(pc_hex, "%04X", pc_value);
-    
-    for (int i = 0; i < tracer.total_lines; i++) {
-        // Look for pattern like "00:822D" at start of line
-        if (strlen(tracer.lines[i]) >= 7 && 
-            tracer.lines[i][2] == ':' && 
-            strncmp(tracer.lines[i] + 3, pc_hex, 4) == 0) {
-            return i + 1; // Return 1-based line number
-        }
+    if (!tracer.pc_lines || !tracer.pc_lines[pc_value]) return -1; // Not found
+    return tracer.pc_lines[pc_value]; // 1-based line number
+}
+
+// tracer in SDL2 - Render every printable character once into a texture.
+// Lines are then drawn as one batch of quads cut from it instead of going
+// through SDL_ttf for each line of each frame.
+static int tracer_build_atlas(void) {
+    SDL_Color white = {255, 255, 255, 255};
+    int advance;
+
+    if (TTF_GlyphMetrics(tracer.font, 'M', NULL, NULL, NULL, NULL, &advance) != 0 || advance <= 0) return -1;
+    tracer.glyph_width = advance;
+    tracer.glyph_height = TTF_FontHeight(tracer.font);
+    tracer.line_height = tracer.glyph_height > 20 ? tracer.glyph_height : 20;
+
+    SDL_Surface *sheet = SDL_CreateRGBSurface(0, TRACER_GLYPHS * advance, tracer.glyph_height, 32,
+                                              0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (!sheet) return -1;
+    for (int c = TRACER_GLYPH_FIRST; c <= TRACER_GLYPH_LAST; c++) {
+        SDL_Surface *glyph = TTF_RenderGlyph_Blended(tracer.font, c, white);
+        if (!glyph) continue;
+        SDL_Rect src = {0, 0, glyph->w < advance ? glyph->w : advance, glyph->h};
+        SDL_Rect dest = {(c - TRACER_GLYPH_FIRST) * advance, 0, src.w, src.h};
+        SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE); // copy the coverage into alpha
+        SDL_BlitSurface(glyph, &src, sheet, &dest);
+        SDL_FreeSurface(glyph);
     }
-    return -1; // Not found
+    tracer.atlas = SDL_CreateTextureFromSurface(tracer.renderer, sheet);
+    SDL_FreeSurface(sheet);
+    if (!tracer.atlas) return -1;
+    SDL_SetTextureBlendMode(tracer.atlas, SDL_BLENDMODE_BLEND);
+    return 0;
 }
 
 // tracer in SDL2 - Initialize tracer window
@@ -247,8 +420,10 @@ int init_tracer_window(const char *list_filename) {
         if (tracer.font) break;
     }
     
-    if (!tracer.font) {
+    if (!tracer.font || tracer_build_atlas() != 0) {
         printf("Failed to load font, tracer disabled\n");
+        if (tracer.font) TTF_CloseFont(tracer.font);
+        tracer.font = NULL;
         SDL_DestroyRenderer(tracer.renderer);
         SDL_DestroyWindow(tracer.window);
         TTF_Quit();
@@ -259,10 +434,11 @@ int init_tracer_window(const char *list_filename) {
     tracer.is_active = 1;
     tracer.current_pc_line = -1;
     tracer.display_start = 0;
+    tracer.redraw = 1;
     
     // up/down key function + initial window + font increase - Initialize trace history
-    trace_history_capacity = 1000;  // Store last 1000 trace entries
-    trace_history = malloc(trace_history_capacity * sizeof(TraceEntry));
+    trace_history = malloc(TRACE_HISTORY_ENTRIES * sizeof(TraceEntry));
+    trace_history_head = 0;
     trace_history_size = 0;
     trace_scroll_index = -1;
     scroll_mode = 0;
@@ -271,26 +447,41 @@ int init_tracer_window(const char *list_filename) {
 }
 
 // up/down key function + initial window + font increase - Add trace entry to history
-void add_trace_entry(const char* instruction, const char* cpu_state, const char* ram_state, uint16_t pc) {
+// Called after each stepped instruction: insn_pc is the instruction that
+// ran, the registers and pc are the state it left.
+void add_trace_entry(uint16_t insn_pc) {
     if (!trace_history) return;
     
-    // If at capacity, shift entries to make room
-    if (trace_history_size >= trace_history_capacity) {
-        memmove(trace_history, trace_history + 1, (trace_history_capacity - 1) * sizeof(TraceEntry));
-        trace_history_size = trace_history_capacity - 1;
-    }
-    
-    // Add new entry
-    TraceEntry *entry = &trace_history[trace_history_size];
-    strncpy(entry->instruction, instruction, sizeof(entry->instruction) - 1);
-    entry->instruction[sizeof(entry->instruction) - 1] = '\0';
-    strncpy(entry->cpu_state, cpu_state, sizeof(entry->cpu_state) - 1);
-    entry->cpu_state[sizeof(entry->cpu_state) - 1] = '\0';
-    strncpy(entry->ram_state, ram_state, sizeof(entry->ram_state) - 1);
-    entry->ram_state[sizeof(entry->ram_state) - 1] = '\0';
+    TraceEntry *entry = &trace_history[trace_history_head++ & (TRACE_HISTORY_ENTRIES - 1)];
+    entry->insn_pc = insn_pc;
     entry->pc_value = pc;
+    entry->opcode = RAM[insn_pc];
+    entry->op1 = RAM[(insn_pc + 1) & 0xFFFF];
+    entry->op2 = RAM[(insn_pc + 2) & 0xFFFF];
+    entry->a = a;
+    entry->x = x;
+    entry->y = y;
+    entry->sp = sp;
+    entry->status = status;
+    memcpy(entry->ram, RAM, sizeof(entry->ram));
     
-    trace_history_size++;
+    if (trace_history_size < (int)TRACE_HISTORY_ENTRIES) trace_history_size++;
+}
+
+// up/down key function + initial window + font increase - Entry by history index, 0 = oldest kept
+static TraceEntry *trace_history_entry(int index) {
+    return &trace_history[(trace_history_head - trace_history_size + index) & (TRACE_HISTORY_ENTRIES - 1)];
+}
+
+// up/down key function + initial window + font increase - Print a history entry
+static void print_trace_entry(int index) {
+    TraceEntry *entry = trace_history_entry(index);
+    printf("TRACE [%d/%d]: ", index + 1, trace_history_size);
+    disasm6502(stdout, entry->insn_pc, entry->opcode, entry->op1, entry->op2);
+    printf("CPU State: PC:%04X A:%02X X:%02X Y:%02X SP:%02X Status:%02X\n",
+           entry->pc_value, entry->a, entry->x, entry->y, entry->sp, entry->status);
+    printf("RAM State: $0000:%02X $0001:%02X $0002:%02X $0003:%02X\n",
+           entry->ram[0], entry->ram[1], entry->ram[2], entry->ram[3]);
 }
 
 // up/down key function + initial window + font increase - Handle scroll up in trace history
@@ -307,10 +498,8 @@ void handle_trace_scroll_up() {
     }
     
     if (trace_scroll_index >= 0 && trace_scroll_index < trace_history_size) {
-        TraceEntry *entry = &trace_history[trace_scroll_index];
-        printf("TRACE [%d/%d]: %s\n", trace_scroll_index + 1, trace_history_size, entry->instruction);
-        printf("%s\n", entry->cpu_state);
-        printf("%s\n", entry->ram_state);
+        TraceEntry *entry = trace_history_entry(trace_scroll_index);
+        print_trace_entry(trace_scroll_index);
         
         // fix up and down to apply in the tracer - Update and render tracer window immediately
         if (tracer.is_active) {
@@ -332,10 +521,8 @@ int handle_trace_scroll_down() {
     
     if (trace_scroll_index < trace_history_size - 1) {
         trace_scroll_index++;
-        TraceEntry *entry = &trace_history[trace_scroll_index];
-        printf("TRACE [%d/%d]: %s\n", trace_scroll_index + 1, trace_history_size, entry->instruction);
-        printf("%s\n", entry->cpu_state);
-        printf("%s\n", entry->ram_state);
+        TraceEntry *entry = trace_history_entry(trace_scroll_index);
+        print_trace_entry(trace_scroll_index);
         
         // fix up and down to apply in the tracer - Update and render tracer window immediately
         if (tracer.is_active) {
@@ -372,70 +559,178 @@ void update_tracer_display(uint16_t current_pc) {
     }
 }
 
+// tracer in SDL2 - Size the canvas and per row bookkeeping for the window
+static int tracer_layout(int width, int height) {
+    int rows = (height - 20) / tracer.line_height;
+    int columns = (width - 5) / tracer.glyph_width + 1;
+    int quads;
+
+    if (rows < 1) rows = 1;
+    if (columns < 1) columns = 1;
+    quads = rows * columns;
+
+    if (tracer.canvas) SDL_DestroyTexture(tracer.canvas);
+    tracer.canvas = NULL;
+    if (SDL_RenderTargetSupported(tracer.renderer)) {
+        tracer.canvas = SDL_CreateTexture(tracer.renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_TARGET, width, height);
+    }
+
+    free(tracer.row_drawn);
+    free(tracer.vertices);
+    free(tracer.indices);
+    tracer.row_drawn = malloc(rows * sizeof(int));
+    tracer.vertices = malloc(quads * 4 * sizeof(SDL_Vertex));
+    tracer.indices = malloc(quads * 6 * sizeof(int));
+    if (!tracer.row_drawn || !tracer.vertices || !tracer.indices) {
+        printf("Error: out of memory for the tracer window\n");
+        tracer.rows = 0;
+        return -1;
+    }
+    for (int q = 0; q < quads; q++) {
+        static const int corner[6] = {0, 1, 2, 2, 1, 3};
+        for (int k = 0; k < 6; k++) tracer.indices[q * 6 + k] = q * 4 + corner[k];
+    }
+    tracer.rows = rows;
+    tracer.columns = columns;
+    tracer.drawn_width = width;
+    tracer.drawn_height = height;
+    tracer.redraw = 1;
+    return 0;
+}
+
+// What a row shows: list line index * 2, plus 1 when it is highlighted;
+// -1 for a row past the end of the file
+static int tracer_row_key(int row) {
+    int line_index = tracer.display_start + row;
+    if (line_index >= tracer.total_lines) return -1;
+    return line_index * 2 + (line_index + 1 == tracer.current_pc_line);
+}
+
+// Appends the quads for one line of text, returns the new quad count
+static int tracer_add_text(int quads, int x, int y, const char *text, SDL_Color color) {
+    float atlas_width = (float)(TRACER_GLYPHS * tracer.glyph_width);
+    int column = 0;
+
+    for (; *text && column < tracer.columns; text++) {
+        int c = (unsigned char)*text;
+        if (c == '\t') {
+            column += TRACER_TAB_WIDTH - column % TRACER_TAB_WIDTH;
+            continue;
+        }
+        if (c > TRACER_GLYPH_FIRST && c <= TRACER_GLYPH_LAST) {
+            SDL_Vertex *v = &tracer.vertices[quads++ * 4];
+            float left = (float)(x + column * tracer.glyph_width);
+            float top = (float)y;
+            float u0 = (c - TRACER_GLYPH_FIRST) * tracer.glyph_width / atlas_width;
+            float u1 = (c - TRACER_GLYPH_FIRST + 1) * tracer.glyph_width / atlas_width;
+            for (int k = 0; k < 4; k++) {
+                v[k].position.x = left + (k & 1 ? tracer.glyph_width : 0);
+                v[k].position.y = top + (k & 2 ? tracer.glyph_height : 0);
+                v[k].color = color;
+                v[k].tex_coord.x = k & 1 ? u1 : u0;
+                v[k].tex_coord.y = k & 2 ? 1.0f : 0.0f;
+            }
+        }
+        column++;
+    }
+    return quads;
+}
+
 // tracer in SDL2 - Render tracer window
+// Called after every instruction while stepping and at TRACER_REFRESH_HZ
+// while the CPU runs. Rows are kept in a canvas texture between frames and
+// only the ones showing a different line (or highlight) are redrawn; when
+// nothing changed the renderer isn't touched at all.
 void render_tracer_window() {
     if (!tracer.is_active) return;
     
-    // Clear background
-    // SDL_SetRenderDrawColor(tracer.renderer, 20, 20, 30, 255);
-    SDL_SetRenderDrawColor(tracer.renderer, 0, 0, 0, 255);
-    SDL_RenderClear(tracer.renderer);
-    
     // Get window size to calculate visible lines
     int window_width, window_height;
     SDL_GetWindowSize(tracer.window, &window_width, &window_height);
     
-    int line_height = 20;  // up/down key function + initial window + font increase - Increased line height for larger font
-    tracer.visible_lines = (window_height - 20) / line_height;
+    if (!tracer.rows || window_width != tracer.drawn_width || window_height != tracer.drawn_height) {
+        if (tracer_layout(window_width, window_height) != 0) return;
+    }
+    tracer.visible_lines = tracer.rows;
+    
+    int redraw_all = tracer.redraw || !tracer.canvas;
+    int dirty = 0;
+    for (int i = 0; i < tracer.rows; i++) {
+        if (redraw_all || tracer_row_key(i) != tracer.row_drawn[i]) dirty++;
+    }
+    if (!dirty) return;
+    tracer.redraw = 0;
+    
+    if (tracer.canvas) SDL_SetRenderTarget(tracer.renderer, tracer.canvas);
+    if (redraw_all) {
+        // Clear background
+        // SDL_SetRenderDrawColor(tracer.renderer, 20, 20, 30, 255);
+        SDL_SetRenderDrawColor(tracer.renderer, 0, 0, 0, 255);
+        SDL_RenderClear(tracer.renderer);
+    }
     
     // Render lines
     SDL_Color white = {180, 180, 180, 255}; // {255, 255, 255, 255};
     SDL_Color yellow = {180, 180, 180, 255}; // {255, 255, 0, 255};
     SDL_Color gray = {180, 180, 180, 255};
+    int quads = 0;
     
-    for (int i = 0; i < tracer.visible_lines && (tracer.display_start + i) < tracer.total_lines; i++) {
-        int line_index = tracer.display_start + i;
-        int line_number = line_index + 1;
+    for (int i = 0; i < tracer.rows; i++) {
+        int key = tracer_row_key(i);
+        if (!redraw_all && key == tracer.row_drawn[i]) continue;
+        tracer.row_drawn[i] = key;
         
+        int line_index = key / 2;
+        SDL_Rect row_rect = {0, 10 + i * tracer.line_height, window_width, tracer.line_height};
         SDL_Color *color = &white;
-        char prefix[4] = "   ";
+        const char *prefix = "   ";
         
         // Highlight current PC line
-        if (line_number == tracer.current_pc_line) {
+        if (key >= 0 && (key & 1)) {
             // Draw highlight background
             SDL_SetRenderDrawColor(tracer.renderer, 80, 80, 0, 255);
-            SDL_Rect highlight_rect = {0, 10 + i * line_height, window_width, line_height};
-            SDL_RenderFillRect(tracer.renderer, &highlight_rect);
             color = &yellow;
-            strcpy(prefix, "-> ");
-        } else if (strlen(tracer.lines[line_index]) > 0 && tracer.lines[line_index][0] != ' ') {
-            // Assembly line
-            color = &white;
+            prefix = "-> ";
         } else {
-            // Comment or empty line
-            color = &gray;
+            SDL_SetRenderDrawColor(tracer.renderer, 0, 0, 0, 255);
+            if (key >= 0 && tracer.lines[line_index][0] != '\0' && tracer.lines[line_index][0] != ' ') {
+                // Assembly line
+                color = &white;
+            } else {
+                // Comment or empty line
+                color = &gray;
+            }
         }
+        if (!redraw_all || (key >= 0 && (key & 1))) SDL_RenderFillRect(tracer.renderer, &row_rect);
+        if (key < 0) continue;
         
         // Prepare text with prefix
         char display_text[600];
         snprintf(display_text, sizeof(display_text), "%s%s", prefix, tracer.lines[line_index]);
-        
-        // Render text
-        SDL_Surface *text_surface = TTF_RenderText_Solid(tracer.font, display_text, *color);
-        if (text_surface) {
-            SDL_Texture *text_texture = SDL_CreateTextureFromSurface(tracer.renderer, text_surface);
-            if (text_texture) {
-                SDL_Rect dest_rect = {5, 10 + i * line_height, text_surface->w, text_surface->h};
-                SDL_RenderCopy(tracer.renderer, text_texture, NULL, &dest_rect);
-                SDL_DestroyTexture(text_texture);
-            }
-            SDL_FreeSurface(text_surface);
-        }
+        quads = tracer_add_text(quads, 5, row_rect.y, display_text, *color);
     }
     
+    // Every glyph of the frame in one draw call
+    if (quads) {
+        SDL_RenderGeometry(tracer.renderer, tracer.atlas, tracer.vertices, quads * 4, tracer.indices, quads * 6);
+    }
+    if (tracer.canvas) {
+        SDL_SetRenderTarget(tracer.renderer, NULL);
+        SDL_RenderCopy(tracer.renderer, tracer.canvas, NULL, NULL);
+    }
     SDL_RenderPresent(tracer.renderer);
 }
 
+// tracer in SDL2 - Whether the tracer should follow the running CPU now,
+// at most TRACER_REFRESH_HZ times a second
+static int tracer_frame_due(void) {
+    Uint32 now = SDL_GetTicks();
+    if (now - tracer.last_frame_ms < 1000 / TRACER_REFRESH_HZ) return 0;
+    tracer.last_frame_ms = now;
+    return 1;
+}
+
 // tracer in SDL2 - Handle tracer window events
 void handle_tracer_events() {
     if (!tracer.is_active) return;
@@ -447,7 +742,9 @@ void handle_tracer_events() {
         // fix up and down to apply in the tracer - Handle window resize event
         } else if (event.type == SDL_WINDOWEVENT) {
             if (event.window.event == SDL_WINDOWEVENT_RESIZED || 
-                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED ||
+                event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                tracer.redraw = 1;
                 render_tracer_window();
             }
         } else if (event.type == SDL_KEYDOWN) {
@@ -489,6 +786,8 @@ void cleanup_tracer() {
         }
         free(tracer.lines);
     }
+    free(tracer.pc_lines);
+    tracer.pc_lines = NULL;
     
     // up/down key function + initial window + font increase - Cleanup trace history
     if (trace_history) {
@@ -496,6 +795,11 @@ void cleanup_tracer() {
         trace_history = NULL;
     }
     
+    free(tracer.row_drawn);
+    free(tracer.vertices);
+    free(tracer.indices);
+    if (tracer.canvas) SDL_DestroyTexture(tracer.canvas);
+    if (tracer.atlas) SDL_DestroyTexture(tracer.atlas);
     if (tracer.font) TTF_CloseFont(tracer.font);
     if (tracer.renderer) SDL_DestroyRenderer(tracer.renderer);
     if (tracer.window) SDL_DestroyWindow(tracer.window);
@@ -561,14 +865,328 @@ The command's output is displayed as intended, without being corrupted by your t
     */  
 
 
+// --- Headless mode ---
+// No SDL at all: LCD writes go to an LCDSim without any surfaces, only its
+// HD44780 controller model (hd44780.h) is used and the screen is read back
+// as text with HD44780_GetLine,
+// keys come from --keys <file> or stdin, nothing is paced, and the run ends
+// with the A register as exit status when the magic opcode is reached.
+#define HEADLESS_STALL_EXIT 124     // ROM stuck waiting for input, or --max-cycles reached
+
+static FILE *key_script = NULL;
+static int keys_exhausted = 0;
+
+LCDSim *create_headless_lcd(void) {
+    LCDSim *self = calloc(1, sizeof(LCDSim));
+    if (!self) {
+        printf("Error: out of memory creating the headless LCD\n");
+        return NULL;
+    }
+    HD44780_Reset(&self->mcu);
+    return self;
+}
+
+// Prints the 16x2 window of DDRAM that the display currently shows.
+void print_headless_lcd(FILE *stream, LCDSim *lcd) {
+    char line[HD44780_COLUMNS + 1];
+    int row;
+    fprintf(stream, "+----------------+\n");
+    for (row = 0; row < HD44780_ROWS; row++) {
+        HD44780_GetLine(&lcd->mcu, row, line, ' ');
+        fprintf(stream, "|%s|\n", line);
+    }
+    fprintf(stream, "+----------------+\n");
+}
+
+// Called when the ROM sits in an idle polling loop: hands it the next scripted
+// key once it has consumed the previous one (the shell clears KEY_INPUT).
+// Newlines become CR, the shell's Enter. Returns 1 if a key was typed.
+int headless_feed_key(void) {
+    int c;
+
+    if (keys_exhausted || RAM[KEY_INPUT] != 0) return 0;
+    do {
+        c = fgetc(key_script);
+    } while (c == '\r');
+    if (c == EOF) {
+        keys_exhausted = 1;
+        return 0;
+    }
+    if (c == '\n') c = '\r';
+    write6502(KEY_INPUT, (uint8_t)c);
+    return 1;
+}
+
+// --- Real-time pacing ---
+// Emulated time is total_cycles / clock_hz. Every slice of emulated time
+// (1 ms) the run loop compares it against the host's monotonic clock and
+// sleeps off any lead, so delay loops take as long as on the real board
+// whatever the host speed. If the emulator falls far behind (a debugger
+// pause, a stalled window) it resynchronises instead of racing to catch up.
+#define PACE_SLICES_PER_SECOND 1000   // check the clock once per ms of emulated time
+#define PACE_MAX_LAG_MS 100           // further behind than this: resync, don't catch up
+
+typedef struct {
+    uint64_t slice_cycles;        // emulated cycles per slice
+    uint64_t next_check;          // total_cycles at which to look at the clock again
+    uint64_t base_cycles;         // total_cycles at base_counter
+    Uint64 base_counter;          // host clock at the last (re)synchronisation
+    Uint64 start_counter;         // host clock when the run started, for the report
+    Uint64 freq;
+    unsigned long sleeps;
+    unsigned long resyncs;
+} Pacer;
+
+static Pacer pacer;
+
+void pace_start(uint64_t now) {
+    pacer.freq = SDL_GetPerformanceFrequency();
+    pacer.start_counter = pacer.base_counter = SDL_GetPerformanceCounter();
+    pacer.base_cycles = now;
+    pacer.slice_cycles = clock_hz / PACE_SLICES_PER_SECOND;
+    if (pacer.slice_cycles == 0) pacer.slice_cycles = 1;
+    pacer.next_check = now + pacer.slice_cycles;
+    pacer.sleeps = pacer.resyncs = 0;
+}
+
+// Called after every chunk with the current total_cycles.
+void pace(uint64_t now) {
+    double ahead;
+
+    if (turbo || now < pacer.next_check) return;
+    pacer.next_check = now + pacer.slice_cycles;
+
+    ahead = (double)(now - pacer.base_cycles) / clock_hz
+          - (double)(SDL_GetPerformanceCounter() - pacer.base_counter) / pacer.freq;
+    if (ahead > 0) {
+        usleep((unsigned int)(ahead * 1e6));
+        pacer.sleeps++;
+    } else if (ahead < -PACE_MAX_LAG_MS / 1000.0) {
+        pacer.base_counter = SDL_GetPerformanceCounter();
+        pacer.base_cycles = now;
+        pacer.resyncs++;
+    }
+}
+
+// Starts pacing over from now, after the clock was set back or forward.
+void pace_resync(uint64_t now) {
+    pacer.base_counter = SDL_GetPerformanceCounter();
+    pacer.base_cycles = now;
+    pacer.next_check = now + pacer.slice_cycles;
+}
+
+// Achieved emulated clock rate over the whole run against the target.
+void pace_report(FILE *stream, uint64_t now) {
+    double elapsed = (double)(SDL_GetPerformanceCounter() - pacer.start_counter) / pacer.freq;
+    double achieved = elapsed > 0 ? now / elapsed : 0;
+
+    if (turbo) {
+        fprintf(stream, "Clock: turbo, %.3f MHz achieved over %.2f s\n", achieved / 1e6, elapsed);
+    } else {
+        fprintf(stream, "Clock: target %.3f MHz, achieved %.3f MHz (%.1f%%) over %.2f s, %lu sleeps, %lu resyncs\n",
+                clock_hz / 1e6, achieved / 1e6, 100.0 * achieved / clock_hz, elapsed,
+                pacer.sleeps, pacer.resyncs);
+    }
+}
+
+// --- Idle loop detection ---
+// The shell spends nearly all its time in keyinput_loop -> poll_keyboard,
+// reading KEY_INPUT and branching back. The head of such a loop is the target
+// of a backward branch/JMP. If two passes through it start with the same
+// registers, take the same number of cycles, change no memory and touch no
+// I/O page, every further pass is identical until the host writes memory
+// (a key into KEY_INPUT) or an IRQ is due. Then the host thread sleeps and
+// total_cycles is advanced by whole passes instead of emulating them.
+#define IDLE_CONFIRM_PASSES 2         // identical passes needed before fast-forwarding
+#define IDLE_MAX_PASS_CYCLES 2000     // longer loops are not considered tight polling loops
+#define IDLE_MAX_SLEEP_MS 100         // keep the UI and Ctrl-C responsive
+
+typedef struct {
+    uint16_t head;                // loop head (target of the last backward branch)
+    int armed;                    // registers at head have been captured
+    uint8_t a, x, y, sp, status;  // registers at the last visit of head
+    unsigned int cycles;          // cycles since the last visit of head
+    unsigned int pass_cycles;     // length of the last pass in cycles
+    int same_passes;              // consecutive identical passes
+    int disturbed;                // memory changed or I/O touched during this pass
+    uint64_t skipped_cycles;
+    unsigned long sleeps;
+} IdleDetector;
+
+static IdleDetector idle;
+
+// --- Binary trace ---
+// Each executed instruction becomes one TraceRecord in trace.bin (see
+// trace6502.h) instead of five text lines in trace.log, which now only gets
+// the start and end of the run. "tracefmt trace.bin" prints the old text.
+// Memory writes are attached to the instruction doing them; writes from
+// the host between instructions (keys, IRQ entry) get records of their own.
+// A writer thread does the file I/O, the CPU thread only queues records; if
+// the disk can't keep up it waits, or with --trace-drop drops and counts.
+#define TRACE_MAX_WRITES 3            // BRK and IRQ entry push three bytes, nothing writes more
+
+static TraceBuffer trace_buf;
+static TraceRecord trace_insn;        // instruction currently executing
+static int trace_insn_open = 0;
+static TraceRecord trace_extra[TRACE_MAX_WRITES - 1];
+static int trace_extra_count = 0;
+static TraceOverflow trace_overflow = TRACE_WAIT;
+
+int trace_open(const char *path) {
+    FILE *out = fopen(path, "wb");
+
+    if (!out) {
+        perror("Error opening trace.bin");
+        return 0;
+    }
+    if (trace_write_header(out, RAM) != 0 || trace_init(&trace_buf, TRACE_BUFFER_RECORDS, out) != 0) {
+        fclose(out);
+        return 0;
+    }
+    if (trace_start_writer(&trace_buf, trace_overflow) != 0) printf("Note: no trace writer thread, tracing synchronously\n");
+    return 1;
+}
+
+static void trace_begin(uint8_t opcode) {
+    memset(&trace_insn, 0, sizeof(trace_insn));
+    trace_insn.pc = pc;
+    trace_insn.opcode = opcode;
+    trace_insn.flags = TRACE_INSN;
+    trace_extra_count = 0;
+    trace_insn_open = 1;
+}
+
+static void trace_note_write(uint16_t address, uint8_t value) {
+    TraceRecord *r;
+
+    if (!trace_insn_open) {
+        TraceRecord host;
+        memset(&host, 0, sizeof(host));
+        host.pc = host.next_pc = pc;
+        host.waddr = address;
+        host.wval = value;
+        host.flags = TRACE_WRITE;
+        trace_push(&trace_buf, &host);
+        return;
+    }
+    if (!(trace_insn.flags & TRACE_WRITE)) {
+        r = &trace_insn;
+    } else if (trace_extra_count < TRACE_MAX_WRITES - 1) {
+        r = &trace_extra[trace_extra_count++];
+        memset(r, 0, sizeof(*r));
+        r->pc = trace_insn.pc;
+        r->flags = TRACE_CONT;
+    } else {
+        return;
+    }
+    r->waddr = address;
+    r->wval = value;
+    r->flags |= TRACE_WRITE;
+}
+
+static void trace_commit(unsigned int cycles) {
+    int i;
+
+    trace_insn.next_pc = pc;
+    trace_insn.a = a;
+    trace_insn.x = x;
+    trace_insn.y = y;
+    trace_insn.sp = sp;
+    trace_insn.status = status;
+    trace_insn.cycles = cycles > 255 ? 255 : (uint8_t)cycles;
+    trace_insn_open = 0;
+    if (!trace_reserve(&trace_buf, 1 + trace_extra_count)) return; // an instruction and its writes go together
+    trace_put(&trace_buf, &trace_insn);
+    for (i = 0; i < trace_extra_count; i++) {
+        trace_extra[i].next_pc = pc;
+        trace_put(&trace_buf, &trace_extra[i]);
+    }
+}
+
+static void trace_mark(uint8_t flags, uint8_t opcode) {
+    TraceRecord r;
+
+    memset(&r, 0, sizeof(r));
+    r.pc = r.next_pc = pc;
+    r.opcode = opcode;
+    r.a = a;
+    r.x = x;
+    r.y = y;
+    r.sp = sp;
+    r.status = status;
+    r.flags = flags;
+    trace_push(&trace_buf, &r);
+    trace_insn_open = 0;
+}
+
+void trace_report(FILE *stream) {
+    fprintf(stream, "Trace: %llu records in %llu block writes to trace.bin, %llu dropped, %llu producer waits\n",
+            (unsigned long long)trace_buf.total, (unsigned long long)trace_buf.flushes,
+            (unsigned long long)trace_buf.dropped, (unsigned long long)trace_buf.waits);
+}
+
+void trace_close(FILE *log) {
+    trace_flush(&trace_buf); // room for the end mark even with --trace-drop
+    trace_mark(TRACE_END, 0);
+    trace_free(&trace_buf);
+    fclose(trace_buf.out);
+    trace_report(log);
+    trace_report(stdout);
+}
+
 // --- Memory Access Functions for fake6502 ---
 // These are the functions fake6502 calls to read from and write to memory.
-// We implement them to access our global RAM array.
+// They go through the paged bus, so plain RAM pages are a single lookup and
+// only the I/O pages pay for a device handler.
 uint8_t read6502(uint16_t address) {
-    return RAM[address];
+    uint8_t value;
+
+    if (!bus6502_mapping(&bus, address >> 8)->read_ptr) idle.disturbed = 1;
+    value = bus6502_read(&bus, address);
+    if (BP_SET(BP_READ, address)) note_access_breakpoint(BP_READ, address, value);
+    return value;
 }
 
 void write6502(uint16_t address, uint8_t value) {
+    if (!bus6502_mapping(&bus, address >> 8)->write_ptr || RAM[address] != value) idle.disturbed = 1;
+    if (trace_enabled) trace_note_write(address, value);
+    if (journaling) journal_write(address, value);
+    if (BP_SET(BP_WRITE, address)) note_access_breakpoint(BP_WRITE, address, value);
+    bus6502_write(&bus, address, value);
+}
+
+// --- LCD refresh ---
+// A write to the LCD ports only updates the HD44780 model, which marks
+// itself dirty. The main loop presents the window at most lcd_refresh_hz
+// times a second, and right away when the ROM goes idle or the debugger
+// stops, so a ROM redrawing all 32 characters costs one present, not 32.
+static Uint32 lcd_last_present_ms = 0;
+static unsigned long lcd_writes = 0;
+static unsigned long lcd_presents = 0;
+
+static void lcd_present(void) {
+    if (headless || !(lcd->dirty || LCDSim_Blinking(lcd))) return;
+    LCDSim_Draw(lcd);
+    SDL_UpdateWindowSurface(window);
+    lcd_last_present_ms = SDL_GetTicks();
+    lcd_presents++;
+}
+
+// Presents the LCD if it changed and a frame is due
+static void lcd_refresh(void) {
+    if (headless || !(lcd->dirty || LCDSim_Blinking(lcd))) return;
+    if (SDL_GetTicks() - lcd_last_present_ms < 1000 / lcd_refresh_hz) return;
+    lcd_present();
+}
+
+// LCD port page ($6000-$60FF). Reads see the last value written, as before.
+static uint8_t lcd_port_read(void *user, uint16_t address) {
+    (void)user;
+    return RAM[address];
+}
+
+static void lcd_port_write(void *user, uint16_t address, uint8_t value) {
+    (void)user;
 
     // In a true hardware system, memory-mapped devices (LCD, sound, etc.) “see” all writes to specific addresses, regardless of what instruction triggers those writes (STA, STX, etc). They don’t care about “what’s in RAM[pc] right now.”
     // By only checking for STA $6000 (opcode==0x8D, op1==0x00, op2==0x60), you miss all other ways the code could write to 0x6000, such as STX, STY, indirect addressing, and even self-modifying code or DMA.
@@ -601,19 +1219,101 @@ void write6502(uint16_t address, uint8_t value) {
 
     if (address == 0x6000) {
         // Data register: write a character or data
-        LCDSim_Instruction(lcd, 0x0100 | value);       // simulate RS=1 (data register), RW=0 (write)
-        LCDSim_Draw(lcd);
-        SDL_UpdateWindowSurface(window);
+        LCDSim_Instruction(lcd, HD44780_DATA | value);       // simulate RS=1 (data register), RW=0 (write)
+        lcd_writes++;
     }
     else if (address == 0x6001) {
         // Instruction register: send a command
         LCDSim_Instruction(lcd, value);       // simulate RS=0 (control register), RW=0 (write)
-        LCDSim_Draw(lcd);
-        SDL_UpdateWindowSurface(window);
+        lcd_writes++;
     }
     RAM[address] = value;
 }
 
+// Build the page table. The whole address space is RAM (the loader and the
+// debugger poke ROM through RAM[] too), with the LCD page mapped to its
+// handler. New devices, e.g. a VIA at $4000, only need another map_io call.
+void setup_bus(void) {
+    bus6502_init(&bus);
+    bus6502_map_ram(&bus, 0x00, 256, RAM);
+    bus6502_map_io(&bus, PRINT_CHAR_ADDR >> 8, 1, lcd_port_read, lcd_port_write, NULL);
+}
+
+static void idle_capture(void) {
+    idle.a = a; idle.x = x; idle.y = y; idle.sp = sp; idle.status = status;
+    idle.cycles = 0;
+    idle.disturbed = 0;
+}
+
+// Feed one executed instruction (its address, opcode and cycles) to the
+// detector. Returns 1 when the CPU sits at the head of a confirmed idle loop.
+int idle_observe(uint16_t prev_pc, uint8_t opcode, unsigned int cycles) {
+    int is_jump = (opcode & 0x1F) == 0x10 || opcode == 0x4C; // Bxx or JMP abs
+
+    idle.cycles += cycles;
+    if (idle.armed && pc == idle.head) {
+        if (!idle.disturbed && idle.cycles == idle.pass_cycles &&
+            a == idle.a && x == idle.x && y == idle.y && sp == idle.sp && status == idle.status) {
+            idle.same_passes++;
+        } else {
+            idle.same_passes = 0;
+        }
+        idle.pass_cycles = idle.cycles;
+        idle_capture();
+        return idle.same_passes >= IDLE_CONFIRM_PASSES;
+    }
+    if (is_jump && pc <= prev_pc) {
+        idle.head = pc;
+        idle.armed = 1;
+        idle.same_passes = 0;
+        idle.pass_cycles = 0;
+        idle_capture();
+    } else if (idle.cycles > IDLE_MAX_PASS_CYCLES) {
+        idle.armed = 0;
+    }
+    return 0;
+}
+
+// Sleep until an SDL event is pending or the time the skipped passes would
+// have taken has passed, never reaching the next scheduled event (until_event
+// cycles away). Returns the number of cycles to add to total_cycles (a whole
+// number of passes, 0 if none).
+uint64_t idle_fast_forward(uint64_t until_event) {
+    uint64_t max_passes, passes;
+    unsigned long long wait_ms;
+    Uint64 t0;
+    double slept;
+
+    if (until_event == 0 || idle.pass_cycles == 0) return 0;
+    max_passes = (until_event - 1) / idle.pass_cycles;
+    if (max_passes == 0) return 0;
+
+    wait_ms = max_passes * idle.pass_cycles * 1000 / clock_hz;
+    if (wait_ms > IDLE_MAX_SLEEP_MS) wait_ms = IDLE_MAX_SLEEP_MS;
+    if (wait_ms == 0) wait_ms = 1;
+
+    t0 = SDL_GetPerformanceCounter();
+    SDL_WaitEventTimeout(NULL, (int)wait_ms); // NULL leaves the event queued for the main loop
+    slept = (double)(SDL_GetPerformanceCounter() - t0) / SDL_GetPerformanceFrequency();
+
+    passes = (uint64_t)(slept * clock_hz / idle.pass_cycles);
+    if (passes > max_passes) passes = max_passes;
+    idle.skipped_cycles += passes * idle.pass_cycles;
+    idle.sleeps++;
+    return passes * idle.pass_cycles;
+}
+
+// Headless counterpart: there is no one to wait for, so skip every pass up
+// to the next scheduled event.
+uint64_t idle_skip(uint64_t until_event) {
+    uint64_t passes;
+
+    if (until_event == 0 || idle.pass_cycles == 0) return 0;
+    passes = (until_event - 1) / idle.pass_cycles;
+    idle.skipped_cycles += passes * idle.pass_cycles;
+    return passes * idle.pass_cycles;
+}
+
 // Function to print all monitored addresses
 void print_monitor_addresses() {
     if (monitor_count == 0) {
@@ -802,176 +1502,7 @@ uint8_t disassemble_current_instruction(FILE *stream, uint16_t current_pc, const
     uint8_t op1 = ram[(current_pc + 1) % 65536]; // % 65536 to handle wrap-around for peek
     uint8_t op2 = ram[(current_pc + 2) % 65536]; // % 65536 to handle wrap-around for peek
 
-    // Print PC and opcode byte(s)
-    fprintf(stream, "%04X: %02X ", current_pc, opcode);
-
-    // This is a simplified disassembler for common opcodes.
-    // A complete one would be much larger.
-    switch (opcode) {
-        case 0x00: fprintf(stream, "         BRK"); break; // Implied
-        case 0x01: fprintf(stream, "%02X       ORA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0x05: fprintf(stream, "%02X       ORA $%02X", op1, op1); break;     // Zero Page
-        case 0x06: fprintf(stream, "%02X       ASL $%02X", op1, op1); break;     // Zero Page
-        case 0x08: fprintf(stream, "         PHP"); break; // Implied
-        case 0x09: fprintf(stream, "%02X       ORA #$%02X", op1, op1); break;   // Immediate
-        case 0x0A: fprintf(stream, "         ASL A"); break; // Accumulator
-        case 0x0D: fprintf(stream, "%02X %02X    ORA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x0E: fprintf(stream, "%02X %02X    ASL $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x10: fprintf(stream, "%02X       BPL $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0x11: fprintf(stream, "%02X       ORA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0x15: fprintf(stream, "%02X       ORA $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x16: fprintf(stream, "%02X       ASL $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x18: fprintf(stream, "         CLC"); break; // Implied
-        case 0x19: fprintf(stream, "%02X %02X    ORA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0x1D: fprintf(stream, "%02X %02X    ORA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0x1E: fprintf(stream, "%02X %02X    ASL $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0x20: fprintf(stream, "%02X %02X    JSR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x21: fprintf(stream, "%02X       AND ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0x24: fprintf(stream, "%02X       BIT $%02X", op1, op1); break;     // Zero Page
-        case 0x25: fprintf(stream, "%02X       AND $%02X", op1, op1); break;     // Zero Page
-        case 0x26: fprintf(stream, "%02X       ROL $%02X", op1, op1); break;     // Zero Page
-        case 0x28: fprintf(stream, "         PLP"); break; // Implied
-        case 0x29: fprintf(stream, "%02X       AND #$%02X", op1, op1); break;   // Immediate
-        case 0x2A: fprintf(stream, "         ROL A"); break; // Accumulator
-        case 0x2C: fprintf(stream, "%02X %02X    BIT $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x2D: fprintf(stream, "%02X %02X    AND $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x2E: fprintf(stream, "%02X %02X    ROL $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x30: fprintf(stream, "%02X       BMI $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0x31: fprintf(stream, "%02X       AND ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0x35: fprintf(stream, "%02X       AND $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x36: fprintf(stream, "%02X       ROL $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x38: fprintf(stream, "         SEC"); break; // Implied
-        case 0x39: fprintf(stream, "%02X %02X    AND $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0x3D: fprintf(stream, "%02X %02X    AND $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0x3E: fprintf(stream, "%02X %02X    ROL $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0x40: fprintf(stream, "         RTI"); break; // Implied
-        case 0x41: fprintf(stream, "%02X       EOR ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0x45: fprintf(stream, "%02X       EOR $%02X", op1, op1); break;     // Zero Page
-        case 0x46: fprintf(stream, "%02X       LSR $%02X", op1, op1); break;     // Zero Page
-        case 0x48: fprintf(stream, "         PHA"); break; // Implied
-        case 0x49: fprintf(stream, "%02X       EOR #$%02X", op1, op1); break;   // Immediate
-        case 0x4A: fprintf(stream, "         LSR A"); break; // Accumulator
-        case 0x4C: fprintf(stream, "%02X %02X    JMP $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x4D: fprintf(stream, "%02X %02X    EOR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x4E: fprintf(stream, "%02X %02X    LSR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x50: fprintf(stream, "%02X       BVC $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0x51: fprintf(stream, "%02X       EOR ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0x55: fprintf(stream, "%02X       EOR $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x56: fprintf(stream, "%02X       LSR $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x58: fprintf(stream, "         CLI"); break; // Implied
-        case 0x59: fprintf(stream, "%02X %02X    EOR $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0x5D: fprintf(stream, "%02X %02X    EOR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0x5E: fprintf(stream, "%02X %02X    LSR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0x60: fprintf(stream, "         RTS"); break; // Implied
-        case 0x61: fprintf(stream, "%02X       ADC ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0x65: fprintf(stream, "%02X       ADC $%02X", op1, op1); break;     // Zero Page
-        case 0x66: fprintf(stream, "%02X       ROR $%02X", op1, op1); break;     // Zero Page
-        case 0x68: fprintf(stream, "         PLA"); break; // Implied
-        case 0x69: fprintf(stream, "%02X       ADC #$%02X", op1, op1); break;   // Immediate
-        case 0x6A: fprintf(stream, "         ROR A"); break; // Accumulator
-        case 0x6C: fprintf(stream, "%02X %02X    JMP ($%04X)", op1, op2, (op2 << 8) | op1); break; // Indirect Absolute
-        case 0x6D: fprintf(stream, "%02X %02X    ADC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x6E: fprintf(stream, "%02X %02X    ROR $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x70: fprintf(stream, "%02X       BVS $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0x71: fprintf(stream, "%02X       ADC ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0x75: fprintf(stream, "%02X       ADC $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x76: fprintf(stream, "%02X       ROR $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x78: fprintf(stream, "         SEI"); break; // Implied
-        case 0x79: fprintf(stream, "%02X %02X    ADC $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0x7D: fprintf(stream, "%02X %02X    ADC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0x7E: fprintf(stream, "%02X %02X    ROR $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0x81: fprintf(stream, "%02X       STA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0x84: fprintf(stream, "%02X       STY $%02X", op1, op1); break;     // Zero Page
-        case 0x85: fprintf(stream, "%02X       STA $%02X", op1, op1); break;     // Zero Page
-        case 0x86: fprintf(stream, "%02X       STX $%02X", op1, op1); break;     // Zero Page
-        case 0x88: fprintf(stream, "         DEY"); break; // Implied
-        case 0x8A: fprintf(stream, "         TXA"); break; // Implied
-        case 0x8C: fprintf(stream, "%02X %02X    STY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x8D: fprintf(stream, "%02X %02X    STA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x8E: fprintf(stream, "%02X %02X    STX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0x90: fprintf(stream, "%02X       BCC $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0x91: fprintf(stream, "%02X       STA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0x94: fprintf(stream, "%02X       STY $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x95: fprintf(stream, "%02X       STA $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0x96: fprintf(stream, "%02X       STX $%02X,Y", op1, op1); break;   // Zero Page,Y
-        case 0x98: fprintf(stream, "         TYA"); break; // Implied
-        case 0x99: fprintf(stream, "%02X %02X    STA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0x9A: fprintf(stream, "         TXS"); break; // Implied
-        case 0x9D: fprintf(stream, "%02X %02X    STA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0xA0: fprintf(stream, "%02X       LDY #$%02X", op1, op1); break;   // Immediate
-        case 0xA1: fprintf(stream, "%02X       LDA ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0xA2: fprintf(stream, "%02X       LDX #$%02X", op1, op1); break;   // Immediate
-        case 0xA4: fprintf(stream, "%02X       LDY $%02X", op1, op1); break;     // Zero Page
-        case 0xA5: fprintf(stream, "%02X       LDA $%02X", op1, op1); break;     // Zero Page
-        case 0xA6: fprintf(stream, "%02X       LDX $%02X", op1, op1); break;     // Zero Page
-        case 0xA8: fprintf(stream, "         TAY"); break; // Implied
-        case 0xA9: fprintf(stream, "%02X       LDA #$%02X", op1, op1); break;   // Immediate
-        case 0xAA: fprintf(stream, "         TAX"); break; // Implied
-        case 0xAC: fprintf(stream, "%02X %02X    LDY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xAD: fprintf(stream, "%02X %02X    LDA $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xAE: fprintf(stream, "%02X %02X    LDX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xB0: fprintf(stream, "%02X       BCS $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0xB1: fprintf(stream, "%02X       LDA ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0xB4: fprintf(stream, "%02X       LDY $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xB5: fprintf(stream, "%02X       LDA $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xB6: fprintf(stream, "%02X       LDX $%02X,Y", op1, op1); break;   // Zero Page,Y
-        case 0xB8: fprintf(stream, "         CLV"); break; // Implied
-        case 0xB9: fprintf(stream, "%02X %02X    LDA $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0xBA: fprintf(stream, "         TSX"); break; // Implied
-        case 0xBC: fprintf(stream, "%02X %02X    LDY $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0xBD: fprintf(stream, "%02X %02X    LDA $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0xBE: fprintf(stream, "%02X %02X    LDX $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-
-        case 0xC0: fprintf(stream, "%02X       CPY #$%02X", op1, op1); break;   // Immediate
-        case 0xC1: fprintf(stream, "%02X       CMP ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0xC4: fprintf(stream, "%02X       CPY $%02X", op1, op1); break;     // Zero Page
-        case 0xC5: fprintf(stream, "%02X       CMP $%02X", op1, op1); break;     // Zero Page
-        case 0xC6: fprintf(stream, "%02X       DEC $%02X", op1, op1); break;     // Zero Page
-        case 0xC8: fprintf(stream, "         INY"); break; // Implied
-        case 0xC9: fprintf(stream, "%02X       CMP #$%02X", op1, op1); break;   // Immediate
-        case 0xCA: fprintf(stream, "         DEX"); break; // Implied
-        case 0xCC: fprintf(stream, "%02X %02X    CPY $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xCD: fprintf(stream, "%02X %02X    CMP $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xCE: fprintf(stream, "%02X %02X    DEC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xD0: fprintf(stream, "%02X       BNE $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0xD1: fprintf(stream, "%02X       CMP ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0xD5: fprintf(stream, "%02X       CMP $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xD6: fprintf(stream, "%02X       DEC $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xD8: fprintf(stream, "         CLD"); break; // Implied
-        case 0xD9: fprintf(stream, "%02X %02X    CMP $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0xDD: fprintf(stream, "%02X %02X    CMP $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0xDE: fprintf(stream, "%02X %02X    DEC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        case 0xE0: fprintf(stream, "%02X       CPX #$%02X", op1, op1); break;   // Immediate
-        case 0xE1: fprintf(stream, "%02X       SBC ($%02X,X)", op1, op1); break; // Indexed Indirect, X
-        case 0xE4: fprintf(stream, "%02X       CPX $%02X", op1, op1); break;     // Zero Page
-        case 0xE5: fprintf(stream, "%02X       SBC $%02X", op1, op1); break;     // Zero Page
-        case 0xE6: fprintf(stream, "%02X       INC $%02X", op1, op1); break;     // Zero Page
-        case 0xE8: fprintf(stream, "         INX"); break; // Implied
-        case 0xE9: fprintf(stream, "%02X       SBC #$%02X", op1, op1); break;   // Immediate
-        case 0xEA: fprintf(stream, "         NOP"); break; // Implied
-        case 0xEC: fprintf(stream, "%02X %02X    CPX $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xED: fprintf(stream, "%02X %02X    SBC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xEE: fprintf(stream, "%02X %02X    INC $%04X", op1, op2, (op2 << 8) | op1); break; // Absolute
-        case 0xF0: fprintf(stream, "%02X       BEQ $%04X", op1, (current_pc + 2 + (int8_t)op1) & 0xFFFF); break; // Relative
-        case 0xF1: fprintf(stream, "%02X       SBC ($%02X),Y", op1, op1); break; // Indirect Indexed, Y
-        case 0xF5: fprintf(stream, "%02X       SBC $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xF6: fprintf(stream, "%02X       INC $%02X,X", op1, op1); break;   // Zero Page,X
-        case 0xF8: fprintf(stream, "         SED"); break; // Implied
-        case 0xF9: fprintf(stream, "%02X %02X    SBC $%04X,Y", op1, op2, (op2 << 8) | op1); break; // Absolute,Y
-        case 0xFD: fprintf(stream, "%02X %02X    SBC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-        case 0xFE: fprintf(stream, "%02X %02X    INC $%04X,X", op1, op2, (op2 << 8) | op1); break; // Absolute,X
-
-        default:
-            fprintf(stream, "         ??? (0x%02X)", opcode); // Unknown opcode
-            break;
-    }
-    fprintf(stream, "\n");
+    disasm6502(stream, current_pc, opcode, op1, op2);
     fflush(stream);
 
     return opcode;
@@ -1065,84 +1596,248 @@ void set_vectors(uint16_t reset, uint16_t irq) {
 
 
 
-// Function to find symbol by address (closest match)
+// FNV-1a, for the symbol name hash
+static unsigned int symbol_hash(const char *name) {
+    unsigned int h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Function to find symbol by address (closest match at or below it).
+// With several names on one address the one listed last wins.
 SymbolEntry* find_closest_symbol(unsigned int address) {
-    SymbolEntry *current = symbol_list;
-    SymbolEntry *closest = NULL;
-    unsigned int min_distance = UINT_MAX;
-    
-    while (current != NULL) {
-        if (current->address <= address) {
-            unsigned int distance = address - current->address;
-            if (distance < min_distance) {
-                min_distance = distance;
-                closest = current;
-            }
-        }
-        current = current->next;
+    int lo = 0, hi = symbols.count; // first entry above address is in [lo, hi]
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (symbols.entries[mid].address <= address) lo = mid + 1;
+        else hi = mid;
     }
-    return closest;
+    return lo > 0 ? &symbols.entries[lo - 1] : NULL;
 }
 
 // Function to find symbol by name
 SymbolEntry* find_symbol_by_name(const char *name) {
-    SymbolEntry *current = symbol_list;
-    while (current != NULL) {
-        if (strcmp(current->symbol_name, name) == 0) {
-            return current;
-        }
-        current = current->next;
+    unsigned int i;
+
+    if (!symbols.slots) return NULL;
+    for (i = symbol_hash(name) & symbols.slot_mask; symbols.slots[i]; i = (i + 1) & symbols.slot_mask) {
+        SymbolEntry *entry = &symbols.entries[symbols.slots[i] - 1];
+        if (strcmp(entry->symbol_name, name) == 0) return entry;
     }
     return NULL;
 }
 
-// Function to add breakpoint
-void add_breakpoint(unsigned int address, const char *label) {
-    if (breakpoint_count >= MAX_BREAKPOINTS) {
-        printf("Maximum breakpoints reached!\n");
-        return;
+static const char *break_kind_name(BreakKind kind) {
+    return kind == BP_READ ? "Read breakpoint" : kind == BP_WRITE ? "Write breakpoint" : "Breakpoint";
+}
+
+// Parses "A==#$0D", "X!=0", "[$0230]>3", "hits>=5" ... Registers A X Y SP P,
+// a memory byte in brackets, or the breakpoint's own hit count; operators
+// == != < <= > >= (= alone means ==); values in hex ($0D, #$0D, 0x0D),
+// decimal or as a 'c'haracter. Returns 1 on success.
+int parse_break_condition(const char *text, BreakCondition *cond) {
+    const char *p = text;
+    char *end;
+    unsigned int address;
+
+    while (isspace((unsigned char)*p)) p++;
+    memset(cond, 0, sizeof(*cond));
+    strncpy(cond->text, p, sizeof(cond->text) - 1);
+
+    if (*p == '[') {
+        p++;
+        if (*p == '$') p++;
+        if (sscanf(p, "%x", &address) != 1) return 0;
+        while (isxdigit((unsigned char)*p) || *p == 'x' || *p == 'X') p++;
+        if (*p++ != ']') return 0;
+        cond->what = COND_MEM;
+        cond->address = address & 0xFFFF;
+    } else if (strncasecmp(p, "hits", 4) == 0) {
+        cond->what = COND_HITS; p += 4;
+    } else if (strncasecmp(p, "sp", 2) == 0) {
+        cond->what = COND_SP; p += 2;
+    } else if (toupper((unsigned char)*p) == 'A') {
+        cond->what = COND_A; p++;
+    } else if (toupper((unsigned char)*p) == 'X') {
+        cond->what = COND_X; p++;
+    } else if (toupper((unsigned char)*p) == 'Y') {
+        cond->what = COND_Y; p++;
+    } else if (toupper((unsigned char)*p) == 'P') {
+        cond->what = COND_P; p++;
+    } else {
+        return 0;
     }
-    
+
+    while (isspace((unsigned char)*p)) p++;
+    if (p[0] == '=' && p[1] == '=') { cond->op = COND_EQ; p += 2; }
+    else if (p[0] == '!' && p[1] == '=') { cond->op = COND_NE; p += 2; }
+    else if (p[0] == '<' && p[1] == '=') { cond->op = COND_LE; p += 2; }
+    else if (p[0] == '>' && p[1] == '=') { cond->op = COND_GE; p += 2; }
+    else if (p[0] == '<') { cond->op = COND_LT; p++; }
+    else if (p[0] == '>') { cond->op = COND_GT; p++; }
+    else if (p[0] == '=') { cond->op = COND_EQ; p++; }
+    else return 0;
+
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '#') p++;
+    if (*p == '\'' && p[1] && p[2] == '\'') {
+        cond->value = (unsigned char)p[1];
+        p += 3;
+    } else if (*p == '$') {
+        cond->value = strtoul(p + 1, &end, 16);
+        if (end == p + 1) return 0;
+        p = end;
+    } else {
+        cond->value = strtoul(p, &end, 0);
+        if (end == p) return 0;
+        p = end;
+    }
+    while (isspace((unsigned char)*p)) p++;
+    return *p == '\0';
+}
+
+static int compare_break_condition(const BreakCondition *cond, unsigned long lhs) {
+    switch (cond->op) {
+        case COND_EQ: return lhs == cond->value;
+        case COND_NE: return lhs != cond->value;
+        case COND_LT: return lhs <  cond->value;
+        case COND_LE: return lhs <= cond->value;
+        case COND_GT: return lhs >  cond->value;
+        case COND_GE: return lhs >= cond->value;
+    }
+    return 1;
+}
+
+static int eval_break_condition(const Breakpoint *bp) {
+    unsigned long lhs;
+
+    switch (bp->cond.what) {
+        case COND_NONE: return 1;
+        case COND_A:    lhs = a; break;
+        case COND_X:    lhs = x; break;
+        case COND_Y:    lhs = y; break;
+        case COND_SP:   lhs = sp; break;
+        case COND_P:    lhs = status; break;
+        case COND_MEM:  lhs = RAM[bp->cond.address]; break;
+        case COND_HITS: lhs = bp->hits; break;
+        default:        return 1;
+    }
+    return compare_break_condition(&bp->cond, lhs);
+}
+
+static Breakpoint *find_breakpoint(BreakKind kind, unsigned int address) {
     for (int i = 0; i < breakpoint_count; i++) {
-        if (breakpoints[i].address == address) {
-            printf("Breakpoint at %04X already exists. Removing it.\n", address);
-            
-            // Shift all subsequent elements down by one
-            for (int j = i; j < breakpoint_count - 1; j++) {
-                breakpoints[j] = breakpoints[j + 1];
+        if (breakpoints[i].kind == kind && breakpoints[i].address == address) return &breakpoints[i];
+    }
+    return NULL;
+}
+
+static void remove_breakpoint(Breakpoint *bp) {
+    int i = (int)(bp - breakpoints);
+
+    bp_bitmap[bp->kind][bp->address >> 3] &= ~(1 << (bp->address & 7));
+    free(bp->label);
+    breakpoints[i] = breakpoints[--breakpoint_count];
+}
+
+// Sets a breakpoint of the given kind. Without a condition an existing one
+// at the same address is removed instead (the "b addr" toggle); with one,
+// its condition is replaced.
+void set_breakpoint(unsigned int address, const char *label, BreakKind kind, const char *condition) {
+    BreakCondition cond;
+    Breakpoint *bp;
+
+    address &= 0xFFFF;
+    memset(&cond, 0, sizeof(cond));
+    if (condition && !parse_break_condition(condition, &cond)) {
+        printf("Bad condition '%s'. Examples: A==#$0D  X!=0  [$0230]>3  hits>=5\n", condition);
+        return;
+    }
+
+    bp = find_breakpoint(kind, address);
+    if (bp && !condition) {
+        printf("%s at %04X already exists. Removing it.\n", break_kind_name(kind), address);
+        remove_breakpoint(bp);
+        return;
+    }
+    if (!bp) {
+        if (breakpoint_count == breakpoint_capacity) {
+            int capacity = breakpoint_capacity ? breakpoint_capacity * 2 : 16;
+            Breakpoint *grown = realloc(breakpoints, capacity * sizeof(*grown));
+            if (!grown) {
+                printf("Error: out of memory for breakpoints\n");
+                return;
             }
-            
-            // Decrement the count of valid breakpoints
-            breakpoint_count--;
-            return;
+            breakpoints = grown;
+            breakpoint_capacity = capacity;
         }
+        bp = &breakpoints[breakpoint_count++];
+        bp->address = address;
+        bp->label = NULL;
+        if (label) {
+            bp->label = malloc(strlen(label) + 1);
+            if (bp->label) strcpy(bp->label, label);
+        }
+        bp->kind = kind;
+        bp_bitmap[kind][address >> 3] |= 1 << (address & 7);
     }
-    breakpoints[breakpoint_count].address = address;
-    if (label) {
-        breakpoints[breakpoint_count].label = malloc(strlen(label) + 1);
-        strcpy(breakpoints[breakpoint_count].label, label);
-    } else {
-        breakpoints[breakpoint_count].label = NULL;
-    }
-    breakpoint_count++;
-    
+    bp->cond = cond;
+    bp->hits = 0;
+
     // Find closest symbol for display
     SymbolEntry *closest = find_closest_symbol(address);
     if (closest) {
-        printf("Breakpoint set at %04X under %s\n", address, closest->symbol_name);
+        printf("%s set at %04X under %s", break_kind_name(kind), address, closest->symbol_name);
     } else {
-        printf("Breakpoint set at %04X\n", address);
+        printf("%s set at %04X", break_kind_name(kind), address);
     }
+    if (condition) printf(" if %s", bp->cond.text);
+    printf("\n");
+}
+
+// Function to add breakpoint
+void add_breakpoint(unsigned int address, const char *label) {
+    set_breakpoint(address, label, BP_EXEC, NULL);
+}
+
+// Counts a hit on a breakpoint whose bitmap bit is set and evaluates its
+// condition. Returns 1 if execution should stop.
+static int breakpoint_hit(BreakKind kind, unsigned int address) {
+    Breakpoint *bp = find_breakpoint(kind, address);
+
+    if (!bp) return 0;
+    bp->hits++;
+    return eval_break_condition(bp);
 }
 
 // Function to check if address is a breakpoint
+// Called for every instruction, and again by the run loop for the same
+// instruction; the hit is only counted once per arrival at the address.
 int is_breakpoint(unsigned int address) {
-    for (int i = 0; i < breakpoint_count; i++) {
-        if (breakpoints[i].address == address) {
-            return 1;
-        }
-    }
-    return 0;
+    static uint64_t seen_cycles = UINT64_MAX;
+    static unsigned int seen_address;
+    static int seen_result;
+
+    if (!BP_SET(BP_EXEC, address)) return 0;
+    if (seen_cycles == total_cycles && seen_address == address) return seen_result;
+    seen_cycles = total_cycles;
+    seen_address = address;
+    seen_result = breakpoint_hit(BP_EXEC, address);
+    return seen_result;
+}
+
+// Memory access side, called from read6502/write6502 when the bit is set.
+// The CPU finishes the instruction; the hook then stops the run.
+static void note_access_breakpoint(BreakKind kind, uint16_t address, uint8_t value) {
+    if (headless || access_break.pending || !breakpoint_hit(kind, address)) return;
+    access_break.pending = 1;
+    access_break.kind = kind;
+    access_break.address = address;
+    access_break.value = value;
 }
 
 // Function to handle read command
@@ -1187,12 +1882,17 @@ void handle_write_command(const char *input) {
         return;
     }
     
-    RAM[address & 0xFFFF] = (unsigned char)value;
+    address &= 0xFFFF;
+    if (trace_enabled) trace_note_write(address, value); // a host write, like key input
+    if (journaling) journal_write(address, value);
+    RAM[address] = (unsigned char)value;
     printf("Wrote %02X to address %04X\n", value, address);
 }
 
 // Function to print all breakpoints
 void print_breakpoints() {
+    static const char *kind_tag[BP_KINDS] = { "", "read  ", "write " };
+
     if (breakpoint_count == 0) {
         printf("No breakpoints set\n");
         return;
@@ -1200,19 +1900,22 @@ void print_breakpoints() {
     
     printf("Breakpoints:\n");
     for (int i = 0; i < breakpoint_count; i++) {
-        if (breakpoints[i].label) {
-            printf("  %04X (%s)\n", breakpoints[i].address, breakpoints[i].label);
-        } else {
-            printf("  %04X\n", breakpoints[i].address);
-        }
+        Breakpoint *bp = &breakpoints[i];
+        printf("  %s%04X", kind_tag[bp->kind], bp->address);
+        if (bp->label) printf(" (%s)", bp->label);
+        if (bp->cond.what != COND_NONE) printf(" if %s", bp->cond.text);
+        printf("  [%lu hits]\n", bp->hits);
     }
     printf("\n");
 }
 
 // Function to handle breakpoint command
+// b [r|w] addr|label [if condition]
 void handle_breakpoint_command(const char *input) {
-    char label_or_addr[256];
+    char target[256];
+    char *condition;
     unsigned int address;
+    BreakKind kind = BP_EXEC;
     
     // Skip 'b' and whitespace
     const char *ptr = input + 1;
@@ -1224,16 +1927,31 @@ void handle_breakpoint_command(const char *input) {
         return;
     }
 
+    // "b r ..." / "b w ...": break on a data read or write instead
+    if ((ptr[0] == 'r' || ptr[0] == 'w') && (ptr[1] == ' ' || ptr[1] == '\t')) {
+        kind = ptr[0] == 'r' ? BP_READ : BP_WRITE;
+        ptr += 2;
+        while (*ptr == ' ' || *ptr == '\t') ptr++;
+    }
+
+    strncpy(target, ptr, sizeof(target) - 1);
+    target[sizeof(target) - 1] = '\0';
+    condition = strstr(target, " if ");
+    if (condition) {
+        *condition = '\0';
+        condition += 4;
+    }
+
     // Check if it's a hex address (starts with 0x or all hex digits)
-    if (sscanf(ptr, "%x", &address) == 1 || sscanf(ptr, "0x%x", &address) == 1) {
-        add_breakpoint(address, NULL);
+    if (sscanf(target, "%x", &address) == 1 || sscanf(target, "0x%x", &address) == 1) {
+        set_breakpoint(address, NULL, kind, condition);
     } else {
         // It's a label
-        SymbolEntry *symbol = find_symbol_by_name(ptr);
+        SymbolEntry *symbol = find_symbol_by_name(target);
         if (symbol) {
-            add_breakpoint(symbol->address, ptr);
+            set_breakpoint(symbol->address, target, kind, condition);
         } else {
-            printf("Warning: Label '%s' not found\n", ptr);
+            printf("Warning: Label '%s' not found\n", target);
         }
     }
 }
@@ -1247,83 +1965,222 @@ void print_gdb_help() {
     printf("c           :  continue to the next breakpoint\n");
     printf("r           :  read memory.  r addr 32 for printing 32 byte from addr\n");
     printf("w addr val  :  write memory byte -- w addr value \n");
-    printf("t           :  print call stack\n");
-    printf("u           :  add a breakpoint at subroutine calls the current subroutine\n");
+    printf("t           :  print call stack (JSR, BRK and IRQ frames with their cycles so far)\n");
+    printf("u           :  add a breakpoint where the current subroutine or interrupt returns to\n");
     printf("b           :  print all breakpoints\n");
     printf("b addr      :  add breakpoint at addr; it also remove it if the breakpoint exists in the database already\n");
     printf("b label     :  add breakpoint at address correspoinding to the label\n");
+    printf("b addr if c :  conditional breakpoint, c is e.g. A==#$0D  X!=0  [$0230]>3  hits>=5\n");
+    printf("b r addr    :  break after an instruction reads addr (b w addr: writes it); also takes if c\n");
     
     printf("s *lcd*     :  print all labels matching the pattern\n");
     printf("m           :  print current monitoring address\n");
     printf("m addr      :  monitor address (4 byte default); it also remove it from monitor if exits \n");
     printf("m addr n    :  monitor address n byte\n");
+    printf("wp c a [e]  :  stop when a..e changes (wp w: any write, wp r: any read, wp rw...)\n");
+    printf("wp / wp d n :  list watchpoints / delete watchpoint n (wp d: all)\n");
     printf("v           :  kills the tracer if already launched\n");
     printf("v listFile  :  launch the tracer, if not launched\n");
     printf("[           :  step backward in tracer; type enter to exit scroll mode\n");
     printf("]           :  step forward  in tracer; type enter to exit scroll mode\n");
+    printf("snap        :  list snapshots; snap save [file] takes one, snap load <n|file> restores one\n");
+    printf("snap d [n]  :  delete snapshot n (all without n); F5/F9 in the LCD window take/restore too\n");
+    printf("rs [n]      :  reverse-step: go back n instructions (1 without n), registers, memory and LCD\n");
+    printf("rc          :  reverse-continue: go back to the previous breakpoint, write breakpoint or watched write\n");
+    printf("who addr    :  which instruction last wrote addr (or a label), and how far back\n");
 }
 
-// Function to push subroutine call onto debug stack
-void push_subroutine_call(unsigned int jsr_address) {
-    if (call_stack_depth >= MAX_CALL_STACK) {
-        printf("Warning: Call stack overflow!\n");
-        return;
-    }
-    
-    // Find the symbol for this JSR target address
-    SymbolEntry *symbol = find_closest_symbol(jsr_address);
-    
-    call_stack[call_stack_depth].address = jsr_address;
-    if (symbol && symbol->address == jsr_address) {
-        // Exact match - use the symbol name
-        call_stack[call_stack_depth].label = malloc(strlen(symbol->symbol_name) + 1);
-        strcpy(call_stack[call_stack_depth].label, symbol->symbol_name);
+// --- Shadow call stack ---
+// Follows the real SP rather than matching JSR with RTS: a JSR, BRK or IRQ
+// entry opens a frame remembering SP right after its return address went
+// on the stack, and whatever leaves SP above that closes it (RTS, RTI, but
+// also PLA PLA dropping a return address or TXS resetting the stack).
+// Frame 0 is the program started at reset and is never closed.
+//
+// Each frame is stamped with total_cycles, so a closed call knows its
+// inclusive cycles and, minus those of its own calls, its exclusive ones.
+// With --profile, --folded or --chrome-trace these are summed per call
+// path in a tree of CallNodes, which gives the subroutine table of the
+// profile report and the folded stacks (flamegraph.pl, speedscope), while
+// every closed call becomes a complete event in the Chrome/Perfetto trace.
+// Cycles fast-forwarded over an idle loop count for the frame waiting in it.
+
+// Name of a routine for the stack, flamegraphs and traces: its symbol,
+// symbol+offset or $XXXX; interrupt frames are prefixed "irq:" / "brk:".
+static void call_name(uint16_t routine, FrameKind kind, char *buf, size_t size) {
+    SymbolEntry *symbol = find_closest_symbol(routine);
+    const char *prefix = kind == FRAME_IRQ ? "irq:" : kind == FRAME_BRK ? "brk:" : "";
+
+    if (symbol && symbol->address == routine) {
+        snprintf(buf, size, "%s%s", prefix, symbol->symbol_name);
     } else if (symbol) {
-        // Close match - show symbol + offset
-        char temp_label[256];
-        snprintf(temp_label, sizeof(temp_label), "%s+%d", 
-                symbol->symbol_name, jsr_address - symbol->address);
-        call_stack[call_stack_depth].label = malloc(strlen(temp_label) + 1);
-        strcpy(call_stack[call_stack_depth].label, temp_label);
+        snprintf(buf, size, "%s%s+%u", prefix, symbol->symbol_name, routine - symbol->address);
     } else {
-        call_stack[call_stack_depth].label = NULL;
+        snprintf(buf, size, "%s$%04X", prefix, routine);
     }
-    
-    call_stack_depth++;
 }
 
-// Function to pop subroutine call from debug stack
-void pop_subroutine_call() {
-    if (call_stack_depth <= 0) {
-        printf("Warning: RTS without matching JSR!\n");
-        return;
+// Child of parent (-1: a root) for routine, added if this path is new.
+// Returns -1 if out of memory; the call is then not timed.
+static int call_node(int parent, uint16_t routine, FrameKind kind) {
+    int i = parent >= 0 ? call_nodes[parent].first_child : -1;
+
+    for (; i >= 0; i = call_nodes[i].next_sibling) {
+        if (call_nodes[i].routine == routine && call_nodes[i].kind == kind) return i;
     }
-    
-    call_stack_depth--;
-    if (call_stack[call_stack_depth].label) {
-        free(call_stack[call_stack_depth].label);
-        call_stack[call_stack_depth].label = NULL;
+    if (call_node_count == call_node_capacity) {
+        int capacity = call_node_capacity ? call_node_capacity * 2 : 256;
+        CallNode *grown = realloc(call_nodes, capacity * sizeof(CallNode));
+        if (!grown) {
+            printf("Error: out of memory for the call tree\n");
+            return -1;
+        }
+        call_nodes = grown;
+        call_node_capacity = capacity;
     }
+    i = call_node_count++;
+    memset(&call_nodes[i], 0, sizeof(CallNode));
+    call_nodes[i].routine = routine;
+    call_nodes[i].kind = kind;
+    call_nodes[i].parent = parent;
+    call_nodes[i].next_sibling = -1;
+    call_nodes[i].first_child = -1;
+    if (parent >= 0) {
+        call_nodes[i].next_sibling = call_nodes[parent].first_child;
+        call_nodes[parent].first_child = i;
+    }
+    return i;
 }
 
-// Function to print call stack trace
-void print_call_stack() {
-    printf("Call stack trace (%d levels):\n", call_stack_depth);
-    
-    if (call_stack_depth == 0) {
-        printf("  No subroutine calls active\n");
+// Opens a frame for the routine pc now points at.
+void push_call(FrameKind kind, uint16_t call_pc, uint16_t return_pc, uint64_t start) {
+    CallFrame *frame;
+
+    if (call_stack_depth >= MAX_CALL_STACK) {
+        printf("Warning: Call stack overflow!\n");
         return;
     }
-    
-    // Print from bottom to top (oldest to newest calls)
-    for (int i = 0; i < call_stack_depth; i++) {
-        if (call_stack[i].label) {
-            printf("  #%d: %04X (%s)\n", i, call_stack[i].address, call_stack[i].label);
-        } else {
-            printf("  #%d: %04X\n", i, call_stack[i].address);
-        }
-    }
-    printf("\n");
+    frame = &call_stack[call_stack_depth];
+    frame->kind = kind;
+    frame->call_pc = call_pc;
+    frame->target = pc;
+    frame->return_pc = return_pc;
+    frame->sp = kind == FRAME_ROOT ? 0x100 : sp;
+    frame->start = start;
+    frame->child_cycles = 0;
+    frame->node = -1;
+    if (call_timing) frame->node = call_node(call_stack_depth ? call_stack[call_stack_depth - 1].node : -1, pc, kind);
+    call_stack_depth++;
+}
+
+// Closes the innermost frame at cycle end.
+static void close_call(uint64_t end) {
+    CallFrame *frame = &call_stack[--call_stack_depth];
+    uint64_t inclusive = end - frame->start;
+
+    if (call_stack_depth > 0) call_stack[call_stack_depth - 1].child_cycles += inclusive;
+    if (frame->node >= 0) {
+        call_nodes[frame->node].calls++;
+        call_nodes[frame->node].inclusive += inclusive;
+        call_nodes[frame->node].exclusive += inclusive - frame->child_cycles;
+    }
+    if (chrome_trace) {
+        char name[300];
+        call_name(frame->target, frame->kind, name, sizeof(name));
+        fprintf(chrome_trace, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                chrome_trace_events++ ? ",\n" : "", name, frame->kind == FRAME_JSR ? "jsr" : frame->kind == FRAME_ROOT ? "reset" : "interrupt",
+                frame->start * 1e6 / clock_hz, inclusive * 1e6 / clock_hz);
+    }
+}
+
+// Starts the stack over with the root frame at pc, once the CPU is reset.
+void reset_calls(void) {
+    while (call_stack_depth > 0) call_stack_depth--;
+    push_call(FRAME_ROOT, pc, pc, total_cycles);
+}
+
+// Called after every instruction: closes the frames SP has left and opens
+// one for a JSR or BRK. IRQ entry happens outside instructions, see
+// irq_timer_fire().
+void track_calls(uint8_t opcode, uint16_t insn_pc, unsigned int cycles) {
+    while (call_stack_depth > 1 && sp > call_stack[call_stack_depth - 1].sp) close_call(total_cycles);
+    if (opcode == JSR) {
+        push_call(FRAME_JSR, insn_pc, insn_pc + 3, total_cycles - cycles);
+    } else if (opcode == BRK) {
+        push_call(FRAME_BRK, insn_pc, insn_pc + 2, total_cycles - cycles);
+    }
+}
+
+// Writes one line per call path that spent cycles itself, starting with
+// the symbol at the reset vector: "InitBaseAddresses;lcd_init;lcd_wait 1234"
+static void write_folded_stacks(const char *path) {
+    FILE *out = fopen(path, "w");
+    int path_nodes[MAX_CALL_STACK + 1];
+    char name[300];
+    int i, n, depth;
+
+    if (!out) {
+        perror("Error opening the folded stack file");
+        return;
+    }
+    for (i = 0; i < call_node_count; i++) {
+        if (!call_nodes[i].exclusive) continue;
+        depth = 0;
+        for (n = i; n >= 0 && depth <= MAX_CALL_STACK; n = call_nodes[n].parent) path_nodes[depth++] = n;
+        while (depth-- > 0) {
+            call_name(call_nodes[path_nodes[depth]].routine, call_nodes[path_nodes[depth]].kind, name, sizeof(name));
+            fprintf(out, "%s%c", name, depth ? ';' : ' ');
+        }
+        fprintf(out, "%llu\n", (unsigned long long)call_nodes[i].exclusive);
+    }
+    fclose(out);
+    printf("Folded call stacks written to %s\n", path);
+}
+
+// Opens the --chrome-trace file; calls are added as they close.
+int open_chrome_trace(const char *path) {
+    chrome_trace = fopen(path, "w");
+    if (!chrome_trace) {
+        perror("Error opening the Chrome trace file");
+        return 0;
+    }
+    fprintf(chrome_trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    chrome_trace_events = 0;
+    return 1;
+}
+
+// At the end of the run: closes every frame still open at the current
+// cycle and writes out the --folded and --chrome-trace files.
+void finish_calls(void) {
+    while (call_stack_depth > 0) close_call(total_cycles);
+    if (folded_path) write_folded_stacks(folded_path);
+    if (chrome_trace) {
+        fprintf(chrome_trace, "\n]}\n");
+        fclose(chrome_trace);
+        chrome_trace = NULL;
+        printf("Chrome trace of %lu calls written to %s\n", chrome_trace_events, chrome_trace_path);
+    }
+}
+
+// Function to print call stack trace
+void print_call_stack() {
+    char name[300], site[300];
+
+    printf("Call stack trace (%d levels):\n", call_stack_depth - 1);
+    
+    if (call_stack_depth <= 1) {
+        printf("  No subroutine calls active\n");
+    }
+    
+    // Print from bottom to top (oldest to newest calls)
+    for (int i = 1; i < call_stack_depth; i++) {
+        CallFrame *frame = &call_stack[i];
+        call_name(frame->target, frame->kind, name, sizeof(name));
+        call_name(frame->call_pc, FRAME_JSR, site, sizeof(site));
+        printf("  #%d: %04X %-24s from %04X (%s), SP %02X, %llu cycles\n", i - 1, frame->target, name,
+               frame->call_pc, site, frame->sp, (unsigned long long)(total_cycles - frame->start));
+    }
+    printf("\n");
     printf("CPU status:\n");
     SymbolEntry *closest = find_closest_symbol(pc);
     if (closest) {
@@ -1338,16 +2195,13 @@ void print_call_stack() {
 
 // Function to handle "up" command - set breakpoint at return address
 void handle_up_command() {
-    if (sp >= 0xFF) {
+    if (call_stack_depth <= 1) {
         printf("No return address on stack\n");
         return;
     }
     
-    // Get return address from stack
-    unsigned int return_addr = call_stack[call_stack_depth-1].address + 3;
-    // RAM[STACK_BASE + sp + 1] | 
-    // (RAM[STACK_BASE + sp + 2] << 8);
-    //return_addr++; // Adjust for JSR behavior
+    // Where the innermost JSR, BRK or IRQ returns to
+    unsigned int return_addr = call_stack[call_stack_depth - 1].return_pc;
     
     // Set temporary breakpoint at return address
     add_breakpoint(return_addr, "up command breakpoint");
@@ -1361,7 +2215,10 @@ void cleanup_breakpoints() {
             free(breakpoints[i].label);
         }
     }
-    breakpoint_count = 0;
+    free(breakpoints);
+    breakpoints = NULL;
+    breakpoint_count = breakpoint_capacity = 0;
+    memset(bp_bitmap, 0, sizeof(bp_bitmap));
 }
 
 // Simple wildcard pattern matching function
@@ -1492,17 +2349,17 @@ void search_symbols(const char *pattern) {
         return;
     }
     
-    SymbolEntry *current = symbol_list;
     int match_count = 0;
+    int i;
     
     printf("Symbols matching pattern '%s':\n", pattern);
     
-    while (current != NULL) {
+    for (i = 0; i < symbols.count; i++) {
+        SymbolEntry *current = &symbols.entries[i];
         if (match_pattern(pattern, current->symbol_name)) {
             printf("  %04X  %s\n", current->address, current->symbol_name);
             match_count++;
         }
-        current = current->next;
     }
     
     if (match_count == 0) {
@@ -1532,7 +2389,7 @@ void handle_symbol_search_command(const char *input) {
     search_symbols(ptr);
 }
 
-void handle_keyboard_event(SDL_Event *event, LCDSim *lcd, SDL_Window *window, long int loop_cnt) {
+void handle_keyboard_event(SDL_Event *event, long int loop_cnt) {
     char input = 0;
     SDL_Keycode key = event->key.keysym.sym;
 
@@ -1551,8 +2408,7 @@ void handle_keyboard_event(SDL_Event *event, LCDSim *lcd, SDL_Window *window, lo
 
     write6502(KEY_INPUT, input); // put it to keyboard buffer
 
-    LCDSim_Draw(lcd);
-    SDL_UpdateWindowSurface(window);
+    lcd_present();
 }
 
 
@@ -1573,20 +2429,33 @@ char* my_strdup(const char* s) {
     return memcpy(new_str, s, len);
 }
 
-// --- Function to Create and Populate the symbol_list ---
-SymbolEntry* create_symbol_dictionary(const char* filepath) {
-    FILE *file = fopen(filepath, "r");
-    if (!file) {
-        perror("Failed to open list file");
-        return NULL;
-    }
+// --- Function to Free the symbol table ---
+void free_dictionary(void) {
+    free(symbols.entries);
+    free(symbols.names);
+    free(symbols.slots);
+    memset(&symbols, 0, sizeof(symbols));
+}
+
+// Orders by address; names share an arena in list file order, so comparing
+// the name pointers keeps aliases of one address in that order.
+static int compare_symbols(const void *pa, const void *pb) {
+    const SymbolEntry *a = pa, *b = pb;
+    if (a->address != b->address) return a->address < b->address ? -1 : 1;
+    return a->symbol_name < b->symbol_name ? -1 : a->symbol_name > b->symbol_name;
+}
 
-    SymbolEntry *head = NULL;
+// Reads the "Symbols by name:" section of the list file. Returns the number
+// of symbols found, or -1 if the file can't be read.
+static int read_symbols(FILE *file, SymbolEntry *entries, char *names, size_t *name_bytes) {
     char line[256];
     char name_buffer[100];
     char type_char;
     unsigned int address;
+    int count = 0;
+    size_t used = 0;
 
+    rewind(file);
     // Skip header lines
     // The format seems to start after "Symbols by name:"
     while (fgets(line, sizeof(line), file)) {
@@ -1595,59 +2464,85 @@ SymbolEntry* create_symbol_dictionary(const char* filepath) {
         }
     }
 
-    printf("create_symbol_dictionary: started"  );
-
-
     // Read and parse symbol entries
     while (fgets(line, sizeof(line), file)) {
 
         // Use sscanf to parse the symbol name, type, and address
         // The format specifier handles spaces between the symbol name and the type.
         // It also handles a colon and a hex value.
-        int result = sscanf(line, "%s %c:%x", name_buffer, &type_char, &address);
-
-        if (result == 3) {
-            // Found a valid symbol entry
-            SymbolEntry *new_entry = malloc(sizeof(SymbolEntry));
-            if (!new_entry) {
-                perror("Memory allocation failed");
-                fclose(file);
-                return head; // Return what we have so far
+        if (sscanf(line, "%99s %c:%x", name_buffer, &type_char, &address) == 3) {
+            size_t len = strlen(name_buffer) + 1;
+            if (entries) {
+                entries[count].symbol_name = memcpy(names + used, name_buffer, len);
+                entries[count].address = address;
             }
+            used += len;
+            count++;
+        }
+    }
+    if (ferror(file)) return -1;
+    *name_bytes = used;
+    return count;
+}
 
-            // Copy the symbol name
-            //new_entry->symbol_name = strdup(name_buffer);
-            new_entry->symbol_name = my_strdup(name_buffer);
-            if (!new_entry->symbol_name) {
-                perror("Memory allocation failed for symbol name");
-                free(new_entry);
-                fclose(file);
-                return head;
-            }
+// --- Function to Create and Populate the symbol table ---
+// Two passes over the list file: the first sizes the arena and the entry
+// array, the second fills them. Returns 0 on success, -1 on failure.
+int create_symbol_dictionary(const char* filepath) {
+    FILE *file = fopen(filepath, "r");
+    size_t name_bytes;
+    unsigned int slot_count = 16;
+    int count, i;
 
-            new_entry->address = address;
-            
-            //printf("create_symbol_dictionary: %s  %x", new_entry->symbol_name, new_entry->address);
+    if (!file) {
+        perror("Failed to open list file");
+        return -1;
+    }
 
-            // Add the new entry to the front of the list
-            new_entry->next = head;
-            head = new_entry;
-        }
+    printf("create_symbol_dictionary: started"  );
+
+    count = read_symbols(file, NULL, NULL, &name_bytes);
+    if (count <= 0) {
+        fclose(file);
+        return -1;
     }
+    while (slot_count < (unsigned int)count * 2) slot_count *= 2; // at most half full
 
+    symbols.entries = malloc(count * sizeof(SymbolEntry));
+    symbols.names = malloc(name_bytes);
+    symbols.slots = calloc(slot_count, sizeof(int));
+    if (!symbols.entries || !symbols.names || !symbols.slots) {
+        perror("Memory allocation failed");
+        fclose(file);
+        free_dictionary();
+        return -1;
+    }
+    if (read_symbols(file, symbols.entries, symbols.names, &name_bytes) != count) {
+        printf("Error: list file %s changed while reading it\n", filepath);
+        fclose(file);
+        free_dictionary();
+        return -1;
+    }
     fclose(file);
-    return head;
-}
 
-// --- Function to Free the symbol_list ---
-void free_dictionary(SymbolEntry* head) {
-    SymbolEntry *current = head;
-    while (current) {
-        SymbolEntry *temp = current;
-        free(current->symbol_name); // Free the string
-        current = current->next;
-        free(temp); // Free the struct
+    qsort(symbols.entries, count, sizeof(SymbolEntry), compare_symbols);
+    symbols.count = count;
+    symbols.slot_mask = slot_count - 1;
+
+    // A name listed twice keeps its last definition
+    for (i = 0; i < count; i++) {
+        const char *name = symbols.entries[i].symbol_name;
+        unsigned int slot = symbol_hash(name) & symbols.slot_mask;
+        while (symbols.slots[slot]) {
+            SymbolEntry *other = &symbols.entries[symbols.slots[slot] - 1];
+            if (strcmp(other->symbol_name, name) == 0) break;
+            slot = (slot + 1) & symbols.slot_mask;
+        }
+        if (!symbols.slots[slot] || symbols.entries[symbols.slots[slot] - 1].symbol_name < name) {
+            symbols.slots[slot] = i + 1;
+        }
     }
+    return 0;
 }
 
 
@@ -1737,241 +2632,2174 @@ void handle_memory_monitor_command(const char *input) {
     }
 }
 
-int run_emulator_loop(LCDSim *lcd, SDL_Window *window, uint16_t irq_interval, int duration_seconds, const char *list_file) {
-    uint8_t opcode, op1, op2;
-    long int loop_cnt = 0;
-    unsigned int last_irq = 0, total_cycles = 0;
-    int irq_count = 0;
-    int row = 1, col = 0;
-    int break_loop = 0;
-    SDL_Event event;
-
-    time_t start_time = time(NULL);
+// --- Watchpoints ---
+// "wp" watches an address range for reads, writes or changes (writes of a
+// different value) and stops right after the instruction that made the
+// access, reporting its PC with the old and new value. Only the pages a
+// watchpoint covers are routed through watch_read/watch_write by the bus
+// (bus6502_watch); every other page keeps its direct RAM pointer, and the
+// ranges are only searched for accesses that passed that page filter.
+#define WATCH_READ   0x01
+#define WATCH_WRITE  0x02
+#define WATCH_CHANGE 0x04
+#define MAX_WATCH_HITS 8              // accesses reported for one instruction
 
-    int step_enabled = 0;
-    char input_buffer[60];
-    uint8_t opcode_decoded;
-    
-    // enable tracer by default - Flag to track if we've automatically opened tracer
-    int auto_tracer_opened = 0;
+typedef struct {
+    uint16_t start, end;    // inclusive
+    int kinds;              // WATCH_* bits
+    unsigned long hits;
+} Watchpoint;
 
-    while (!break_loop && !quit_flag) {
-    // while (time(NULL) - start_time < duration_seconds && !break_loop && !quit_flag) {
-        
-        // Check for breakpoints (including original and new ones)
-        //if (pc == break_address || is_breakpoint(pc)) {
-        if (is_breakpoint(pc)) {
-            step_enabled = 1;
-        }
-        
-        if (step_enabled) {
-            duration_seconds = INT_MAX;
-            
-            // enable tracer by default - Auto-open tracer when first entering debug mode
-            if (!auto_tracer_opened && list_file && strlen(list_file) > 0) {
-                if (init_tracer_window(list_file)) {
-                    printf("Auto-opened tracer window with file: %s\n", list_file);
-                    update_tracer_display(pc);
-                    render_tracer_window();
-                    auto_tracer_opened = 1;
-                } else {
-                    printf("Failed to auto-open tracer window\n");
-                }
-            }
-            
-            //printf("DEBUG [%04X]: ", pc);
-            
-            // Display current instruction
-            disassemble_current_instruction(stdout, pc, RAM, false);
-            
-            printf("\nDEBUG> ");
-            
-            if (fgets(input_buffer, sizeof(input_buffer), stdin) == NULL) {
-                break;
-            }
-            
-            // Remove newline
-            input_buffer[strcspn(input_buffer, "\n")] = 0;
-            
-            // https://claude.ai/public/artifacts/6c8eb142-6502-40ab-b77a-705c9245dd59
-            if (strlen(input_buffer) == 0) {
-                // Enter pressed - step one instruction
-                // scroll from the last line - Reset scroll position when Enter is pressed in scroll mode
-                if (scroll_mode) {
-                    scroll_mode = 0;
-                    trace_scroll_index = -1;
-                    printf("Exiting trace scroll mode\n");
-                    if (tracer.is_active) {
-                        update_tracer_display(pc);
-                        render_tracer_window();
-                    }
-                }
-                // Continue to execute one instruction
-            } else if (input_buffer[0] == 'h') {
-                print_gdb_help();
-                continue;
-            } else if (input_buffer[0] == 'c') {
-                step_enabled = 0;
-                printf("Continuing execution...\n");
-            } else if (input_buffer[0] == 'r') {
-                handle_read_command(input_buffer);
-                continue; // Don't execute instruction, stay in debug mode
-            } else if (input_buffer[0] == 'w') {
-                handle_write_command(input_buffer);
-                continue; // Don't execute instruction, stay in debug mode
-            } else if (input_buffer[0] == 'u') {
-                handle_up_command();
-                step_enabled = 0; // Continue until return
-            } else if (input_buffer[0] == 't') {
-                print_call_stack();
-                continue; // Don't execute instruction, stay in debug mode
-            } else if (input_buffer[0] == 'b') {
-                handle_breakpoint_command(input_buffer);
-                continue; // Don't execute instruction, stay in debug mode
-            } else if (input_buffer[0] == 's') {
-                handle_symbol_search_command(input_buffer);
-                continue; // Don't execute instruction, stay in debug mode
-            } else if (input_buffer[0] == 'm') {
-                handle_memory_monitor_command(input_buffer);
-                continue; // Don't execute instruction, stay in debug mode
-            // enable tracer by default - Modified tracer command to toggle/close tracer
-            } else if (input_buffer[0] == 'v') {
-                if (tracer.is_active) {
-                    // Close existing tracer
-                    cleanup_tracer();
-                    printf("Tracer window closed\n");
-                } else {
-                    // Open tracer with specified file
-                    if (strlen(input_buffer) > 2) {
-                        char *filename = input_buffer + 2; // Skip "v "
-                        if (init_tracer_window(filename)) {
-                            printf("Tracer window opened with file: %s\n", filename);
-                            update_tracer_display(pc);
-                            render_tracer_window();
-                        } else {
-                            printf("Failed to open tracer window\n");
-                        }
-                    } else {
-                        printf("Usage: v <list_file_path> (or 'v' to close active tracer)\n");
-                    }
-                }
-                continue;
-            // up/down key function + initial window + font increase - Add up/down scroll commands  
-            } else if (input_buffer[0] == '[') {
-                handle_trace_scroll_up();
-                continue;
-            } else if (input_buffer[0] == ']') {
-                if (handle_trace_scroll_down()) {
-                    // Exit scroll mode, update tracer with current PC
-                    if (tracer.is_active) {
-                        update_tracer_display(pc);
-                        render_tracer_window();
-                    }
-                }
-                continue;
-            } else {
-                printf("Unknown command. Available: enter, c, r, w, u, t, b, s, v (toggle tracer), [, ]\n");
-                continue; // Don't execute instruction, stay in debug mode
-            }
+typedef struct {
+    int index;              // watchpoint that fired
+    int kind;               // WATCH_READ, WATCH_WRITE or WATCH_CHANGE
+    uint16_t address;
+    uint8_t old_value, new_value;
+    int by_host;            // not a CPU access (key input, IRQ entry)
+} WatchHit;
+
+static Watchpoint *watchpoints = NULL;
+static int watchpoint_count = 0;
+static int watchpoint_capacity = 0;
+static WatchHit watch_hits[MAX_WATCH_HITS];
+static int watch_hit_count = 0;
+static int watch_hits_lost = 0;
+static int cpu_executing = 0;         // inside exec6502(), see run_chunk()
+
+static void watch_check(int access, uint16_t address, uint8_t old_value, uint8_t new_value) {
+    for (int i = 0; i < watchpoint_count; i++) {
+        Watchpoint *wp = &watchpoints[i];
+        int kind;
+
+        if (address < wp->start || address > wp->end) continue;
+        if (access == WATCH_READ) {
+            if (!(wp->kinds & WATCH_READ)) continue;
+            kind = WATCH_READ;
+        } else if (wp->kinds & WATCH_WRITE) {
+            kind = WATCH_WRITE;
+        } else if ((wp->kinds & WATCH_CHANGE) && old_value != new_value) {
+            kind = WATCH_CHANGE;
+        } else {
+            continue;
         }
-        
-        // SDL_PollEvent removes one event: Each call to SDL_PollEvent(&event) does two things:
-        // It checks if there's an event at the front of the queue.
-        // If there is, it copies that event's data into the event structure you provide AND removes that event from the queue.
-        // It returns 1 if an event was processed and 0 if the queue was empty.
-
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) { 
-                if(step_enabled) {
-                    printf("SDL_QUIT when step_enabled should break the sim loop");
-                    break_loop = 1; break; 
-                } else {
-                    printf("SDL_QUIT when step_enabled is off turns on step_enabled");
-                    step_enabled = 1;
-                }
-            }
-            else if (event.type == SDL_KEYDOWN) {
-                // running this on wsl does not send SDL_QUIT, handle it under SDL_KEYDOWN code 
-                if (event.key.keysym.sym == SDLK_c && (event.key.keysym.mod & KMOD_CTRL)) {
-                    printf("Ctrl+C pressed via keydown event\n");
-                    step_enabled = 1;
-                } else {
-                    handle_keyboard_event(&event, lcd, window, loop_cnt);
-                }
-            }
+        wp->hits++;
+        if (watch_hit_count == MAX_WATCH_HITS) {
+            watch_hits_lost++;
+            continue;
         }
+        watch_hits[watch_hit_count].index = i;
+        watch_hits[watch_hit_count].kind = kind;
+        watch_hits[watch_hit_count].address = address;
+        watch_hits[watch_hit_count].old_value = old_value;
+        watch_hits[watch_hit_count].new_value = new_value;
+        watch_hits[watch_hit_count].by_host = !cpu_executing;
+        watch_hit_count++;
+    }
+}
 
-        // tracer in SDL2 - Handle tracer window events
-        handle_tracer_events();
-
-        if (step_enabled) disassemble_current_instruction(stdout, pc, RAM, false);
-        opcode_decoded = disassemble_current_instruction(log_file, pc, RAM, false);
-        if(opcode_decoded == magic_opcde) {
-            fprintf(log_file, "INFO: magic opcode 0xFF detected, terminate the simulation\n");
-            fprintf(log_file, "INFO: this means the code jumps to pc where opcode is 0x00 BRK and executes \n");
+// Bus handlers for watched pages. They may also see the unwatched direction
+// of an I/O page; watch_check() sorts that out.
+static uint8_t watch_read(void *user, uint16_t address) {
+    uint8_t value = bus6502_mapped_read(&bus, address);
 
-            break; // break the while loop
-        } else if(opcode_decoded == JSR) {
-            unsigned int target_address = pc; // RAM[(pc + 1) & 0xFFFF] | (RAM[(pc + 2) & 0xFFFF] << 8);
-            push_subroutine_call(target_address);
-        } else if(opcode_decoded == RTS) {
-            pop_subroutine_call();
-        }
+    (void)user;
+    watch_check(WATCH_READ, address, value, value);
+    return value;
+}
 
+static void watch_write(void *user, uint16_t address, uint8_t value) {
+    uint8_t old_value = RAM[address];
 
-        exec6502(1);
-        total_cycles += clockticks6502;
+    (void)user;
+    bus6502_mapped_write(&bus, address, value);
+    watch_check(WATCH_WRITE, address, old_value, value);
+}
 
-        // tracer in SDL2 - Update tracer display after instruction execution
-        if (tracer.is_active) {
-            update_tracer_display(pc);
-            render_tracer_window();
+// Re-routes exactly the pages some watchpoint covers.
+static void update_watched_pages(void) {
+    for (int page = 0; page < 256; page++) {
+        int reads = 0, writes = 0;
+        for (int i = 0; i < watchpoint_count; i++) {
+            if ((watchpoints[i].start >> 8) <= page && page <= (watchpoints[i].end >> 8)) {
+                reads |= watchpoints[i].kinds & WATCH_READ;
+                writes |= watchpoints[i].kinds & (WATCH_WRITE | WATCH_CHANGE);
+            }
         }
+        if (reads || writes) bus6502_watch(&bus, page, reads, writes, watch_read, watch_write, NULL);
+        else bus6502_unwatch(&bus, page);
+    }
+}
 
-        // up/down key function + initial window + font increase - Add current state to trace history
-        if (step_enabled || scroll_mode) {
-            char instruction_str[128];
-            char cpu_state_str[256];
-            char ram_state_str[512];
-            
-            // Format instruction (you might need to adjust this based on your disassemble function)
-            sprintf(instruction_str, "%04X: instruction", pc);
-            
-            // Format CPU state
-            sprintf(cpu_state_str, "CPU State: PC:%04X A:%02X X:%02X Y:%02X SP:%02X Status:%02X", 
-                    pc, a, x, y, sp, status);
-            
-            // Format RAM state (simplified, you can expand this)
-            sprintf(ram_state_str, "RAM State: $0000:%02X $0001:%02X $0002:%02X $0003:%02X", 
-                    RAM[0x00], RAM[0x01], RAM[0x02], RAM[0x03]);
-            
-            add_trace_entry(instruction_str, cpu_state_str, ram_state_str, pc);
-        }
+static const char *watch_kinds_name(int kinds) {
+    static char name[4];
+    int n = 0;
 
-        if (step_enabled) print_cpu_state_to_stream(stdout);
-        print_cpu_state_to_stream(log_file);
+    if (kinds & WATCH_READ) name[n++] = 'r';
+    if (kinds & WATCH_WRITE) name[n++] = 'w';
+    if (kinds & WATCH_CHANGE) name[n++] = 'c';
+    name[n] = '\0';
+    return name;
+}
 
-        if (total_cycles - last_irq >= irq_interval) {
-            fprintf(stdout, "Triggering IRQ at %u cycles\n", total_cycles);
-            irq6502();
-            last_irq = total_cycles;
-            irq_count++;
-        }
+void print_watchpoints() {
+    if (watchpoint_count == 0) {
+        printf("No watchpoints set\n");
+        return;
+    }
+    printf("Watchpoints:\n");
+    for (int i = 0; i < watchpoint_count; i++) {
+        Watchpoint *wp = &watchpoints[i];
+        SymbolEntry *closest = find_closest_symbol(wp->start);
+        printf("  %d: %-3s %04X-%04X", i + 1, watch_kinds_name(wp->kinds), wp->start, wp->end);
+        if (closest) printf(" (%s)", closest->symbol_name);
+        printf("  [%lu hits]\n", wp->hits);
+    }
+}
 
-        usleep(10);
-        loop_cnt++;
+// Prints what the last instruction (at instr_pc) did to watched memory.
+void report_watch_hits(uint16_t instr_pc) {
+    for (int i = 0; i < watch_hit_count; i++) {
+        WatchHit *hit = &watch_hits[i];
+        printf("Watchpoint %d: $%04X ", hit->index + 1, hit->address);
+        if (hit->kind == WATCH_READ) printf("read $%02X", hit->new_value);
+        else printf("%s $%02X -> $%02X", hit->kind == WATCH_CHANGE ? "changed" : "written", hit->old_value, hit->new_value);
+        if (hit->by_host) printf(" by the host\n");
+        else printf(" by the instruction at $%04X\n", instr_pc);
+    }
+    if (watch_hits_lost) printf("(%d more watched accesses by the same instruction)\n", watch_hits_lost);
+    watch_hit_count = 0;
+    watch_hits_lost = 0;
+}
+
+// Parses an address or a label for the wp command.
+static int parse_watch_address(const char *token, unsigned int *address) {
+    SymbolEntry *symbol;
+
+    if (sscanf(token, "%x", address) == 1) return 1;
+    symbol = find_symbol_by_name(token);
+    if (!symbol) return 0;
+    *address = symbol->address;
+    return 1;
+}
+
+// wp                      list watchpoints
+// wp r|w|c|rw.. start [end]  watch reads / writes / value changes of start..end
+// wp d [n]                delete watchpoint n, or all of them
+void handle_watchpoint_command(const char *input) {
+    char kinds_arg[8], start_arg[64], end_arg[64];
+    unsigned int start, end;
+    int kinds = 0, n;
+
+    n = sscanf(input, "wp %7s %63s %63s", kinds_arg, start_arg, end_arg);
+    if (n < 1) {
+        print_watchpoints();
+        return;
+    }
+
+    if (strcmp(kinds_arg, "d") == 0) {
+        if (n == 1) {
+            watchpoint_count = 0;
+            printf("All watchpoints deleted\n");
+        } else {
+            int index = atoi(start_arg);
+            if (index < 1 || index > watchpoint_count) {
+                printf("No watchpoint %s\n", start_arg);
+                return;
+            }
+            memmove(&watchpoints[index - 1], &watchpoints[index], (watchpoint_count - index) * sizeof(Watchpoint));
+            watchpoint_count--;
+            printf("Watchpoint %d deleted\n", index);
+        }
+        update_watched_pages();
+        return;
+    }
+
+    for (const char *k = kinds_arg; *k; k++) {
+        if (*k == 'r') kinds |= WATCH_READ;
+        else if (*k == 'w') kinds |= WATCH_WRITE;
+        else if (*k == 'c') kinds |= WATCH_CHANGE;
+        else kinds = -1;
+        if (kinds < 0) break;
+    }
+    if (kinds <= 0 || n < 2 || !parse_watch_address(start_arg, &start) ||
+        (n == 3 && !parse_watch_address(end_arg, &end))) {
+        printf("Usage: wp [r|w|c] <start> [end]   e.g. wp c 0230, wp w 0200 02FF, wp c CMD_INDEX\n");
+        printf("       wp d [n]   delete watchpoint n (all without n)\n");
+        return;
+    }
+    if (n < 3) end = start;
+    if (end < start || end > 0xFFFF) {
+        printf("Bad range %04X-%04X\n", start, end);
+        return;
+    }
+
+    if (watchpoint_count == watchpoint_capacity) {
+        int capacity = watchpoint_capacity ? watchpoint_capacity * 2 : 8;
+        Watchpoint *grown = realloc(watchpoints, capacity * sizeof(*grown));
+        if (!grown) {
+            printf("Error: out of memory for watchpoints\n");
+            return;
+        }
+        watchpoints = grown;
+        watchpoint_capacity = capacity;
+    }
+    watchpoints[watchpoint_count].start = start;
+    watchpoints[watchpoint_count].end = end;
+    watchpoints[watchpoint_count].kinds = kinds;
+    watchpoints[watchpoint_count].hits = 0;
+    watchpoint_count++;
+    update_watched_pages();
+    printf("Watchpoint %d: %s %04X-%04X\n", watchpoint_count, watch_kinds_name(kinds), start, end);
+}
+
+// --- Profiler ---
+// --profile <file> counts, for every address, how often the instruction
+// there ran and how many cycles it took: two array increments per
+// instruction. When the run ends the counters are summed per symbol (the
+// nearest one at or below the address, like the call stack names frames)
+// and per listFile line, and both tables are written sorted by cycles.
+// Cycles an idle loop was fast-forwarded over are not counted.
+#define PROFILE_TOP_LINES 100   // source lines listed in the report
+
+static uint64_t profile_exec[65536];
+static uint64_t profile_cycles[65536];
+
+typedef struct {
+    char *name;             // symbol name, or "file:line  source" of a listFile line
+    unsigned int address;   // symbol address, or the line's instruction address
+    uint64_t exec;          // instructions run
+    uint64_t cycles;
+} ProfileRow;
+
+// Most cycles first, then by address
+static int compare_profile_rows(const void *a, const void *b) {
+    const ProfileRow *x = a, *y = b;
+    if (x->cycles != y->cycles) return x->cycles < y->cycles ? 1 : -1;
+    return (x->address > y->address) - (x->address < y->address);
+}
+
+static void print_profile_row(FILE *stream, const ProfileRow *row, uint64_t total) {
+    fprintf(stream, "%12llu %6.2f%% %12llu  $%04X  %s\n", (unsigned long long)row->cycles,
+            total ? 100.0 * row->cycles / total : 0.0, (unsigned long long)row->exec, row->address, row->name);
+}
+
+// One row per listFile line that holds an executed instruction. A line like
+// "00:822D A900    \t    35:     LDA #$00" is line 35 of the file named by
+// the last "Source: "x.s"" line. Returns the number of rows, -1 on error.
+static int profile_source_lines(const char *list_file, ProfileRow **rows_out, uint64_t *listed_cycles) {
+    char buffer[512], source[sizeof(buffer)] = "?";
+    uint8_t *claimed;
+    ProfileRow *rows = NULL;
+    int count = 0, capacity = 0;
+    FILE *file;
+
+    *rows_out = NULL;
+    *listed_cycles = 0;
+    if (!list_file || !(file = fopen(list_file, "r"))) return -1;
+    claimed = calloc(65536, 1);
+    if (!claimed) {
+        fclose(file);
+        return -1;
+    }
+    while (fgets(buffer, sizeof(buffer), file)) {
+        char *text, *colon;
+        long line;
+        int address;
+
+        buffer[strcspn(buffer, "\r\n")] = 0;
+        if (strncmp(buffer, "Source: \"", 9) == 0) {
+            snprintf(source, sizeof(source), "%s", buffer + 9);
+            source[strcspn(source, "\"")] = 0;
+            continue;
+        }
+        if (strlen(buffer) < 7 || buffer[2] != ':') continue;
+        address = parse_hex4(buffer + 3);
+        if (address < 0 || claimed[address] || !profile_exec[address]) continue;
+        claimed[address] = 1; // the first line listing an address gets it, as in the tracer
+        if (!(text = strchr(buffer, '\t'))) continue;
+        line = strtol(text + 1, &colon, 10);
+        if (*colon != ':') continue;
+        for (text = colon + 1; isspace((unsigned char)*text); text++)
+            ;
+
+        if (count == capacity) {
+            int grown_capacity = capacity ? capacity * 2 : 256;
+            ProfileRow *grown = realloc(rows, grown_capacity * sizeof(ProfileRow));
+            if (!grown) break;
+            rows = grown;
+            capacity = grown_capacity;
+        }
+        rows[count].name = malloc(strlen(source) + strlen(text) + 16);
+        if (!rows[count].name) break;
+        sprintf(rows[count].name, "%s:%ld  %s", source, line, text);
+        rows[count].address = address;
+        rows[count].exec = profile_exec[address];
+        rows[count].cycles = profile_cycles[address];
+        *listed_cycles += rows[count].cycles;
+        count++;
+    }
+    free(claimed);
+    fclose(file);
+    *rows_out = rows;
+    return count;
+}
+
+// Most inclusive cycles first, then by address
+static int compare_call_rows(const void *a, const void *b) {
+    const CallNode *x = a, *y = b;
+    if (x->inclusive != y->inclusive) return x->inclusive < y->inclusive ? 1 : -1;
+    return (x->routine > y->routine) - (x->routine < y->routine);
+}
+
+// Subroutine table of the profile report: the call tree summed per routine.
+// A recursive call's inclusive cycles are already part of the outer call's.
+static void write_call_table(FILE *out, uint64_t total) {
+    int *row_of = calloc(65536, sizeof(int)); // routine -> row + 1
+    CallNode *rows = malloc((call_node_count + 1) * sizeof(CallNode));
+    char name[300];
+    int i, n, count = 0;
+
+    if (!row_of || !rows) {
+        free(row_of);
+        free(rows);
+        return;
+    }
+    for (i = 0; i < call_node_count; i++) {
+        CallNode *node = &call_nodes[i], *row;
+        if (!row_of[node->routine]) {
+            row = &rows[count];
+            memset(row, 0, sizeof(*row));
+            row->routine = node->routine;
+            row->kind = node->kind;
+            row_of[node->routine] = ++count;
+        }
+        row = &rows[row_of[node->routine] - 1];
+        row->calls += node->calls;
+        row->exclusive += node->exclusive;
+        for (n = node->parent; n >= 0 && call_nodes[n].routine != node->routine; n = call_nodes[n].parent)
+            ;
+        if (n < 0) row->inclusive += node->inclusive;
+    }
+    qsort(rows, count, sizeof(CallNode), compare_call_rows);
+
+    fprintf(out, "\nCycles by subroutine, from the call stack (%% of all cycles including idle ones)\n");
+    fprintf(out, "%12s %7s %12s %7s %10s  %5s  %s\n", "inclusive", "%", "exclusive", "%", "calls", "addr", "routine");
+    for (i = 0; i < count; i++) {
+        call_name(rows[i].routine, rows[i].kind, name, sizeof(name));
+        fprintf(out, "%12llu %6.2f%% %12llu %6.2f%% %10llu  $%04X  %s\n",
+                (unsigned long long)rows[i].inclusive, total ? 100.0 * rows[i].inclusive / total : 0.0,
+                (unsigned long long)rows[i].exclusive, total ? 100.0 * rows[i].exclusive / total : 0.0,
+                (unsigned long long)rows[i].calls, rows[i].routine, name);
+    }
+    free(row_of);
+    free(rows);
+}
+
+// Writes the hot spot report. Needs the symbol table, so it runs before
+// free_dictionary().
+void write_profile_report(const char *path, const char *list_file) {
+    ProfileRow *by_symbol, *by_line, unknown = { "(no symbol)", 0, 0, 0 };
+    uint64_t total_exec = 0, total = 0, listed = 0;
+    int i, lines, shown;
+    unsigned int address;
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        perror("Error opening the profile report");
+        return;
+    }
+    by_symbol = calloc(symbols.count + 1, sizeof(ProfileRow));
+    if (!by_symbol) {
+        printf("Error: out of memory writing the profile report\n");
+        fclose(out);
+        return;
+    }
+    for (i = 0; i < symbols.count; i++) {
+        by_symbol[i].name = symbols.entries[i].symbol_name;
+        by_symbol[i].address = symbols.entries[i].address;
+    }
+    for (address = 0; address < 65536; address++) {
+        ProfileRow *row;
+        SymbolEntry *symbol;
+
+        if (!profile_exec[address]) continue;
+        symbol = find_closest_symbol(address);
+        row = symbol ? &by_symbol[symbol - symbols.entries] : &unknown;
+        row->exec += profile_exec[address];
+        row->cycles += profile_cycles[address];
+        total_exec += profile_exec[address];
+        total += profile_cycles[address];
+    }
+    if (unknown.exec) by_symbol[symbols.count] = unknown;
+    qsort(by_symbol, symbols.count + 1, sizeof(ProfileRow), compare_profile_rows);
+
+    fprintf(out, "Profile: %llu cycles in %llu instructions (%llu idle cycles skipped, not counted)\n\n",
+            (unsigned long long)total, (unsigned long long)total_exec, (unsigned long long)idle.skipped_cycles);
+    fprintf(out, "Cycles by symbol\n%12s %7s %12s  %5s  %s\n", "cycles", "%", "instructions", "addr", "symbol");
+    for (i = 0; i <= symbols.count && by_symbol[i].exec; i++) print_profile_row(out, &by_symbol[i], total);
+
+    lines = profile_source_lines(list_file, &by_line, &listed);
+    if (lines < 0) {
+        fprintf(out, "\nNo cycles by source line: %s\n", list_file ? "the list file could not be read" : "no --list file given");
+    } else {
+        qsort(by_line, lines, sizeof(ProfileRow), compare_profile_rows);
+        shown = lines < PROFILE_TOP_LINES ? lines : PROFILE_TOP_LINES;
+        fprintf(out, "\nCycles by source line (top %d of %d, %llu cycles outside the listing)\n%12s %7s %12s  %5s  %s\n",
+                shown, lines, (unsigned long long)(total - listed), "cycles", "%", "instructions", "addr", "line");
+        for (i = 0; i < shown; i++) print_profile_row(out, &by_line[i], total);
+        for (i = 0; i < lines; i++) free(by_line[i].name);
+        free(by_line);
+    }
+    write_call_table(out, total_cycles);
+    free(by_symbol);
+    fclose(out);
+    printf("Profile of %llu cycles written to %s\n", (unsigned long long)total, path);
+}
+
+// --- Frame markers ---
+// The guest brackets code with marker instructions, NOP #imm ($E2 nn), which
+// the 65C02 runs as a 2 byte, 2 cycle no-op (and fake6502 as well), so a
+// marked ROM still behaves the same on the board:
+//
+//   .byte $E2, $00+n    region n (0-15) begins, e.g. at the top of game_loop
+//   .byte $E2, $80+n    region n ends, e.g. right before JSR delay_frame
+//
+// Per region the cycles of every begin..end span (the work of a frame) and
+// every begin..begin span (the whole frame) are kept, and the run ends with
+// min/avg/p99/max of both. With --frame-budget <ms> each frame longer than
+// the budget at --clock-hz is flagged, and the report says how many cycles
+// of the budget the work leaves for a delay loop to burn.
+#define MARK_OPCODE 0xE2
+#define MARK_END 0x80
+#define MARK_REGIONS 16
+#define MARK_FLAGS_SHOWN 10     // over budget frames printed per region, the rest are only counted
+
+typedef struct {
+    uint32_t *cycles;
+    int count;
+    int capacity;
+} CycleSamples;
+
+typedef struct {
+    uint64_t begin;         // cycle of the last begin marker
+    int started;            // a begin marker was seen
+    int open;               // ... and no end marker after it yet
+    CycleSamples work;      // begin -> end
+    CycleSamples frame;     // begin -> next begin
+    unsigned long over_budget;
+} MarkRegion;
+
+static MarkRegion mark_regions[MARK_REGIONS];
+static int marks_seen = 0;
+
+static void add_cycle_sample(CycleSamples *samples, uint64_t cycles) {
+    if (samples->count == samples->capacity) {
+        int capacity = samples->capacity ? samples->capacity * 2 : 256;
+        uint32_t *grown = realloc(samples->cycles, capacity * sizeof(uint32_t));
+        if (!grown) {
+            printf("Error: out of memory for frame marker samples\n");
+            return;
+        }
+        samples->cycles = grown;
+        samples->capacity = capacity;
+    }
+    samples->cycles[samples->count++] = cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles;
+}
+
+static uint64_t frame_budget_cycles(void) {
+    return (uint64_t)(frame_budget_ms * clock_hz / 1000.0);
+}
+
+// A marker instruction at the current cycle, operand is its nn byte.
+void frame_mark(uint8_t operand, uint64_t now) {
+    MarkRegion *region;
+    int n = operand & ~MARK_END;
+
+    if (n >= MARK_REGIONS) return;
+    region = &mark_regions[n];
+    marks_seen = 1;
+    if (operand & MARK_END) {
+        if (region->open) add_cycle_sample(&region->work, now - region->begin);
+        region->open = 0;
+        return;
+    }
+    if (region->started) {
+        uint64_t cycles = now - region->begin;
+        add_cycle_sample(&region->frame, cycles);
+        if (frame_budget_ms > 0 && cycles > frame_budget_cycles() && region->over_budget++ < MARK_FLAGS_SHOWN) {
+            printf("Frame budget: region %d frame %d took %llu cycles (%.2f ms), budget %.2f ms\n", n,
+                   region->frame.count, (unsigned long long)cycles, cycles * 1000.0 / clock_hz, frame_budget_ms);
+        }
+    }
+    region->begin = now;
+    region->started = 1;
+    region->open = 1;
+}
+
+static int compare_cycles(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the samples in place. Returns the average; *min, *p99 and *max are set.
+static double cycle_stats(CycleSamples *samples, uint32_t *min, uint32_t *p99, uint32_t *max) {
+    uint64_t sum = 0;
+    int i;
+
+    qsort(samples->cycles, samples->count, sizeof(uint32_t), compare_cycles);
+    for (i = 0; i < samples->count; i++) sum += samples->cycles[i];
+    *min = samples->cycles[0];
+    *p99 = samples->cycles[(samples->count * 99 + 99) / 100 - 1];
+    *max = samples->cycles[samples->count - 1];
+    return (double)sum / samples->count;
+}
+
+static void print_cycle_stats(FILE *stream, int n, const char *what, CycleSamples *samples) {
+    uint32_t min, p99, max;
+    double avg = cycle_stats(samples, &min, &p99, &max);
+
+    fprintf(stream, "  region %2d %-5s %8d  min %8u  avg %10.1f  p99 %8u  max %8u cycles (max %.2f ms)\n",
+            n, what, samples->count, min, avg, p99, max, max * 1000.0 / clock_hz);
+}
+
+void report_frame_marks(FILE *stream) {
+    uint64_t budget = frame_budget_cycles();
+    int n;
+
+    if (!marks_seen) return;
+    if (frame_budget_ms > 0) {
+        fprintf(stream, "Frame markers, budget %.2f ms = %llu cycles at %llu Hz:\n", frame_budget_ms,
+                (unsigned long long)budget, (unsigned long long)clock_hz);
+    } else {
+        fprintf(stream, "Frame markers at %llu Hz:\n", (unsigned long long)clock_hz);
+    }
+    for (n = 0; n < MARK_REGIONS; n++) {
+        MarkRegion *region = &mark_regions[n];
+        uint32_t min, p99, max;
+        double avg;
+
+        if (region->work.count) print_cycle_stats(stream, n, "work", &region->work);
+        if (region->frame.count) print_cycle_stats(stream, n, "frame", &region->frame);
+        if (frame_budget_ms > 0 && region->frame.count) {
+            fprintf(stream, "  region %2d %lu of %d frames over budget\n", n, region->over_budget, region->frame.count);
+        }
+        if (frame_budget_ms > 0 && region->work.count) {
+            avg = cycle_stats(&region->work, &min, &p99, &max);
+            fprintf(stream, "  region %2d left for the delay loop: %lld cycles after the longest work, %.0f on average\n",
+                    n, (long long)budget - (long long)max, budget - avg);
+        }
+    }
+}
+
+static void free_frame_marks(void) {
+    int n;
+
+    for (n = 0; n < MARK_REGIONS; n++) {
+        free(mark_regions[n].work.cycles);
+        free(mark_regions[n].frame.cycles);
+    }
+    memset(mark_regions, 0, sizeof(mark_regions));
+}
+
+// --- Coverage ---
+// --coverage <prefix> marks, for every address, whether an instruction ran
+// there and, for conditional branches, whether it was taken and whether it
+// fell through: one byte of flags per address, set from after_instruction.
+// The flags are kept in <prefix>.map and ORed into what is already there,
+// so a scripted suite of --headless runs adds up; delete the map to start
+// over. At exit they are mapped to source lines through the listFile, whose
+// lines carry the address, the file ("Source:" lines) and the line number,
+// and written as <prefix>.info (lcov, for genhtml or an IDE) and
+// <prefix>.html (a single page with every listed source line).
+#define COVER_EXEC 0x01
+#define COVER_TAKEN 0x02
+#define COVER_NOT_TAKEN 0x04
+#define COVER_CODE 0x08         // source lines only: the line is an instruction
+#define COVER_BRANCH 0x10       // source lines only: a conditional branch
+
+static uint8_t coverage[65536];
+
+typedef struct {
+    uint8_t flags;          // COVER_* of every address the line assembled to
+    char *text;             // the source line, as listed
+} CoverLine;
+
+typedef struct {
+    char *name;
+    CoverLine *lines;       // indexed by line number - 1
+    int count;              // highest line number seen
+    int capacity;
+} CoverFile;
+
+static CoverFile *cover_files = NULL;
+static int cover_file_count = 0;
+
+static const char *const mnemonics6502 =
+    "ADC AND ASL BCC BCS BEQ BIT BMI BNE BPL BRA BRK BVC BVS CLC CLD CLI CLV CMP CPX CPY DEC DEX DEY EOR INC INX INY "
+    "JMP JSR LDA LDX LDY LSR NOP ORA PHA PHP PHX PHY PLA PLP PLX PLY ROL ROR RTI RTS SBC SEC SED SEI STA STX STY STZ "
+    "TAX TAY TRB TSB TSX TXA TXS TYA WAI STP ";
+
+// Whether the word at text is a 6502 mnemonic (any case) on its own
+static int is_mnemonic(const char *text) {
+    char word[5];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (!isalpha((unsigned char)text[i])) return 0;
+        word[i] = toupper((unsigned char)text[i]);
+    }
+    if (text[3] && !isspace((unsigned char)text[3]) && text[3] != ';') return 0;
+    word[3] = ' ';
+    word[4] = 0;
+    return strstr(mnemonics6502, word) != NULL;
+}
+
+// COVER_CODE (and COVER_BRANCH) if the source line is an instruction,
+// possibly after a label, 0 for directives, data, labels and comments.
+static int classify_source_line(const char *text) {
+    const char *word = text;
+
+    while (isspace((unsigned char)*word)) word++;
+    if (!is_mnemonic(word)) {
+        while (*word && !isspace((unsigned char)*word) && *word != ';') word++; // skip the label
+        while (isspace((unsigned char)*word)) word++;
+        if (!is_mnemonic(word)) return 0;
+    }
+    if (toupper((unsigned char)word[0]) == 'B' && strncasecmp(word, "BIT", 3) && strncasecmp(word, "BRK", 3) && strncasecmp(word, "BRA", 3)) {
+        return COVER_CODE | COVER_BRANCH;
+    }
+    return COVER_CODE;
+}
+
+static CoverFile *cover_file(const char *name) {
+    int i;
+
+    for (i = 0; i < cover_file_count; i++) {
+        if (strcmp(cover_files[i].name, name) == 0) return &cover_files[i];
+    }
+    CoverFile *grown = realloc(cover_files, (cover_file_count + 1) * sizeof(CoverFile));
+    if (!grown) return NULL;
+    cover_files = grown;
+    memset(&cover_files[cover_file_count], 0, sizeof(CoverFile));
+    if (!(cover_files[cover_file_count].name = strdup(name))) return NULL;
+    return &cover_files[cover_file_count++];
+}
+
+static CoverLine *cover_line(CoverFile *file, int line) {
+    if (line > file->capacity) {
+        int capacity = file->capacity ? file->capacity : 256;
+        while (capacity < line) capacity *= 2;
+        CoverLine *grown = realloc(file->lines, capacity * sizeof(CoverLine));
+        if (!grown) return NULL;
+        memset(grown + file->capacity, 0, (capacity - file->capacity) * sizeof(CoverLine));
+        file->lines = grown;
+        file->capacity = capacity;
+    }
+    if (line > file->count) file->count = line;
+    return &file->lines[line - 1];
+}
+
+// Reads the listFile into cover_files. Source paths are taken relative to
+// the listFile's directory, where vasm ran. Returns 0 on success.
+static int load_coverage_sources(const char *list_file) {
+    char buffer[512], dir[256] = "", source[sizeof(dir) + sizeof(buffer)];
+    const char *slash = strrchr(list_file, '/');
+    CoverFile *file = NULL;
+    FILE *in = fopen(list_file, "r");
+
+    if (!in) return -1;
+    if (slash) snprintf(dir, sizeof(dir), "%.*s/", (int)(slash - list_file), list_file);
+    while (fgets(buffer, sizeof(buffer), in)) {
+        char *tab, *text;
+        CoverLine *line;
+        long number;
+        int address;
+
+        buffer[strcspn(buffer, "\r\n")] = 0;
+        if (strncmp(buffer, "Source: \"", 9) == 0) {
+            const char *name = buffer + 9;
+            if (name[0] == '/' || !strncmp(name, dir, strlen(dir))) snprintf(source, sizeof(source), "%s", name);
+            else snprintf(source, sizeof(source), "%s%s", dir, name);
+            source[strcspn(source, "\"")] = 0;
+            file = cover_file(source);
+            continue;
+        }
+        if (!file || !(tab = strchr(buffer, '\t'))) continue;
+        number = strtol(tab + 1, &text, 10);
+        if (number <= 0 || *text != ':' || !(line = cover_line(file, number))) continue;
+        if (text[1] == ' ') text++;
+        text++;
+        if (!line->text) line->text = strdup(text);
+
+        address = buffer[2] == ':' ? parse_hex4(buffer + 3) : -1;
+        if (address < 0 || !classify_source_line(text)) continue;
+        line->flags |= classify_source_line(text) | coverage[address];
+    }
+    fclose(in);
+    return 0;
+}
+
+// Marks one executed instruction, called from after_instruction.
+static inline void cover_instruction(uint16_t insn_pc, uint8_t opcode) {
+    coverage[insn_pc] |= COVER_EXEC;
+    if ((opcode & 0x1F) == 0x10) { // Bxx
+        coverage[insn_pc] |= pc == (uint16_t)(insn_pc + 2) ? COVER_NOT_TAKEN : COVER_TAKEN;
+    }
+}
+
+// Adds the flags saved by earlier runs to this one's.
+void load_coverage_map(const char *prefix) {
+    char path[512];
+    uint8_t saved[65536];
+    FILE *in;
+    int i;
+
+    snprintf(path, sizeof(path), "%s.map", prefix);
+    if (!(in = fopen(path, "rb"))) return;
+    if (fread(saved, 1, sizeof(saved), in) == sizeof(saved)) {
+        for (i = 0; i < 65536; i++) coverage[i] |= saved[i];
+        printf("Coverage: adding to %s\n", path);
+    } else {
+        printf("Warning: %s is not a coverage map, starting over\n", path);
+    }
+    fclose(in);
+}
+
+typedef struct {
+    int lines, lines_hit;
+    int branches, branches_hit;     // two per conditional branch: taken and not taken
+} CoverTotals;
+
+static CoverTotals cover_totals(const CoverFile *file) {
+    CoverTotals t = { 0, 0, 0, 0 };
+    int n;
+
+    for (n = 0; n < file->count; n++) {
+        uint8_t flags = file->lines[n].flags;
+        if (!(flags & COVER_CODE)) continue;
+        t.lines++;
+        t.lines_hit += !!(flags & COVER_EXEC);
+        if (flags & COVER_BRANCH) {
+            t.branches += 2;
+            t.branches_hit += !!(flags & COVER_TAKEN) + !!(flags & COVER_NOT_TAKEN);
+        }
+    }
+    return t;
+}
+
+static void write_coverage_info(FILE *out) {
+    int i, n;
+
+    for (i = 0; i < cover_file_count; i++) {
+        CoverFile *file = &cover_files[i];
+        CoverTotals t = cover_totals(file);
+
+        if (!t.lines) continue;
+        fprintf(out, "TN:\nSF:%s\n", file->name);
+        for (n = 0; n < file->count; n++) {
+            uint8_t flags = file->lines[n].flags;
+            if (flags & COVER_CODE) fprintf(out, "DA:%d,%d\n", n + 1, flags & COVER_EXEC ? 1 : 0);
+        }
+        fprintf(out, "LF:%d\nLH:%d\n", t.lines, t.lines_hit);
+        for (n = 0; n < file->count; n++) {
+            uint8_t flags = file->lines[n].flags;
+            if (!(flags & COVER_BRANCH)) continue;
+            fprintf(out, "BRDA:%d,0,0,%s\n", n + 1, !(flags & COVER_EXEC) ? "-" : flags & COVER_TAKEN ? "1" : "0");
+            fprintf(out, "BRDA:%d,0,1,%s\n", n + 1, !(flags & COVER_EXEC) ? "-" : flags & COVER_NOT_TAKEN ? "1" : "0");
+        }
+        fprintf(out, "BRF:%d\nBRH:%d\nend_of_record\n", t.branches, t.branches_hit);
+    }
+}
+
+static void html_escaped(FILE *out, const char *text) {
+    for (; *text; text++) {
+        if (*text == '<') fputs("&lt;", out);
+        else if (*text == '>') fputs("&gt;", out);
+        else if (*text == '&') fputs("&amp;", out);
+        else fputc(*text, out);
+    }
+}
+
+static void write_coverage_html(FILE *out) {
+    int i, n;
+
+    fprintf(out, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>6502 coverage</title><style>\n"
+                 "body{font-family:sans-serif} table{border-collapse:collapse} td,th{padding:0 8px;text-align:right}\n"
+                 "pre{margin:0} .hit{background:#cfc} .miss{background:#fcc} .part{background:#ffc} .no{color:#888}\n"
+                 "</style></head><body>\n<h1>6502 coverage</h1>\n"
+                 "<table><tr><th>file</th><th>lines</th><th>%%</th><th>branches</th><th>%%</th></tr>\n");
+    for (i = 0; i < cover_file_count; i++) {
+        CoverTotals t = cover_totals(&cover_files[i]);
+
+        if (!t.lines) continue;
+        fprintf(out, "<tr><td style=\"text-align:left\"><a href=\"#f%d\">", i);
+        html_escaped(out, cover_files[i].name);
+        fprintf(out, "</a></td><td>%d/%d</td><td>%.1f</td><td>%d/%d</td><td>%.1f</td></tr>\n",
+                t.lines_hit, t.lines, 100.0 * t.lines_hit / t.lines, t.branches_hit, t.branches,
+                t.branches ? 100.0 * t.branches_hit / t.branches : 100.0);
+    }
+    fprintf(out, "</table>\n");
+    for (i = 0; i < cover_file_count; i++) {
+        CoverFile *file = &cover_files[i];
+
+        if (!cover_totals(file).lines) continue;
+        fprintf(out, "<h2 id=\"f%d\">", i);
+        html_escaped(out, file->name);
+        fprintf(out, "</h2>\n<pre>");
+        for (n = 0; n < file->count; n++) {
+            CoverLine *line = &file->lines[n];
+            const char *class = "no", *note = "";
+
+            if (line->flags & COVER_CODE) class = line->flags & COVER_EXEC ? "hit" : "miss";
+            if ((line->flags & (COVER_BRANCH | COVER_EXEC)) == (COVER_BRANCH | COVER_EXEC)) {
+                if (!(line->flags & COVER_TAKEN)) note = "  [never taken]";
+                else if (!(line->flags & COVER_NOT_TAKEN)) note = "  [always taken]";
+                if (*note) class = "part";
+            }
+            fprintf(out, "<span class=\"%s\">%6d  ", class, n + 1);
+            html_escaped(out, line->text ? line->text : "");
+            fprintf(out, "%s</span>\n", note);
+        }
+        fprintf(out, "</pre>\n");
+    }
+    fprintf(out, "</body></html>\n");
+}
+
+// Saves the map and, with a listFile, writes the lcov and HTML reports.
+void write_coverage(const char *prefix, const char *list_file) {
+    char path[512];
+    FILE *out;
+    int i, n;
+
+    snprintf(path, sizeof(path), "%s.map", prefix);
+    if (!(out = fopen(path, "wb"))) {
+        perror("Error writing the coverage map");
+        return;
+    }
+    fwrite(coverage, 1, sizeof(coverage), out);
+    fclose(out);
+    if (!list_file || load_coverage_sources(list_file) != 0) {
+        printf("Coverage map saved to %s, a --list file is needed for the reports\n", path);
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s.info", prefix);
+    if ((out = fopen(path, "w"))) {
+        write_coverage_info(out);
+        fclose(out);
+    } else {
+        perror("Error writing the lcov report");
+    }
+    snprintf(path, sizeof(path), "%s.html", prefix);
+    if ((out = fopen(path, "w"))) {
+        write_coverage_html(out);
+        fclose(out);
+    } else {
+        perror("Error writing the HTML coverage report");
+    }
+    printf("Coverage written to %s.info and %s.html\n", prefix, prefix);
+
+    for (i = 0; i < cover_file_count; i++) {
+        for (n = 0; n < cover_files[i].count; n++) free(cover_files[i].lines[n].text);
+        free(cover_files[i].lines);
+        free(cover_files[i].name);
+    }
+    free(cover_files);
+    cover_files = NULL;
+    cover_file_count = 0;
+}
+
+// --- Cycle clock, scheduled events and run chunks ---
+// total_cycles is the 64-bit machine clock. The CPU runs in exec6502(budget)
+// chunks that end at the next scheduled event (IRQ timer, device timers...),
+// so nothing is polled per instruction in the main loop. The per-instruction
+// work (trace log, call stack, tracer, breakpoints, magic opcode) runs from
+// the fake6502 hook, which ends a chunk early by setting clockgoal6502.
+#define CHUNK_MAX_CYCLES 1000   // keeps SDL events and Ctrl-C responsive
+
+static uint64_t total_cycles = 0;
+static uint64_t chunk_start_cycles = 0;
+static Scheduler scheduler;
+static int step_enabled = 0;
+
+typedef struct {
+    unsigned int interval;
+    int count;
+} IrqTimer;
+
+static IrqTimer irq_timer;
+
+static struct {
+    uint16_t pc;            // address of the instruction about to run
+    uint8_t opcode;         // and its opcode
+    int stop;               // end the chunk after the current instruction
+    int magic;              // magic opcode reached, end the simulation
+    int idle;               // stopped at the head of an idle loop
+    long instructions;      // instructions run in this chunk
+} chunk;
+
+// Periodic IRQ, reposts itself one interval after it fired
+static void irq_timer_fire(void *user, uint64_t now) {
+    IrqTimer *timer = user;
+    uint16_t interrupted = pc;
+    uint8_t sp_before = sp;
+    if (journal_replaying) { // the journal has the IRQ entry, only keep the timer going
+        timer->count++;
+        sched_post(&scheduler, now + timer->interval, irq_timer_fire, timer);
+        return;
+    }
+    fprintf(stdout, "Triggering IRQ at %llu cycles\n", (unsigned long long)now);
+    irq6502();
+    if (sp != sp_before) push_call(FRAME_IRQ, interrupted, interrupted, now); // not masked
+    timer->count++;
+    sched_post(&scheduler, now + timer->interval, irq_timer_fire, timer);
+}
+
+// Starts the trace record for the instruction at pc and tracks JSR/RTS.
+// Returns 0 on the magic opcode.
+static int before_instruction(void) {
+    uint8_t opcode_decoded = RAM[pc];
+
+    chunk.pc = pc;
+    chunk.opcode = opcode_decoded;
+    if (opcode_decoded == magic_opcde) {
+        if (trace_enabled) trace_mark(TRACE_MAGIC, opcode_decoded);
+        fprintf(log_file, "INFO: magic opcode 0xFF detected, terminate the simulation\n");
+        fprintf(log_file, "INFO: this means the code jumps to pc where opcode is 0x00 BRK and executes \n");
+        chunk.magic = 1;
+        return 0;
+    }
+    if (trace_enabled) trace_begin(opcode_decoded);
+    if (journaling) journal_instruction();
+    if (opcode_decoded == MARK_OPCODE) frame_mark(RAM[(pc + 1) & 0xFFFF], total_cycles);
+    return 1;
+}
+
+static void after_instruction(unsigned int cycles) {
+    if (profile_path) {
+        profile_exec[chunk.pc]++;
+        profile_cycles[chunk.pc] += cycles;
+    }
+    track_calls(chunk.opcode, chunk.pc, cycles);
+    if (coverage_prefix) cover_instruction(chunk.pc, chunk.opcode);
+
+    // Stop at a polling loop that can only be left by a key or an event
+    if (idle_observe(chunk.pc, chunk.opcode, cycles) && !step_enabled) {
+        chunk.idle = 1;
+        chunk.stop = 1;
+    }
+
+    // tracer in SDL2 - Update tracer display after instruction execution
+    if (tracer.is_active) {
+        update_tracer_display(pc);
+        if (step_enabled || tracer_frame_due()) render_tracer_window();
+    }
+
+    // up/down key function + initial window + font increase - Add current state to trace history
+    if (step_enabled || scroll_mode) {
+        add_trace_entry(chunk.pc);
+    }
+
+    if (trace_enabled) {
+        trace_commit(cycles);
+        if (step_enabled) trace_flush(&trace_buf); // keep "tracefmt -f" current while stepping
+    }
+    if (step_enabled) print_cpu_state_to_stream(stdout);
+}
+
+// fake6502 hook, called after every instruction inside exec6502()
+static void on_instruction(void) {
+    uint64_t now = chunk_start_cycles + clockticks6502;
+    unsigned int cycles = (unsigned int)(now - total_cycles);
+
+    total_cycles = now;
+    chunk.instructions++;
+    after_instruction(cycles);
+
+    if (clockticks6502 >= clockgoal6502) return; // chunk over, the main loop prepares the next instruction
+    if (chunk.stop || quit_flag || access_break.pending || watch_hit_count || (!headless && is_breakpoint(pc)) || !before_instruction()) {
+        clockgoal6502 = clockticks6502;
+    }
+}
+
+// Runs the CPU up to the next scheduled event (one instruction when stepping).
+// The instruction at pc must already have gone through before_instruction().
+static void run_chunk(void) {
+    uint64_t budget = step_enabled ? 1 : sched_next(&scheduler) - total_cycles;
+
+    if (budget > CHUNK_MAX_CYCLES) budget = CHUNK_MAX_CYCLES;
+    if (budget == 0) budget = 1;
+    chunk.stop = chunk.magic = chunk.idle = 0;
+    chunk.instructions = 0;
+    chunk_start_cycles = total_cycles;
+    cpu_executing = 1;
+    exec6502((unsigned int)budget);
+    cpu_executing = 0;
+    total_cycles = chunk_start_cycles + clockticks6502;
+}
+
+// --- Snapshots ---
+// A Snapshot is the whole machine: CPU registers and cycle clock, the 64K
+// RAM[], the HD44780 controller, the scheduler's pending events (the IRQ
+// timer), the breakpoints and the shadow call stack. Memory is held as 256
+// byte pages that snapshots share: taking one compares each page with the
+// newest copy of it and only copies pages that changed since, so a
+// snapshot of a machine that touched a few pages costs a 64K compare and
+// those few pages. Pages are never written once taken, restoring copies
+// them back into RAM[].
+//
+// The same state goes to a file (snapshot_save/snapshot_load): host byte
+// order like trace.bin, and all-zero pages are left out. Debugger commands
+// "snap ..." and the LCD window's F5 (take) / F9 (restore the newest) use it.
+#define SNAPSHOT_MAGIC "6502SNP1"
+#define SNAPSHOT_ENDIAN_MARK 0x6502
+
+typedef struct {
+    int refs;               // snapshots holding the page, plus snap_current
+    uint8_t data[256];
+} SnapPage;
+
+typedef struct {
+    SnapPage *pages[256];
+    uint16_t pc;
+    uint8_t a, x, y, sp, status;
+    uint64_t total_cycles;
+    IrqTimer irq_timer;
+    Scheduler scheduler;    // its own copy of the event heap
+    HD44780 lcd;
+    Breakpoint *breakpoints; // own copies, labels included
+    int breakpoint_count;
+    CallFrame *call_stack;
+    int call_stack_depth;
+} Snapshot;
+
+static SnapPage *snap_current[256];     // newest copy of each page, shared by the next snapshot if unchanged
+static Snapshot **snapshots = NULL;     // the debugger's in-memory snapshots, numbered from 1
+static int snapshot_count = 0;
+static int snapshot_capacity = 0;
+
+static void snap_release(SnapPage *page) {
+    if (page && --page->refs == 0) free(page);
+}
+
+// The snapshot's reference to page n of RAM[] as it is now
+static SnapPage *snap_page(int n) {
+    SnapPage *page = snap_current[n];
+
+    if (page && memcmp(page->data, &RAM[n << 8], 256) == 0) {
+        page->refs++;
+        return page;
+    }
+    if (!(page = malloc(sizeof(SnapPage)))) return NULL;
+    memcpy(page->data, &RAM[n << 8], 256);
+    page->refs = 2;
+    snap_release(snap_current[n]);
+    snap_current[n] = page;
+    return page;
+}
+
+void snapshot_free(Snapshot *s) {
+    int i;
+
+    if (!s) return;
+    for (i = 0; i < 256; i++) snap_release(s->pages[i]);
+    for (i = 0; i < s->breakpoint_count; i++) free(s->breakpoints[i].label);
+    free(s->breakpoints);
+    free(s->scheduler.heap);
+    free(s->call_stack);
+    free(s);
+}
+
+// Copies count breakpoints with their labels. Returns NULL if out of memory.
+static Breakpoint *copy_breakpoints(const Breakpoint *from, int count) {
+    Breakpoint *copy = malloc((count ? count : 1) * sizeof(Breakpoint));
+    int i;
+
+    if (!copy) return NULL;
+    for (i = 0; i < count; i++) {
+        copy[i] = from[i];
+        copy[i].label = my_strdup(from[i].label);
+    }
+    return copy;
+}
+
+// Captures the machine. Returns NULL if out of memory.
+Snapshot *snapshot_take(void) {
+    Snapshot *s = calloc(1, sizeof(Snapshot));
+    int i;
+
+    if (!s) goto oom;
+    for (i = 0; i < 256; i++) {
+        if (!(s->pages[i] = snap_page(i))) goto oom;
+    }
+    s->pc = pc;
+    s->a = a; s->x = x; s->y = y; s->sp = sp; s->status = status;
+    s->total_cycles = total_cycles;
+    s->irq_timer = irq_timer;
+    s->scheduler = scheduler;
+    s->scheduler.capacity = scheduler.count;
+    s->scheduler.heap = malloc((scheduler.count ? scheduler.count : 1) * sizeof(ScheduledEvent));
+    if (!s->scheduler.heap) goto oom;
+    memcpy(s->scheduler.heap, scheduler.heap, scheduler.count * sizeof(ScheduledEvent));
+    s->lcd = lcd->mcu;
+    s->breakpoint_count = breakpoint_count;
+    if (!(s->breakpoints = copy_breakpoints(breakpoints, breakpoint_count))) goto oom;
+    s->call_stack_depth = call_stack_depth;
+    s->call_stack = malloc((call_stack_depth ? call_stack_depth : 1) * sizeof(CallFrame));
+    if (!s->call_stack) goto oom;
+    memcpy(s->call_stack, call_stack, call_stack_depth * sizeof(CallFrame));
+    return s;
+
+oom:
+    printf("Error: out of memory taking a snapshot\n");
+    snapshot_free(s);
+    return NULL;
+}
+
+// Puts everything but the breakpoints back as it was when s was taken.
+// Returns 0 if out of memory, the machine is unchanged then.
+static int restore_machine(const Snapshot *s) {
+    ScheduledEvent *heap = malloc((s->scheduler.count ? s->scheduler.count : 1) * sizeof(ScheduledEvent));
+    int i;
+
+    if (!heap) return 0;
+    for (i = 0; i < 256; i++) {
+        memcpy(&RAM[i << 8], s->pages[i]->data, 256);
+        s->pages[i]->refs++;
+        snap_release(snap_current[i]);
+        snap_current[i] = s->pages[i];
+    }
+    pc = s->pc;
+    a = s->a; x = s->x; y = s->y; sp = s->sp; status = s->status;
+    total_cycles = s->total_cycles;
+    irq_timer = s->irq_timer;
+    sched_free(&scheduler);
+    scheduler = s->scheduler;
+    scheduler.heap = heap;
+    scheduler.capacity = scheduler.count ? scheduler.count : 1;
+    memcpy(heap, s->scheduler.heap, s->scheduler.count * sizeof(ScheduledEvent));
+
+    lcd->mcu = s->lcd;
+    lcd->mcu.CGRAM_changed = 0xFFFF; // the atlas may hold other CGRAM patterns
+    lcd->dirty = 1;
+
+    call_stack_depth = s->call_stack_depth;
+    memcpy(call_stack, s->call_stack, call_stack_depth * sizeof(CallFrame));
+
+    idle.armed = 0;         // the loop it was watching is gone
+    pace_resync(total_cycles);
+    return 1;
+}
+
+static uint8_t restore_ram_before[65536]; // RAM[] before a restore, see trace_restore()
+
+// trace.bin only learns about memory through writes, so a restore shows up
+// as a TRACE_RESTORE mark with the new registers and a host write for every
+// byte that differs from restore_ram_before. Callers fill that in first.
+static void trace_restore(void) {
+    int page, i;
+
+    if (!trace_enabled) return;
+    trace_mark(TRACE_RESTORE, RAM[pc]);
+    for (page = 0; page < 65536; page += 256) {
+        if (memcmp(&RAM[page], &restore_ram_before[page], 256) == 0) continue;
+        for (i = page; i < page + 256; i++) {
+            if (RAM[i] != restore_ram_before[i]) trace_note_write((uint16_t)i, RAM[i]);
+        }
+    }
+}
+
+void reverse_forget(void);
+
+// Puts the machine back as it was when s was taken. s stays valid.
+void snapshot_restore(const Snapshot *s) {
+    Breakpoint *restored = copy_breakpoints(s->breakpoints, s->breakpoint_count);
+    int i;
+
+    if (trace_enabled) memcpy(restore_ram_before, RAM, sizeof(restore_ram_before));
+    if (!restored || !restore_machine(s)) {
+        printf("Error: out of memory restoring a snapshot\n");
+        free(restored);
+        return;
+    }
+    cleanup_breakpoints();
+    breakpoints = restored;
+    breakpoint_count = breakpoint_capacity = s->breakpoint_count;
+    for (i = 0; i < breakpoint_count; i++) {
+        bp_bitmap[breakpoints[i].kind][breakpoints[i].address >> 3] |= 1 << (breakpoints[i].address & 7);
+    }
+    trace_restore();
+    reverse_forget();       // the journal leads somewhere else
+}
+
+static int snap_io_failed;
+
+static void snap_put(FILE *out, const void *data, size_t size) {
+    if (size && fwrite(data, size, 1, out) != 1) snap_io_failed = 1;
+}
+
+static void snap_get(FILE *in, void *data, size_t size) {
+    if (size && fread(data, size, 1, in) != 1) {
+        snap_io_failed = 1;
+        memset(data, 0, size);
+    }
+}
+
+// Writes s to path. Returns 0 on success, -1 on error.
+int snapshot_save(const Snapshot *s, const char *path) {
+    uint16_t header[4] = { SNAPSHOT_ENDIAN_MARK, sizeof(HD44780), sizeof(BreakCondition), sizeof(CallFrame) };
+    uint8_t stored[32] = { 0 };
+    uint32_t count;
+    int i, j;
+    FILE *out = fopen(path, "wb");
+
+    if (!out) {
+        perror("Error writing the snapshot");
+        return -1;
+    }
+    snap_io_failed = 0;
+    snap_put(out, SNAPSHOT_MAGIC, 8);
+    snap_put(out, header, sizeof(header));
+    snap_put(out, &s->pc, 2);
+    snap_put(out, &s->a, 1); snap_put(out, &s->x, 1); snap_put(out, &s->y, 1);
+    snap_put(out, &s->sp, 1); snap_put(out, &s->status, 1);
+    snap_put(out, &s->total_cycles, 8);
+    snap_put(out, &s->irq_timer.interval, 4);
+    snap_put(out, &s->irq_timer.count, 4);
+
+    // The IRQ timer is the only kind of event there is; pointers don't go to files
+    snap_put(out, &s->scheduler.next_seq, 8);
+    for (count = 0, i = 0; i < s->scheduler.count; i++) count += s->scheduler.heap[i].fn == irq_timer_fire;
+    snap_put(out, &count, 4);
+    for (i = 0; i < s->scheduler.count; i++) {
+        if (s->scheduler.heap[i].fn == irq_timer_fire) snap_put(out, &s->scheduler.heap[i].when, 8);
+    }
+
+    snap_put(out, &s->lcd, sizeof(HD44780));
+
+    count = s->breakpoint_count;
+    snap_put(out, &count, 4);
+    for (i = 0; i < s->breakpoint_count; i++) {
+        const Breakpoint *bp = &s->breakpoints[i];
+        uint32_t address = bp->address, kind = bp->kind;
+        uint64_t hits = bp->hits;
+        uint16_t length = bp->label ? strlen(bp->label) : 0;
+        snap_put(out, &address, 4);
+        snap_put(out, &kind, 4);
+        snap_put(out, &bp->cond, sizeof(BreakCondition));
+        snap_put(out, &hits, 8);
+        snap_put(out, &length, 2);
+        snap_put(out, bp->label, length);
+    }
+
+    count = s->call_stack_depth;
+    snap_put(out, &count, 4);
+    snap_put(out, s->call_stack, count * sizeof(CallFrame));
+
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 256 && !s->pages[i]->data[j]; j++)
+            ;
+        if (j < 256) stored[i >> 3] |= 1 << (i & 7);
+    }
+    snap_put(out, stored, sizeof(stored));
+    for (i = 0; i < 256; i++) {
+        if (stored[i >> 3] & (1 << (i & 7))) snap_put(out, s->pages[i]->data, 256);
+    }
+
+    if (fclose(out) != 0) snap_io_failed = 1;
+    if (snap_io_failed) {
+        printf("Error writing the snapshot to %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Reads a snapshot written by snapshot_save. Returns NULL on error.
+Snapshot *snapshot_load(const char *path) {
+    uint16_t header[4];
+    uint8_t stored[32];
+    char magic[8];
+    uint32_t count, i;
+    Snapshot *s;
+    FILE *in = fopen(path, "rb");
+
+    if (!in) {
+        perror("Error reading the snapshot");
+        return NULL;
+    }
+    snap_io_failed = 0;
+    snap_get(in, magic, 8);
+    snap_get(in, header, sizeof(header));
+    if (snap_io_failed || memcmp(magic, SNAPSHOT_MAGIC, 8) != 0 || header[0] != SNAPSHOT_ENDIAN_MARK ||
+        header[1] != sizeof(HD44780) || header[2] != sizeof(BreakCondition) || header[3] != sizeof(CallFrame)) {
+        printf("Error: %s is not a snapshot written by this simulator build\n", path);
+        fclose(in);
+        return NULL;
+    }
+    if (!(s = calloc(1, sizeof(Snapshot)))) goto fail;
+    snap_get(in, &s->pc, 2);
+    snap_get(in, &s->a, 1); snap_get(in, &s->x, 1); snap_get(in, &s->y, 1);
+    snap_get(in, &s->sp, 1); snap_get(in, &s->status, 1);
+    snap_get(in, &s->total_cycles, 8);
+    snap_get(in, &s->irq_timer.interval, 4);
+    snap_get(in, &s->irq_timer.count, 4);
+
+    snap_get(in, &s->scheduler.next_seq, 8);
+    snap_get(in, &count, 4);
+    if (snap_io_failed || count > 65536) goto fail;
+    s->scheduler.heap = calloc(count ? count : 1, sizeof(ScheduledEvent));
+    if (!s->scheduler.heap) goto fail;
+    for (i = 0; i < count; i++) { // written in heap order, which stays a heap
+        snap_get(in, &s->scheduler.heap[i].when, 8);
+        s->scheduler.heap[i].seq = i;
+        s->scheduler.heap[i].fn = irq_timer_fire;
+        s->scheduler.heap[i].user = &irq_timer;
+    }
+    s->scheduler.count = s->scheduler.capacity = count;
+
+    snap_get(in, &s->lcd, sizeof(HD44780));
+
+    snap_get(in, &count, 4);
+    if (snap_io_failed || count > 65536 * BP_KINDS) goto fail;
+    if (!(s->breakpoints = calloc(count ? count : 1, sizeof(Breakpoint)))) goto fail;
+    s->breakpoint_count = count;
+    for (i = 0; i < count && !snap_io_failed; i++) {
+        Breakpoint *bp = &s->breakpoints[i];
+        uint32_t address, kind;
+        uint64_t hits;
+        uint16_t length;
+        snap_get(in, &address, 4);
+        snap_get(in, &kind, 4);
+        snap_get(in, &bp->cond, sizeof(BreakCondition));
+        snap_get(in, &hits, 8);
+        snap_get(in, &length, 2);
+        if (address > 0xFFFF || kind >= BP_KINDS) goto fail;
+        bp->address = address;
+        bp->kind = kind;
+        bp->hits = hits;
+        if (length) {
+            if (!(bp->label = malloc(length + 1))) goto fail;
+            snap_get(in, bp->label, length);
+            bp->label[length] = 0;
+        }
+    }
+
+    snap_get(in, &count, 4);
+    if (snap_io_failed || count < 1 || count > MAX_CALL_STACK) goto fail;
+    if (!(s->call_stack = malloc(count * sizeof(CallFrame)))) goto fail;
+    snap_get(in, s->call_stack, count * sizeof(CallFrame));
+    s->call_stack_depth = count;
+    for (i = 0; i < count; i++) s->call_stack[i].node = -1; // the call tree belongs to the run that saved it
+
+    snap_get(in, stored, sizeof(stored));
+    for (i = 0; i < 256; i++) {
+        if (!(s->pages[i] = calloc(1, sizeof(SnapPage)))) goto fail;
+        s->pages[i]->refs = 1;
+        if (stored[i >> 3] & (1 << (i & 7))) snap_get(in, s->pages[i]->data, 256);
+    }
+    if (snap_io_failed) goto fail;
+    fclose(in);
+    return s;
+
+fail:
+    printf("Error: %s is damaged or truncated\n", path);
+    snapshot_free(s);
+    fclose(in);
+    return NULL;
+}
+
+// Keeps s as the next numbered in-memory snapshot. Returns its number, 0 on error.
+static int add_snapshot(Snapshot *s) {
+    if (!s) return 0;
+    if (snapshot_count == snapshot_capacity) {
+        int capacity = snapshot_capacity ? snapshot_capacity * 2 : 8;
+        Snapshot **grown = realloc(snapshots, capacity * sizeof(*grown));
+        if (!grown) {
+            printf("Error: out of memory for snapshots\n");
+            snapshot_free(s);
+            return 0;
+        }
+        snapshots = grown;
+        snapshot_capacity = capacity;
+    }
+    snapshots[snapshot_count++] = s;
+    return snapshot_count;
+}
+
+static void print_snapshot(int n) {
+    const Snapshot *s = snapshots[n - 1];
+    SymbolEntry *closest = find_closest_symbol(s->pc);
+
+    printf("  #%d: %llu cycles, PC %04X", n, (unsigned long long)s->total_cycles, s->pc);
+    if (closest) printf(" under %s", closest->symbol_name);
+    printf("\n");
+}
+
+// Drops every in-memory snapshot and the pages only they held.
+void free_snapshots(void) {
+    int i;
+
+    for (i = 0; i < snapshot_count; i++) snapshot_free(snapshots[i]);
+    free(snapshots);
+    snapshots = NULL;
+    snapshot_count = snapshot_capacity = 0;
+    for (i = 0; i < 256; i++) {
+        snap_release(snap_current[i]);
+        snap_current[i] = NULL;
+    }
+}
+
+// F5 in the LCD window
+void snapshot_hotkey_take(void) {
+    int n = add_snapshot(snapshot_take());
+    if (n) printf("Snapshot %d taken at %llu cycles\n", n, (unsigned long long)total_cycles);
+}
+
+// F9 in the LCD window
+void snapshot_hotkey_restore(void) {
+    if (!snapshot_count) {
+        printf("No snapshot to restore, F5 takes one\n");
+        return;
+    }
+    snapshot_restore(snapshots[snapshot_count - 1]);
+    printf("Snapshot %d restored, PC %04X at %llu cycles\n", snapshot_count, pc, (unsigned long long)total_cycles);
+}
+
+// "snap", "snap save [file]", "snap load <n|file>", "snap d [n]"
+void handle_snapshot_command(const char *input) {
+    char verb[8] = "", arg[256] = "";
+    int fields = sscanf(input, "snap %7s %255s", verb, arg);
+    char *end;
+    long n = strtol(arg, &end, 10);
+    int numbered = fields == 2 && *end == 0;
+
+    if (fields < 1) {
+        if (!snapshot_count) printf("No snapshots\n");
+        for (int i = 1; i <= snapshot_count; i++) print_snapshot(i);
+    } else if (strcmp(verb, "save") == 0 && fields == 2) {
+        Snapshot *s = snapshot_take();
+        if (s && snapshot_save(s, arg) == 0) printf("Snapshot saved to %s\n", arg);
+        snapshot_free(s);
+    } else if (strcmp(verb, "save") == 0) {
+        int taken = add_snapshot(snapshot_take());
+        if (taken) print_snapshot(taken);
+    } else if (strcmp(verb, "load") == 0 && numbered) {
+        if (n < 1 || n > snapshot_count) {
+            printf("No snapshot %ld\n", n);
+            return;
+        }
+        snapshot_restore(snapshots[n - 1]);
+        printf("Snapshot %ld restored\n", n);
+    } else if (strcmp(verb, "load") == 0 && fields == 2) {
+        Snapshot *s = snapshot_load(arg);
+        if (!s) return;
+        snapshot_restore(s);
+        snapshot_free(s);
+        printf("Snapshot restored from %s\n", arg);
+    } else if (strcmp(verb, "d") == 0 && numbered) {
+        if (n < 1 || n > snapshot_count) {
+            printf("No snapshot %ld\n", n);
+            return;
+        }
+        snapshot_free(snapshots[n - 1]);
+        memmove(&snapshots[n - 1], &snapshots[n], (snapshot_count - n) * sizeof(*snapshots));
+        snapshot_count--;
+        printf("Snapshot %ld deleted, later ones renumbered\n", n);
+    } else if (strcmp(verb, "d") == 0 && fields == 1) {
+        for (int i = 0; i < snapshot_count; i++) snapshot_free(snapshots[i]);
+        snapshot_count = 0;
+        printf("All snapshots deleted\n");
+    } else {
+        printf("Usage: snap                 list snapshots\n");
+        printf("       snap save [file]     take one (in memory, or to a file)\n");
+        printf("       snap load <n|file>   restore one\n");
+        printf("       snap d [n]           delete snapshot n (all without n)\n");
+    }
+}
+
+// --- Reverse execution ---
+// rs (reverse-step), rc (reverse-continue) and who (who last wrote an
+// address) move the machine backwards. While the debugger is available
+// every instruction appends to a journal ring: a record with the registers
+// and cycle count before it ran, then one record per memory write with the
+// old and the new byte. Writes from outside the CPU (key input, IRQ entry,
+// the debugger's w) are journaled the same way, marked as host writes. Every
+// CHECKPOINT_INTERVAL instructions a Snapshot is taken into a ring of
+// checkpoints; they share unchanged pages, so one costs little more than
+// the pages written since the previous one.
+//
+// Going back to instruction n restores the newest checkpoint at or before
+// n and redoes the journal forward up to n: registers come from the
+// instruction records, memory and the LCD from the writes (through the bus,
+// so the HD44780 sees them again), the call stack follows SP as it did. No
+// 6502 code runs, so that is at most one checkpoint interval of records
+// however far back n is. Once the machine runs forward again the journal
+// after n is dropped. Memory is bounded by the two rings: what fell out of
+// the journal, or is older than the oldest checkpoint, is out of reach.
+//
+// Reads are not journaled, so rc only stops at execution breakpoints,
+// write breakpoints and write/change watchpoints.
+#define JOURNAL_RECORDS (1u << 21)      // 24 MiB, about 1.5 million instructions; a power of two
+#define CHECKPOINT_INTERVAL 32768       // instructions between checkpoints
+#define CHECKPOINTS 64                  // ring; covers more than the journal does
+
+#define JOURNAL_INSN  0
+#define JOURNAL_WRITE 1                 // by the instruction recorded before it
+#define JOURNAL_HOST  2                 // from outside the CPU
+
+typedef struct {
+    uint32_t cycles;        // INSN: total_cycles before it, low 32 bits
+    uint16_t address;       // INSN: pc; WRITE/HOST: address written
+    uint8_t kind;           // JOURNAL_*
+    uint8_t a;              // INSN: registers before it; WRITE/HOST: old value
+    uint8_t x;              //                             WRITE/HOST: new value
+    uint8_t y, sp, status;
+} JournalRecord;
+
+typedef struct {
+    Snapshot *snapshot;
+    uint64_t insn;          // instructions journaled before it
+    uint64_t record;        // journal records written before it
+} Checkpoint;
+
+static struct {
+    JournalRecord *rec;     // NULL: reverse execution is off
+    uint64_t head;          // records written
+    uint64_t written;       // highest head so far; reverse_to() moves head back, the
+                            // slots below it may hold the dropped future up to here
+    uint64_t insns;         // instructions journaled, the number of the one at pc
+    Checkpoint checkpoints[CHECKPOINTS];
+    int first, count;       // live checkpoints in the ring, oldest first
+} journal;
+
+static Checkpoint *checkpoint_at(int i) {
+    return &journal.checkpoints[(journal.first + i) % CHECKPOINTS];
+}
+
+static void drop_oldest_checkpoint(void) {
+    snapshot_free(checkpoint_at(0)->snapshot);
+    journal.first = (journal.first + 1) % CHECKPOINTS;
+    journal.count--;
+}
+
+static void drop_newest_checkpoint(void) {
+    snapshot_free(checkpoint_at(--journal.count)->snapshot);
+}
+
+static JournalRecord *journal_append(void) {
+    JournalRecord *r = &journal.rec[journal.head++ & (JOURNAL_RECORDS - 1)];
+
+    if (journal.head > journal.written) journal.written = journal.head;
+    // a checkpoint whose records were overwritten can't be redone from
+    while (journal.count && journal.written - checkpoint_at(0)->record > JOURNAL_RECORDS) drop_oldest_checkpoint();
+    return r;
+}
+
+// Called before every instruction
+static void journal_instruction(void) {
+    JournalRecord *r;
+
+    if (journal.insns % CHECKPOINT_INTERVAL == 0 &&
+        !(journal.count && checkpoint_at(journal.count - 1)->insn == journal.insns)) {
+        Snapshot *s = snapshot_take();
+        if (s) {
+            if (journal.count == CHECKPOINTS) drop_oldest_checkpoint();
+            checkpoint_at(journal.count)->snapshot = s;
+            checkpoint_at(journal.count)->insn = journal.insns;
+            checkpoint_at(journal.count)->record = journal.head;
+            journal.count++;
+        }
+    }
+    r = journal_append();
+    r->kind = JOURNAL_INSN;
+    r->address = pc;
+    r->cycles = (uint32_t)total_cycles;
+    r->a = a; r->x = x; r->y = y; r->sp = sp; r->status = status;
+    journal.insns++;
+}
+
+// Called from write6502() before the write happens
+static void journal_write(uint16_t address, uint8_t value) {
+    JournalRecord *r = journal_append();
+
+    r->kind = cpu_executing ? JOURNAL_WRITE : JOURNAL_HOST;
+    r->address = address;
+    r->a = RAM[address];
+    r->x = value;
+}
+
+// The journal and checkpoints no longer lead to the machine as it is
+// (a snapshot was restored). Reverse execution starts over from here.
+void reverse_forget(void) {
+    while (journal.count) drop_oldest_checkpoint();
+    journal.first = 0;
+    journal.head = 0;
+    journal.written = 0;
+    journal.insns = 0;
+}
+
+static int reverse_start(void) {
+    memset(&journal, 0, sizeof(journal));
+    journal.rec = malloc(JOURNAL_RECORDS * sizeof(JournalRecord));
+    if (!journal.rec) {
+        printf("Error: out of memory for the reverse execution journal, rs/rc are off\n");
+        return 0;
+    }
+    journaling = 1;
+    return 1;
+}
+
+static void reverse_stop(void) {
+    reverse_forget();
+    journaling = 0;
+    free(journal.rec);
+    journal.rec = NULL;
+}
+
+// Oldest record still in the ring
+static uint64_t journal_oldest_record(void) {
+    return journal.written > JOURNAL_RECORDS ? journal.written - JOURNAL_RECORDS : 0;
+}
+
+// Number of the oldest instruction that can be gone back to
+static uint64_t reverse_horizon(void) {
+    return journal.count ? checkpoint_at(0)->insn : journal.insns;
+}
+
+static void uncount_breakpoint(uint16_t address) {
+    Breakpoint *bp;
+
+    if (BP_SET(BP_EXEC, address) && (bp = find_breakpoint(BP_EXEC, address)) && bp->hits) bp->hits--;
+}
+
+// Puts the machine back to just before instruction number target (counted
+// from when the journal started). target must lie within
+// [reverse_horizon(), journal.insns].
+static void reverse_to(uint64_t target) {
+    const Checkpoint *from;
+    uint64_t pos, base, insn, prev_cycles = 0;
+    uint16_t prev_pc = 0;
+    uint8_t prev_opcode = 0;
+    uint16_t left_pc = pc;
+    int have_prev = 0, i, timing = call_timing;
+    FILE *chrome = chrome_trace;
+
+    for (i = journal.count - 1; i > 0 && checkpoint_at(i)->insn > target; i--) {}
+    from = checkpoint_at(i);
+    if (trace_enabled) memcpy(restore_ram_before, RAM, sizeof(restore_ram_before));
+    if (!restore_machine(from->snapshot)) {
+        printf("Error: out of memory going back\n");
+        return;
+    }
+
+    // The profile and the Chrome trace have seen these instructions already
+    call_timing = 0;
+    chrome_trace = NULL;
+    journaling = 0;
+    journal_replaying = 1;
+    base = total_cycles;
+    insn = from->insn;
+    for (pos = from->record; pos < journal.head; pos++) {
+        const JournalRecord *r = &journal.rec[pos & (JOURNAL_RECORDS - 1)];
+
+        if (r->kind != JOURNAL_INSN) {
+            bus6502_mapped_write(&bus, r->address, r->x);
+            continue;
+        }
+        base += (uint32_t)(r->cycles - (uint32_t)base);
+        total_cycles = base;
+        pc = r->address;
+        a = r->a; x = r->x; y = r->y; sp = r->sp; status = r->status;
+        sched_run_due(&scheduler, total_cycles);
+        if (have_prev) track_calls(prev_opcode, prev_pc, (unsigned int)(total_cycles - prev_cycles));
+        if (insn == target) break;
+        prev_pc = pc;
+        prev_opcode = RAM[pc];
+        prev_cycles = total_cycles;
+        have_prev = 1;
+        insn++;
+    }
+    journal_replaying = 0;
+    journaling = 1;
+    call_timing = timing;
+    chrome_trace = chrome;
+
+    // Breakpoint arrivals from target on are undone. The run loop counts the
+    // one at target again, as total_cycles differs from its last look.
+    uncount_breakpoint(left_pc);
+    for (; pos < journal.head; journal.head--) {
+        const JournalRecord *r = &journal.rec[(journal.head - 1) & (JOURNAL_RECORDS - 1)];
+        if (r->kind == JOURNAL_INSN) uncount_breakpoint(r->address);
+    }
+
+    // Running on from here writes a new future
+    journal.head = pos;
+    journal.insns = target;
+    while (journal.count && checkpoint_at(journal.count - 1)->insn > target) drop_newest_checkpoint();
+    pace_resync(total_cycles);
+    trace_restore();
+}
+
+static int watch_catches_write(uint16_t address, uint8_t old_value, uint8_t new_value) {
+    for (int i = 0; i < watchpoint_count; i++) {
+        const Watchpoint *wp = &watchpoints[i];
+
+        if (address < wp->start || address > wp->end) continue;
+        if ((wp->kinds & WATCH_WRITE) || ((wp->kinds & WATCH_CHANGE) && old_value != new_value)) return 1;
+    }
+    return 0;
+}
+
+static void print_reverse_position(uint64_t from) {
+    printf("Back %llu instructions, at %llu cycles\n",
+           (unsigned long long)(from - journal.insns), (unsigned long long)total_cycles);
+    print_cpu_state_to_stream(stdout);
+}
+
+static int reverse_available(void) {
+    if (journal.rec) return 1;
+    printf("Reverse execution is off (--no-reverse, or out of memory)\n");
+    return 0;
+}
+
+// rs [n]: step back n instructions (1 without n)
+void handle_reverse_step_command(const char *input) {
+    unsigned long long n = 1;
+    uint64_t from = journal.insns, horizon;
+
+    if (!reverse_available()) return;
+    sscanf(input, "rs %llu", &n);
+    if (n == 0) return;
+    horizon = reverse_horizon();
+    if (from - horizon < n) {
+        if (from == horizon) {
+            printf("Nothing to step back to, the journal starts here\n");
+            return;
+        }
+        printf("Only %llu instructions are kept, going back to the oldest\n", (unsigned long long)(from - horizon));
+        n = from - horizon;
+    }
+    reverse_to(from - n);
+    print_reverse_position(from);
+}
+
+// Condition of bp at an earlier arrival: registers from its journal
+// record, hits as they were then. Returns -1 for a memory condition, only
+// the machine put back can answer that.
+static int journal_break_condition(const Breakpoint *bp, const JournalRecord *r, unsigned long hits) {
+    unsigned long lhs;
+
+    switch (bp->cond.what) {
+        case COND_NONE: return 1;
+        case COND_A:    lhs = r->a; break;
+        case COND_X:    lhs = r->x; break;
+        case COND_Y:    lhs = r->y; break;
+        case COND_SP:   lhs = r->sp; break;
+        case COND_P:    lhs = r->status; break;
+        case COND_MEM:  return -1;
+        case COND_HITS: lhs = hits; break;
+        default:        return 1;
+    }
+    return compare_break_condition(&bp->cond, lhs);
+}
+
+// rc: go back to the latest earlier point where execution would have
+// stopped: an execution breakpoint whose condition holds, or a write
+// caught by a write breakpoint or watchpoint (stops before the writer).
+// Conditions are judged from the journal; only [addr] ones need the
+// machine put back to each candidate.
+void handle_reverse_continue_command(void) {
+    uint64_t from = journal.insns, horizon, insn, pos;
+    unsigned long *hits;    // each breakpoint's hit count at the arrival being looked at
+    Breakpoint *bp;
+    int wrote = 0, i;
+
+    if (!reverse_available()) return;
+    horizon = reverse_horizon();
+    if (from == horizon) {
+        printf("Nothing to go back to, the journal starts here\n");
+        return;
+    }
+    hits = malloc((breakpoint_count ? breakpoint_count : 1) * sizeof(*hits));
+    if (!hits) {
+        printf("Error: out of memory for rc\n");
+        return;
+    }
+    for (i = 0; i < breakpoint_count; i++) hits[i] = breakpoints[i].hits;
+    // the arrival at pc is counted but not journaled yet
+    if (BP_SET(BP_EXEC, pc) && (bp = find_breakpoint(BP_EXEC, pc)) && hits[bp - breakpoints]) hits[bp - breakpoints]--;
+
+    insn = journal.insns;
+    for (pos = journal.head; insn > horizon && pos-- > checkpoint_at(0)->record; ) {
+        const JournalRecord *r = &journal.rec[pos & (JOURNAL_RECORDS - 1)];
+        int stop;
+
+        if (r->kind == JOURNAL_WRITE) {
+            if (BP_SET(BP_WRITE, r->address) || watch_catches_write(r->address, r->a, r->x)) wrote = 1;
+            continue;
+        }
+        if (r->kind != JOURNAL_INSN) continue;
+        insn--;
+        if (wrote) {
+            reverse_to(insn);
+            printf("Stopped before the instruction at $%04X, it writes a watched address\n", pc);
+            print_reverse_position(from);
+            free(hits);
+            return;
+        }
+        if (!BP_SET(BP_EXEC, r->address)) continue;
+        bp = find_breakpoint(BP_EXEC, r->address);
+        if (!bp) {
+            stop = 1;
+        } else {
+            stop = journal_break_condition(bp, r, hits[bp - breakpoints]);
+            if (hits[bp - breakpoints]) hits[bp - breakpoints]--;
+        }
+        if (stop < 0) {
+            reverse_to(insn);   // [addr] needs the memory as it was
+            stop = compare_break_condition(&bp->cond, RAM[bp->cond.address]);
+        }
+        if (stop) {
+            if (journal.insns != insn) reverse_to(insn);
+            printf("Stopped at the breakpoint at $%04X\n", pc);
+            print_reverse_position(from);
+            free(hits);
+            return;
+        }
+    }
+    free(hits);
+    if (journal.insns > horizon) reverse_to(horizon);
+    printf("No breakpoint or watched write further back, stopped at the oldest kept instruction\n");
+    print_reverse_position(from);
+}
+
+// who addr: the latest journaled write to addr and the instruction that did it
+void handle_who_command(const char *input) {
+    char arg[64];
+    unsigned int address;
+    uint64_t insn, pos, stop;
+    int found = 0;
+
+    if (!reverse_available()) return;
+    if (sscanf(input, "who %63s", arg) != 1 || !parse_watch_address(arg, &address) || address > 0xFFFF) {
+        printf("Usage: who <addr|label>\n");
+        return;
+    }
+    insn = journal.insns;
+    stop = journal_oldest_record();
+    for (pos = journal.head; pos-- > stop; ) {
+        const JournalRecord *r = &journal.rec[pos & (JOURNAL_RECORDS - 1)];
+
+        if (r->kind == JOURNAL_INSN) {
+            insn--;
+            if (found) {
+                SymbolEntry *closest = find_closest_symbol(r->address);
+                printf("  by the instruction at $%04X", r->address);
+                if (closest) printf(" (%s+%u)", closest->symbol_name, (unsigned int)(r->address - closest->address));
+                printf(", %llu instructions ago at %llu cycles\n", (unsigned long long)(journal.insns - insn),
+                       (unsigned long long)(total_cycles - (uint32_t)((uint32_t)total_cycles - r->cycles)));
+                printf("  A:%02X X:%02X Y:%02X SP:%02X Status:%02X before it ran; rs %llu goes there\n",
+                       r->a, r->x, r->y, r->sp, r->status, (unsigned long long)(journal.insns - insn));
+                return;
+            }
+            continue;
+        }
+        if (found || r->address != address) continue;
+        printf("$%04X was last written with $%02X (was $%02X)\n", address, r->x, r->a);
+        if (r->kind == JOURNAL_HOST) {
+            printf("  from outside the CPU (key input, IRQ entry or the w command)\n");
+            return;
+        }
+        found = 1;
+    }
+    if (found) printf("  by an instruction no longer in the journal\n");
+    else printf("No write to $%04X in the last %llu instructions\n", address, (unsigned long long)(journal.insns - insn));
+}
+
+int run_emulator_loop(unsigned int irq_interval, int duration_seconds, const char *list_file) {
+    uint8_t opcode, op1, op2;
+    long int loop_cnt = 0;
+    int row = 1, col = 0;
+    int break_loop = 0;
+    SDL_Event event;
+
+    time_t start_time = time(NULL);
+
+    char input_buffer[60];
+    int exit_status = headless ? EXIT_FAILURE : 0; // stays a failure if a headless run is interrupted
+    
+    // enable tracer by default - Flag to track if we've automatically opened tracer
+    int auto_tracer_opened = 0;
+
+    sched_init(&scheduler);
+    irq_timer.interval = irq_interval;
+    irq_timer.count = 0;
+    sched_post(&scheduler, irq_interval, irq_timer_fire, &irq_timer);
+    if (trace_enabled && !trace_open("trace.bin")) trace_enabled = 0;
+    call_timing = profile_path || folded_path || chrome_trace_path;
+    if (chrome_trace_path && !open_chrome_trace(chrome_trace_path)) chrome_trace_path = NULL;
+    reset_calls();
+    if (coverage_prefix) load_coverage_map(coverage_prefix);
+    if (reverse_debugging && !headless) reverse_start(); // the debugger is never entered headless
+    hookexternal((void *)on_instruction);
+    pace_start(total_cycles);
+
+    while (!break_loop && !quit_flag) {
+    // while (time(NULL) - start_time < duration_seconds && !break_loop && !quit_flag) {
+        
+        // Check for breakpoints (including original and new ones)
+        //if (pc == break_address || is_breakpoint(pc)) {
+        if (!headless && is_breakpoint(pc)) {
+            step_enabled = 1;
+        }
+        if (access_break.pending) {
+            printf("%s: $%04X %s $%02X by the instruction at $%04X\n", break_kind_name(access_break.kind),
+                   access_break.address, access_break.kind == BP_READ ? "read as" : "written with",
+                   access_break.value, chunk.pc);
+            access_break.pending = 0;
+            step_enabled = 1;
+        }
+        if (watch_hit_count) {
+            report_watch_hits(chunk.pc);
+            step_enabled = 1;
+        }
+        
+        if (step_enabled) {
+            duration_seconds = INT_MAX;
+            
+            // enable tracer by default - Auto-open tracer when first entering debug mode
+            if (!auto_tracer_opened && list_file && strlen(list_file) > 0) {
+                if (init_tracer_window(list_file)) {
+                    printf("Auto-opened tracer window with file: %s\n", list_file);
+                    update_tracer_display(pc);
+                    render_tracer_window();
+                    auto_tracer_opened = 1;
+                } else {
+                    printf("Failed to auto-open tracer window\n");
+                }
+            }
+            
+            //printf("DEBUG [%04X]: ", pc);
+            lcd_present(); // show the LCD as it is now before waiting for a command
+            
+            // Display current instruction
+            disassemble_current_instruction(stdout, pc, RAM, false);
+            
+            printf("\nDEBUG> ");
+            
+            if (fgets(input_buffer, sizeof(input_buffer), stdin) == NULL) {
+                break;
+            }
+            
+            // Remove newline
+            input_buffer[strcspn(input_buffer, "\n")] = 0;
+            
+            // https://claude.ai/public/artifacts/6c8eb142-6502-40ab-b77a-705c9245dd59
+            if (strlen(input_buffer) == 0) {
+                // Enter pressed - step one instruction
+                // scroll from the last line - Reset scroll position when Enter is pressed in scroll mode
+                if (scroll_mode) {
+                    scroll_mode = 0;
+                    trace_scroll_index = -1;
+                    printf("Exiting trace scroll mode\n");
+                    if (tracer.is_active) {
+                        update_tracer_display(pc);
+                        render_tracer_window();
+                    }
+                }
+                // Continue to execute one instruction
+            } else if (input_buffer[0] == 'h') {
+                print_gdb_help();
+                continue;
+            } else if (input_buffer[0] == 'c') {
+                step_enabled = 0;
+                printf("Continuing execution...\n");
+            } else if (strncmp(input_buffer, "rs", 2) == 0 || strncmp(input_buffer, "rc", 2) == 0) {
+                if (input_buffer[1] == 's') handle_reverse_step_command(input_buffer);
+                else handle_reverse_continue_command();
+                if (tracer.is_active) {
+                    update_tracer_display(pc);
+                    render_tracer_window();
+                }
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 'r') {
+                handle_read_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (strncmp(input_buffer, "who", 3) == 0) {
+                handle_who_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (strncmp(input_buffer, "wp", 2) == 0) {
+                handle_watchpoint_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 'w') {
+                handle_write_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 'u') {
+                handle_up_command();
+                step_enabled = 0; // Continue until return
+            } else if (input_buffer[0] == 't') {
+                print_call_stack();
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 'b') {
+                handle_breakpoint_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (strncmp(input_buffer, "snap", 4) == 0) {
+                handle_snapshot_command(input_buffer);
+                if (tracer.is_active) {
+                    update_tracer_display(pc);
+                    render_tracer_window();
+                }
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 's') {
+                handle_symbol_search_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            } else if (input_buffer[0] == 'm') {
+                handle_memory_monitor_command(input_buffer);
+                continue; // Don't execute instruction, stay in debug mode
+            // enable tracer by default - Modified tracer command to toggle/close tracer
+            } else if (input_buffer[0] == 'v') {
+                if (tracer.is_active) {
+                    // Close existing tracer
+                    cleanup_tracer();
+                    printf("Tracer window closed\n");
+                } else {
+                    // Open tracer with specified file
+                    if (strlen(input_buffer) > 2) {
+                        char *filename = input_buffer + 2; // Skip "v "
+                        if (init_tracer_window(filename)) {
+                            printf("Tracer window opened with file: %s\n", filename);
+                            update_tracer_display(pc);
+                            render_tracer_window();
+                        } else {
+                            printf("Failed to open tracer window\n");
+                        }
+                    } else {
+                        printf("Usage: v <list_file_path> (or 'v' to close active tracer)\n");
+                    }
+                }
+                continue;
+            // up/down key function + initial window + font increase - Add up/down scroll commands  
+            } else if (input_buffer[0] == '[') {
+                handle_trace_scroll_up();
+                continue;
+            } else if (input_buffer[0] == ']') {
+                if (handle_trace_scroll_down()) {
+                    // Exit scroll mode, update tracer with current PC
+                    if (tracer.is_active) {
+                        update_tracer_display(pc);
+                        render_tracer_window();
+                    }
+                }
+                continue;
+            } else {
+                printf("Unknown command. Available: enter, c, r, w, u, t, b, s, v (toggle tracer), [, ], snap, rs, rc, who\n");
+                continue; // Don't execute instruction, stay in debug mode
+            }
+        }
+        
+        // SDL_PollEvent removes one event: Each call to SDL_PollEvent(&event) does two things:
+        // It checks if there's an event at the front of the queue.
+        // If there is, it copies that event's data into the event structure you provide AND removes that event from the queue.
+        // It returns 1 if an event was processed and 0 if the queue was empty.
+
+        while (!headless && SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) { 
+                if(step_enabled) {
+                    printf("SDL_QUIT when step_enabled should break the sim loop");
+                    break_loop = 1; break; 
+                } else {
+                    printf("SDL_QUIT when step_enabled is off turns on step_enabled");
+                    step_enabled = 1;
+                }
+            }
+            else if (event.type == SDL_KEYDOWN) {
+                // running this on wsl does not send SDL_QUIT, handle it under SDL_KEYDOWN code 
+                if (event.key.keysym.sym == SDLK_c && (event.key.keysym.mod & KMOD_CTRL)) {
+                    printf("Ctrl+C pressed via keydown event\n");
+                    step_enabled = 1;
+                } else if (event.key.keysym.sym == SDLK_F5) {
+                    snapshot_hotkey_take();
+                } else if (event.key.keysym.sym == SDLK_F9) {
+                    snapshot_hotkey_restore();
+                    lcd_present();
+                } else {
+                    handle_keyboard_event(&event, loop_cnt);
+                }
+            }
+        }
+
+        // tracer in SDL2 - Handle tracer window events
+        handle_tracer_events();
+
+        if (step_enabled) disassemble_current_instruction(stdout, pc, RAM, false);
+        if (!before_instruction()) break; // magic opcode
+
+        run_chunk();
+        if (chunk.magic) {
+            exit_status = headless ? a : 0;
+            break;
+        }
+
+        if (headless && chunk.idle) {
+            // Type the next key when the ROM sits waiting for one. Otherwise
+            // only an IRQ can still change anything.
+            if (!headless_feed_key()) {
+                if (!(status & FLAG_INTERRUPT) && sched_next(&scheduler) != SCHED_NEVER) {
+                    total_cycles += idle_skip(sched_next(&scheduler) - total_cycles);
+                } else {
+                    printf("headless: ROM idle at $%04X, %s\n", pc,
+                           keys_exhausted ? "keyboard input exhausted" : "pending key is never read");
+                    exit_status = HEADLESS_STALL_EXIT;
+                    break;
+                }
+            }
+        } else if (chunk.idle && !step_enabled && !turbo) {
+            // Sleep through an idle loop instead of emulating it, up to the next event
+            lcd_present();
+            total_cycles += idle_fast_forward(sched_next(&scheduler) - total_cycles);
+        }
+
+        sched_run_due(&scheduler, total_cycles);
+
+        pace(total_cycles);
+        lcd_refresh();
+        loop_cnt += chunk.instructions;
+
+        if (max_cycles && total_cycles >= max_cycles) {
+            printf("Stopping after --max-cycles %llu\n", (unsigned long long)max_cycles);
+            exit_status = HEADLESS_STALL_EXIT;
+            break;
+        }
     }
 
     fprintf(log_file, "--- Simulation Finished ---\n");
     dump_memory_range(log_file, 0xBB00, 0xCFFF);
     print_cpu_state_to_stream(stdout);
-    fprintf(log_file, "Total Cycles: %u | IRQs: %d | $02 = %02X\n", total_cycles, irq_count, RAM[0x02]);
+    fprintf(log_file, "Total Cycles: %llu | IRQs: %d | $02 = %02X\n", (unsigned long long)total_cycles, irq_timer.count, RAM[0x02]);
+    fprintf(log_file, "Idle: %llu cycles skipped in %lu sleeps\n", (unsigned long long)idle.skipped_cycles, idle.sleeps);
+    pace_report(log_file, total_cycles);
+    pace_report(stdout, total_cycles);
+    report_frame_marks(log_file);
+    report_frame_marks(stdout);
+    free_frame_marks();
+    if (!headless) {
+        fprintf(log_file, "LCD: %lu port writes, %lu frames presented (at most %u per second)\n",
+                lcd_writes, lcd_presents, lcd_refresh_hz);
+    }
+    if (trace_enabled) trace_close(log_file);
+    finish_calls();
+    if (profile_path) write_profile_report(profile_path, list_file);
+    if (coverage_prefix) write_coverage(coverage_prefix, list_file);
     fclose(log_file);
+    hookexternal(NULL);
+    sched_free(&scheduler);
 
     // tracer in SDL2 - Cleanup tracer on exit
     cleanup_tracer();
+    reverse_stop();
+    free_snapshots();
 
-    return 0;
+    return exit_status;
 
 }
 
@@ -1984,32 +4812,19 @@ int handle_symbol_lookup(const char* list_file_path, const char* break_symbol_na
         return 0; 
     }
 
-    // Create the symbol_list from the list file
-    symbol_list = create_symbol_dictionary(list_file_path);
-
-    if (!symbol_list) {
+    // Create the symbol table from the list file
+    if (create_symbol_dictionary(list_file_path) != 0) {
         fprintf(stderr, "Error: Could not create symbol dictionary from file: %s\n", list_file_path);
         return -1; // Indicate failure
     }
 
-    // --- Example of searching for a symbol ---
-    SymbolEntry *current = symbol_list;
-    //while (current) {
-    //    printf("Symbol: %-25s Address: 0x%04X\n", current->symbol_name, current->address);
-    //    current = current->next;
-    // }
-
     if (break_symbol_name) {
-        current = symbol_list;
+        SymbolEntry *current = find_symbol_by_name(break_symbol_name);
         int found = 0;
-        while (current) {
-            if (strcmp(current->symbol_name, break_symbol_name) == 0) {
-                printf("Found breakpoint symbol '%s' at address 0x%04X\n", break_symbol_name, current->address);
-                found = 1;
-                add_breakpoint(current->address, break_symbol_name);
-                break;
-            }
-            current = current->next;
+        if (current) {
+            printf("Found breakpoint symbol '%s' at address 0x%04X\n", break_symbol_name, current->address);
+            found = 1;
+            add_breakpoint(current->address, break_symbol_name);
         }
 
         if (!found) {
@@ -2026,12 +4841,29 @@ int handle_symbol_lookup(const char* list_file_path, const char* break_symbol_na
 // --- Main Function ---
 int main(int argc, char *argv[]) {
     int opt; // To store the return value of getopt_long
+    int trace_requested = 0;
+    int clock_given = 0;
+    int exit_status;
 
     // Define the long options
     static struct option long_options[] = {
         {"hex",           required_argument, 0, 'h'}, // 'h' is the short option equivalent value
         {"list",          required_argument, 0, 'l'}, // 'l' is the short option equivalent value
         {"break_symbol",  required_argument, 0, 'b'}, // 'b' is the short option equivalent value
+        {"headless",      no_argument,       0, 'H'}, // long only: no SDL window, full speed
+        {"keys",          required_argument, 0, 'k'}, // long only: key script for --headless (default stdin)
+        {"trace",         no_argument,       0, 'T'}, // long only: keep trace.bin under --headless
+        {"trace-drop",    no_argument,       0, 'D'}, // long only: drop trace records rather than wait for the disk
+        {"max-cycles",    required_argument, 0, 'M'}, // long only: watchdog for scripted runs
+        {"clock-hz",      required_argument, 0, 'C'}, // long only: emulated clock rate (default 1000000)
+        {"turbo",         no_argument,       0, 'U'}, // long only: don't pace at all
+        {"lcd-hz",        required_argument, 0, 'L'}, // long only: LCD window refresh rate (default 60)
+        {"profile",       required_argument, 0, 'P'}, // long only: write a cycles-per-symbol/line report at exit
+        {"folded",        required_argument, 0, 'F'}, // long only: folded call stacks for flamegraphs at exit
+        {"chrome-trace",  required_argument, 0, 'J'}, // long only: calls as Chrome/Perfetto trace event JSON
+        {"frame-budget",  required_argument, 0, 'B'}, // long only: ms per marked frame, longer ones are flagged
+        {"coverage",      required_argument, 0, 'V'}, // long only: coverage map, lcov and HTML reports with this prefix
+        {"no-reverse",    no_argument,       0, 'R'}, // long only: no journal for rs/rc/who, saves 24 MiB and some speed
         {0, 0, 0, 0} // Sentinel to mark the end of the array
     };
 
@@ -2055,6 +4887,61 @@ int main(int argc, char *argv[]) {
                 printf("Break symbol specified: %s\n", break_symbol_name);
                 //add_breakpoint(return_addr, "up command breakpoint");
                 break;
+            case 'H': // Corresponds to --headless
+                headless = 1;
+                break;
+            case 'k': // Corresponds to --keys
+                key_script_path = optarg;
+                break;
+            case 'T': // Corresponds to --trace
+                trace_requested = 1;
+                break;
+            case 'D': // Corresponds to --trace-drop
+                trace_overflow = TRACE_DROP;
+                break;
+            case 'M': // Corresponds to --max-cycles
+                max_cycles = strtoull(optarg, NULL, 0);
+                break;
+            case 'C': // Corresponds to --clock-hz
+                clock_hz = strtoull(optarg, NULL, 0);
+                if (clock_hz == 0) {
+                    fprintf(stderr, "Error: --clock-hz needs a positive rate (use --turbo to run unthrottled)\n");
+                    return EXIT_FAILURE;
+                }
+                clock_given = 1;
+                break;
+            case 'U': // Corresponds to --turbo
+                turbo = 1;
+                break;
+            case 'L': // Corresponds to --lcd-hz
+                lcd_refresh_hz = (unsigned int)strtoul(optarg, NULL, 0);
+                if (lcd_refresh_hz == 0 || lcd_refresh_hz > 1000) {
+                    fprintf(stderr, "Error: --lcd-hz needs a rate from 1 to 1000\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P': // Corresponds to --profile
+                profile_path = optarg;
+                break;
+            case 'F': // Corresponds to --folded
+                folded_path = optarg;
+                break;
+            case 'J': // Corresponds to --chrome-trace
+                chrome_trace_path = optarg;
+                break;
+            case 'V': // Corresponds to --coverage
+                coverage_prefix = optarg;
+                break;
+            case 'R': // Corresponds to --no-reverse
+                reverse_debugging = 0;
+                break;
+            case 'B': // Corresponds to --frame-budget
+                frame_budget_ms = strtod(optarg, NULL);
+                if (frame_budget_ms <= 0) {
+                    fprintf(stderr, "Error: --frame-budget needs a positive number of milliseconds\n");
+                    return EXIT_FAILURE;
+                }
+                break;
             case '?': // getopt_long returns '?' for an unknown option
                 fprintf(stderr, "Unknown option or missing argument.\n");
                 // getopt_long already prints an error message.
@@ -2070,6 +4957,10 @@ int main(int argc, char *argv[]) {
     if (hex_file_path == NULL) {
         fprintf(stderr, "Error: --hex <hex_file_path> is required.\n");
         fprintf(stderr, "Usage: %s --hex <hex_file> [--list <list_file>] [--break_symbol <symbol>]\n", argv[0]);
+        fprintf(stderr, "       [--headless [--keys <key_script>] [--trace]] [--max-cycles <n>]\n");
+        fprintf(stderr, "       [--clock-hz <hz> | --turbo] [--trace-drop] [--lcd-hz <hz>]\n");
+        fprintf(stderr, "       [--profile <report_file>] [--folded <stacks_file>] [--chrome-trace <json_file>]\n");
+        fprintf(stderr, "       [--frame-budget <ms>] [--coverage <prefix>] [--no-reverse]\n");
         return EXIT_FAILURE;
     }
 
@@ -2090,8 +4981,22 @@ int main(int argc, char *argv[]) {
 
 
 
-    if (!initialize_sdl_and_lcd(&window, &screen, &lcd)) return EXIT_FAILURE;
+    if (headless) {
+        trace_enabled = trace_requested;
+        if (!clock_given) turbo = 1; // batch runs go flat out unless asked to pace
+        key_script = stdin;
+        if (key_script_path && !(key_script = fopen(key_script_path, "r"))) {
+            perror("Error opening key script");
+            return EXIT_FAILURE;
+        }
+        if (break_symbol_name) printf("Note: breakpoints are ignored in headless mode\n");
+        if (!(lcd = create_headless_lcd())) return EXIT_FAILURE;
+    } else {
+        if (key_script_path) printf("Note: --keys only applies to --headless\n");
+        if (!initialize_sdl_and_lcd(&window, &screen, &lcd)) return EXIT_FAILURE;
+    }
 
+    setup_bus();
     if (!load_program_and_irq(hex_file_path, program_start_address, irq_handler_address)) return EXIT_FAILURE;
         
     
@@ -2102,7 +5007,16 @@ int main(int argc, char *argv[]) {
     reset6502();
     signal(SIGINT, handle_sigint); // capture ctrl-c
 
-    run_emulator_loop(lcd, window, irq_cycle_interval, SIM_TIME_SECONDS, list_file_path);
+    exit_status = run_emulator_loop(irq_cycle_interval, SIM_TIME_SECONDS, list_file_path);
+    free_dictionary();
+
+    if (headless) {
+        print_headless_lcd(stdout, lcd);
+        printf("headless: exit status %d after %llu cycles\n", exit_status, (unsigned long long)total_cycles);
+        if (key_script != stdin) fclose(key_script);
+        free(lcd);
+        return exit_status;
+    }
 
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,275 @@
+// trace6502.h - compact binary instruction trace
+//
+// Writing five formatted lines per instruction to trace.log dominated the
+// simulator's run time. Instead every executed instruction becomes one
+// 16 byte TraceRecord in an in-memory ring buffer, written out in big
+// blocks, normally by a writer thread. tracefmt turns trace.bin back into
+// the familiar text log.
+//
+// File layout: TraceFileHeader, the 64K memory image when tracing started,
+// then records in execution order. Replaying the memory writes on top of
+// the image gives the memory contents at any point, so instruction operand
+// bytes and the RAM State lines don't have to be stored per record.
+//
+//   TRACE_INSN               an executed instruction: pc, opcode, registers
+//                            after it ran, next_pc, cycles, and its first
+//                            memory write if TRACE_WRITE is set too
+//   TRACE_WRITE|TRACE_CONT   a further write by the instruction just before
+//                            (JSR pushes two bytes, an IRQ or BRK three)
+//   TRACE_WRITE              a write from outside the CPU (keyboard, IRQ entry)
+//   TRACE_MAGIC              the 0xFF stop opcode was reached at pc
+//   TRACE_END                last record, the simulator closed the trace
+//   TRACE_GAP                records were dropped here under overload
+//   TRACE_RESTORE            the debugger put the machine back in time (a
+//                            snapshot, rs or rc): registers in the record,
+//                            the changed memory follows as TRACE_WRITEs
+//
+// Records are stored in host byte order; the header's endian field tells a
+// reader on another machine.
+
+#ifndef TRACE6502_H
+#define TRACE6502_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define TRACE_MAGIC_ID "6502TRC1"
+#define TRACE_ENDIAN_MARK 0x6502
+#define TRACE_BUFFER_RECORDS (1u << 16) // 1 MiB ring, must be a power of two
+
+#define TRACE_INSN  0x01
+#define TRACE_WRITE 0x02
+#define TRACE_CONT  0x04
+#define TRACE_MAGIC 0x08
+#define TRACE_END   0x10
+#define TRACE_GAP   0x20            // records were dropped here, see trace_gap_count()
+#define TRACE_RESTORE 0x40          // machine restored, pc and registers are the new ones
+
+typedef struct {
+    uint16_t pc;            // instruction address
+    uint16_t next_pc;       // pc once it ran
+    uint16_t waddr;         // memory write, valid with TRACE_WRITE
+    uint8_t wval;
+    uint8_t opcode;
+    uint8_t a, x, y, sp, status;
+    uint8_t cycles;         // cycles the instruction took
+    uint8_t flags;          // TRACE_*
+    uint8_t reserved;
+} TraceRecord;
+
+typedef struct {
+    char magic[8];          // TRACE_MAGIC_ID, not terminated
+    uint16_t endian;        // TRACE_ENDIAN_MARK in the writer's byte order
+    uint16_t record_size;   // sizeof(TraceRecord)
+    uint32_t reserved;
+} TraceFileHeader;
+
+typedef char trace_record_is_16_bytes[sizeof(TraceRecord) == 16 ? 1 : -1];
+
+// TraceBuffer is a single-producer/single-consumer ring of records. head is
+// only advanced by the producer (the CPU thread) and tail only by whoever
+// writes records out; both are free-running counters published with
+// release stores, so neither side ever takes a lock. Three ways to drain it:
+//
+//   out == NULL            flight recorder, the oldest records are overwritten
+//   trace_init(.., out)    the producer fwrites a full ring itself
+//   trace_start_writer()   a background thread writes whatever is queued; a
+//                          full ring makes the producer wait (TRACE_WAIT,
+//                          nothing is lost) or drop and count (TRACE_DROP,
+//                          the CPU thread never blocks). Drops show up in the
+//                          stream as a TRACE_GAP record.
+
+typedef enum { TRACE_WAIT, TRACE_DROP } TraceOverflow;
+
+typedef struct {
+    TraceRecord *rec;
+    uint32_t mask;          // capacity - 1
+    uint32_t head;          // records pushed (producer)
+    uint32_t tail;          // records written out (consumer)
+    uint32_t tail_seen;     // producer's last look at tail
+    FILE *out;              // NULL: keep the newest records only, never write
+    TraceOverflow overflow;
+    int threaded;
+    int closing;            // set by the producer to stop the writer thread
+    pthread_t writer;
+    uint64_t total;         // records pushed
+    uint64_t dropped;       // records lost to TRACE_DROP
+    uint64_t waits;         // times the producer had to wait for the writer
+    uint64_t gap;           // drops not reported in the stream yet
+    uint64_t flushes;       // block writes
+} TraceBuffer;
+
+#define TRACE_WRITER_IDLE_NS 1000000L // writer thread poll interval when the ring is empty
+
+// Returns 0 on success, -1 if out of memory. capacity must be a power of two.
+static inline int trace_init(TraceBuffer *tb, uint32_t capacity, FILE *out) {
+    memset(tb, 0, sizeof(*tb));
+    tb->rec = malloc(capacity * sizeof(TraceRecord));
+    if (!tb->rec) {
+        printf("Error: out of memory for the trace buffer\n");
+        return -1;
+    }
+    tb->mask = capacity - 1;
+    tb->out = out;
+    return 0;
+}
+
+// Writes the header and the memory image the trace starts from.
+static inline int trace_write_header(FILE *out, const uint8_t *mem) {
+    TraceFileHeader h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC_ID, sizeof(h.magic));
+    h.endian = TRACE_ENDIAN_MARK;
+    h.record_size = sizeof(TraceRecord);
+    if (fwrite(&h, sizeof(h), 1, out) != 1 || fwrite(mem, 1, 65536, out) != 65536) return -1;
+    return 0;
+}
+
+// Reads and checks the header and memory image. Returns 0 if they are valid.
+static inline int trace_read_header(FILE *in, uint8_t *mem) {
+    TraceFileHeader h;
+
+    if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, TRACE_MAGIC_ID, sizeof(h.magic)) != 0) return -1;
+    if (h.endian != TRACE_ENDIAN_MARK || h.record_size != sizeof(TraceRecord)) return -1;
+    if (fread(mem, 1, 65536, in) != 65536) return -1;
+    return 0;
+}
+
+// Number of records a TRACE_GAP record stands for.
+static inline uint32_t trace_gap_count(const TraceRecord *r) {
+    return (uint32_t)r->pc | (uint32_t)r->next_pc << 16;
+}
+
+// fwrites records [from, to) in at most two runs.
+static inline void trace_write_range(TraceBuffer *tb, uint32_t from, uint32_t to) {
+    uint32_t first = from & tb->mask;
+    uint32_t n = to - from;
+    uint32_t run = n;
+
+    if (first + run > tb->mask + 1) run = tb->mask + 1 - first;
+    fwrite(&tb->rec[first], sizeof(TraceRecord), run, tb->out);
+    fwrite(tb->rec, sizeof(TraceRecord), n - run, tb->out);
+    tb->flushes++;
+}
+
+static inline void trace_put(TraceBuffer *tb, const TraceRecord *r) {
+    tb->rec[tb->head & tb->mask] = *r;
+    if (tb->threaded) __atomic_store_n(&tb->head, tb->head + 1, __ATOMIC_RELEASE);
+    else tb->head++;
+    if (!tb->out && tb->head - tb->tail > tb->mask) tb->tail++; // flight recorder: forget the oldest
+    tb->total++;
+}
+
+// Gets the buffer onto disk: writes it out, or waits until the writer
+// thread has caught up.
+static inline void trace_flush(TraceBuffer *tb) {
+    if (!tb->out) return;
+    if (tb->threaded) {
+        while (__atomic_load_n(&tb->tail, __ATOMIC_ACQUIRE) != tb->head) sched_yield();
+        tb->tail_seen = tb->head;
+        return;
+    }
+    if (tb->head == tb->tail) return;
+    trace_write_range(tb, tb->tail, tb->head);
+    fflush(tb->out);
+    tb->tail = tb->head;
+}
+
+// Makes room for n records that belong together, waiting for the writer or
+// dropping per tb->overflow. Returns 1 if they may be trace_put(), 0 if they
+// were counted as dropped.
+static inline int trace_reserve(TraceBuffer *tb, uint32_t n) {
+    uint32_t capacity = tb->mask + 1;
+    uint32_t need = n + (tb->gap ? 1 : 0);
+    int waited = 0;
+
+    if (!tb->out) return 1;
+    if (!tb->threaded) {
+        if (tb->head - tb->tail + n > capacity) trace_flush(tb);
+        return 1;
+    }
+    while (tb->head - tb->tail_seen + need > capacity) {
+        tb->tail_seen = __atomic_load_n(&tb->tail, __ATOMIC_ACQUIRE);
+        if (tb->head - tb->tail_seen + need <= capacity) break;
+        if (tb->overflow == TRACE_DROP) {
+            tb->dropped += n;
+            tb->gap += n;
+            return 0;
+        }
+        if (!waited) tb->waits++;
+        waited = 1;
+        sched_yield();
+    }
+    if (tb->gap) {
+        TraceRecord mark;
+        memset(&mark, 0, sizeof(mark));
+        mark.pc = (uint16_t)tb->gap;
+        mark.next_pc = (uint16_t)(tb->gap >> 16);
+        mark.flags = TRACE_GAP;
+        trace_put(tb, &mark);
+        tb->gap = 0;
+    }
+    return 1;
+}
+
+static inline void trace_push(TraceBuffer *tb, const TraceRecord *r) {
+    if (trace_reserve(tb, 1)) trace_put(tb, r);
+}
+
+static inline void *trace_writer_main(void *arg) {
+    TraceBuffer *tb = arg;
+    struct timespec idle = { 0, TRACE_WRITER_IDLE_NS };
+    int unflushed = 0;
+
+    for (;;) {
+        uint32_t head = __atomic_load_n(&tb->head, __ATOMIC_ACQUIRE);
+
+        if (head != tb->tail) {
+            trace_write_range(tb, tb->tail, head);
+            __atomic_store_n(&tb->tail, head, __ATOMIC_RELEASE);
+            unflushed = 1;
+        } else if (unflushed) {
+            fflush(tb->out); // caught up, let readers (tracefmt -f) see it
+            unflushed = 0;
+        } else if (__atomic_load_n(&tb->closing, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&tb->head, __ATOMIC_ACQUIRE) == tb->tail) break;
+        } else {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Hands writing over to a background thread. Returns 0 on success; on
+// failure the buffer keeps writing from the producer.
+static inline int trace_start_writer(TraceBuffer *tb, TraceOverflow overflow) {
+    if (!tb->out) return -1;
+    tb->overflow = overflow;
+    tb->threaded = 1;
+    if (pthread_create(&tb->writer, NULL, trace_writer_main, tb) != 0) {
+        tb->threaded = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Writes out everything still queued (stops the writer thread) and frees the ring.
+static inline void trace_free(TraceBuffer *tb) {
+    if (tb->threaded) {
+        __atomic_store_n(&tb->closing, 1, __ATOMIC_RELEASE);
+        pthread_join(tb->writer, NULL);
+        tb->threaded = 0;
+    } else {
+        trace_flush(tb);
+    }
+    free(tb->rec);
+    tb->rec = NULL;
+}
+
+#endif
@@ -0,0 +1,125 @@
+// tracefmt - renders the simulator's binary trace.bin as the text trace.log
+//
+//   tracefmt [-f] [trace.bin] > trace.log
+//   python3 tools/tracer/tracer.py listFile trace.log
+//
+// Every instruction prints as the disassembly line followed by the CPU State
+// and RAM State lines, exactly as the simulator used to write them. Memory
+// is rebuilt from the image at the start of the trace plus every recorded
+// write, so operand bytes and RAM State reflect the machine at that point.
+// -f keeps following a trace that is still being written (like tail -f) and
+// stops when the simulator closes it, so tracer.py can follow a live run.
+//
+// Build: cc -std=c99 -O2 tracefmt.c -o tracefmt
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "disasm6502.h"
+#include "trace6502.h"
+
+#define FOLLOW_POLL_MS 100
+
+static uint8_t mem[65536];
+static TraceRecord pending;   // instruction whose state lines are not printed yet
+static int have_pending = 0;
+
+static void print_state(FILE *stream, const TraceRecord *r) {
+    fprintf(stream, "CPU State: PC:%04X A:%02X X:%02X Y:%02X SP:%02X Status:%02X (NV-B DIZC)\n",
+            r->next_pc, r->a, r->x, r->y, r->sp, r->status);
+    fprintf(stream, "RAM State: $0000:%02X $0001:%02X $0002:%02X $0003:%02X\n",
+            mem[0x0000], mem[0x0001], mem[0x0002], mem[0x0003]);
+    fprintf(stream, "RAM State: $6000:%02X $6001:%02X scroll mode $0264:%02X row $0230:%02X col $0231:%02X   \n",
+            mem[0x6000], mem[0x6001], mem[0x0264], mem[0x0230], mem[0x0231]);
+    fprintf(stream, "RAM State: $0300:%02X $0301:%02X $0302:%02X $0303:%02X\n",
+            mem[0x0300], mem[0x0301], mem[0x0302], mem[0x0303]);
+}
+
+// Reads the next record. In follow mode waits for the writer instead of
+// giving up at end of file. Returns 1 on success, 0 at the end.
+static int next_record(FILE *in, TraceRecord *r, int follow) {
+    struct timespec poll = { 0, FOLLOW_POLL_MS * 1000000L };
+    size_t got;
+
+    for (;;) {
+        got = fread(r, 1, sizeof(*r), in);
+        if (got == sizeof(*r)) return 1;
+        if (!follow) return 0;
+        if (got) fseek(in, -(long)got, SEEK_CUR); // partial record, reread it whole
+        if (have_pending) { // the simulator writes an instruction and its writes in one block
+            print_state(stdout, &pending);
+            have_pending = 0;
+        }
+        clearerr(in);
+        fflush(stdout);
+        nanosleep(&poll, NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "trace.bin";
+    int follow = 0;
+    int opt;
+    FILE *in;
+    TraceRecord r;
+    unsigned long long instructions = 0;
+
+    while ((opt = getopt(argc, argv, "f")) != -1) {
+        switch (opt) {
+            case 'f':
+                follow = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f] [trace.bin]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) path = argv[optind];
+
+    in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    if (trace_read_header(in, mem) != 0) {
+        fprintf(stderr, "Error: %s is not a trace written by this simulator build\n", path);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    // An instruction's state lines wait for the TRACE_CONT writes after it
+    while (next_record(in, &r, follow)) {
+        if (have_pending && !(r.flags & TRACE_CONT)) {
+            print_state(stdout, &pending);
+            have_pending = 0;
+        }
+        if (r.flags & TRACE_INSN) {
+            disasm6502(stdout, r.pc, r.opcode, mem[(r.pc + 1) & 0xFFFF], mem[(r.pc + 2) & 0xFFFF]);
+            pending = r;
+            have_pending = 1;
+            instructions++;
+        } else if (r.flags & TRACE_MAGIC) {
+            disasm6502(stdout, r.pc, r.opcode, mem[(r.pc + 1) & 0xFFFF], mem[(r.pc + 2) & 0xFFFF]);
+            printf("INFO: magic opcode 0xFF detected, terminate the simulation\n");
+        }
+        if (r.flags & TRACE_RESTORE) {
+            printf("--- machine restored to PC:%04X A:%02X X:%02X Y:%02X SP:%02X Status:%02X ---\n",
+                   r.pc, r.a, r.x, r.y, r.sp, r.status);
+        }
+        if (r.flags & TRACE_GAP) {
+            printf("--- %lu trace records dropped, RAM State may be stale from here ---\n",
+                   (unsigned long)trace_gap_count(&r));
+        }
+        if (r.flags & TRACE_WRITE) mem[r.waddr] = r.wval;
+        if (r.flags & TRACE_END) break;
+    }
+    if (have_pending) print_state(stdout, &pending);
+
+    fclose(in);
+    fprintf(stderr, "tracefmt: %llu instructions\n", instructions);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/*
+	bus6502.h - paged memory bus for fake6502
+
+	The 64K address space is split into 256 pages of 256 bytes. Each page is
+	either backed by a host pointer (plain RAM or ROM) or by a read/write
+	handler pair (memory mapped I/O). RAM and ROM accesses are a table lookup
+	plus a pointer dereference, so adding devices costs nothing for the
+	zero page and stack traffic that most programs spend their time on.
+
+	Single header, like fake6502.h. Typical use:
+
+		static uint8_t mem[65536];
+		static bus6502_t bus;
+
+		bus6502_init(&bus);
+		bus6502_map_ram(&bus, 0x00, 0x80, &mem[0x0000]);
+		bus6502_map_rom(&bus, 0x80, 0x80, &mem[0x8000]);
+		bus6502_map_io(&bus, 0x60, 1, lcd_read, lcd_write, lcd);
+
+		uint8 read6502(ushort address) { return bus6502_read(&bus, address); }
+		void write6502(ushort address, uint8 value) { bus6502_write(&bus, address, value); }
+
+	For a cpu6502_t instance, pass bus6502_cpu_read/bus6502_cpu_write and the
+	bus6502_t as the user pointer of its cpu6502_bus_t.
+
+	Handlers receive the full 16 bit address. Unmapped pages read as $FF and
+	ignore writes. Later mappings replace earlier ones page by page.
+
+	Watching a page (bus6502_watch) routes its reads and/or writes through a
+	handler pair without changing what is mapped there: the mapping is kept
+	aside, and the watch handlers reach it through bus6502_mapped_read and
+	bus6502_mapped_write. Pages that are not watched keep their direct
+	pointers, so debugger watchpoints cost nothing outside the pages they
+	cover. Unwatch a page before mapping something else onto it.
+*/
+
+#ifndef BUS6502_H
+#define BUS6502_H
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t (*bus6502_read_fn)(void *user, uint16_t address);
+typedef void (*bus6502_write_fn)(void *user, uint16_t address, uint8_t value);
+
+typedef struct {
+    uint8_t *read_ptr;          /* direct read pointer, NULL for I/O pages */
+    uint8_t *write_ptr;         /* direct write pointer, NULL for ROM and I/O pages */
+    bus6502_read_fn read;       /* used when read_ptr is NULL */
+    bus6502_write_fn write;     /* used when write_ptr is NULL */
+    void *user;
+} bus6502_page_t;
+
+typedef struct {
+    bus6502_page_t page[256];
+    bus6502_page_t mapped[256];         /* real mapping of watched pages */
+    uint8_t watched[256];
+} bus6502_t;
+
+static inline uint8_t bus6502_open_read(void *user, uint16_t address) {
+    (void)user; (void)address;
+    return 0xFF;
+}
+
+static inline void bus6502_ignore_write(void *user, uint16_t address, uint8_t value) {
+    (void)user; (void)address; (void)value;
+}
+
+static inline void bus6502_init(bus6502_t *bus) {
+    int i;
+    memset(bus, 0, sizeof(*bus));
+    for (i = 0; i < 256; i++) {
+        bus->page[i].read = bus6502_open_read;
+        bus->page[i].write = bus6502_ignore_write;
+    }
+}
+
+/*maps pages first..first+count-1 onto mem, which must hold count*256 bytes*/
+static inline void bus6502_map_ram(bus6502_t *bus, int first, int count, uint8_t *mem) {
+    int i;
+    for (i = 0; i < count && first + i < 256; i++) {
+        bus6502_page_t *p = &bus->page[first + i];
+        p->read_ptr = p->write_ptr = mem + i * 256;
+        p->read = bus6502_open_read;
+        p->write = bus6502_ignore_write;
+        p->user = NULL;
+    }
+}
+
+/*like bus6502_map_ram, but the cpu cannot write the pages (the host still can through mem)*/
+static inline void bus6502_map_rom(bus6502_t *bus, int first, int count, uint8_t *mem) {
+    int i;
+    bus6502_map_ram(bus, first, count, mem);
+    for (i = 0; i < count && first + i < 256; i++)
+        bus->page[first + i].write_ptr = NULL;
+}
+
+static inline void bus6502_map_io(bus6502_t *bus, int first, int count,
+                           bus6502_read_fn read, bus6502_write_fn write, void *user) {
+    int i;
+    for (i = 0; i < count && first + i < 256; i++) {
+        bus6502_page_t *p = &bus->page[first + i];
+        p->read_ptr = p->write_ptr = NULL;
+        p->read = read ? read : bus6502_open_read;
+        p->write = write ? write : bus6502_ignore_write;
+        p->user = user;
+    }
+}
+
+static inline uint8_t bus6502_read(const bus6502_t *bus, uint16_t address) {
+    const bus6502_page_t *p = &bus->page[address >> 8];
+    if (p->read_ptr) return p->read_ptr[address & 0xFF];
+    return p->read(p->user, address);
+}
+
+static inline void bus6502_write(bus6502_t *bus, uint16_t address, uint8_t value) {
+    bus6502_page_t *p = &bus->page[address >> 8];
+    if (p->write_ptr) p->write_ptr[address & 0xFF] = value;
+        else p->write(p->user, address, value);
+}
+
+/*the mapping behind a page, whether it is watched or not*/
+static inline const bus6502_page_t *bus6502_mapping(const bus6502_t *bus, int page) {
+    return bus->watched[page] ? &bus->mapped[page] : &bus->page[page];
+}
+
+static inline uint8_t bus6502_mapped_read(const bus6502_t *bus, uint16_t address) {
+    const bus6502_page_t *p = bus6502_mapping(bus, address >> 8);
+    if (p->read_ptr) return p->read_ptr[address & 0xFF];
+    return p->read(p->user, address);
+}
+
+static inline void bus6502_mapped_write(bus6502_t *bus, uint16_t address, uint8_t value) {
+    const bus6502_page_t *p = bus6502_mapping(bus, address >> 8);
+    if (p->write_ptr) p->write_ptr[address & 0xFF] = value;
+        else p->write(p->user, address, value);
+}
+
+/*
+	routes reads (if reads is set) and writes (if writes is set) of a page
+	through read/write. Directions that are not watched keep their direct
+	pointer; where the mapping has none (I/O pages) the handler is called
+	anyway and must forward to bus6502_mapped_read/bus6502_mapped_write.
+	Calling it again for a watched page changes what is watched.
+*/
+static inline void bus6502_watch(bus6502_t *bus, int page, int reads, int writes,
+                          bus6502_read_fn read, bus6502_write_fn write, void *user) {
+    bus6502_page_t *p = &bus->page[page];
+    if (!bus->watched[page]) {
+        bus->mapped[page] = *p;
+        bus->watched[page] = 1;
+    }
+    p->read_ptr = reads ? NULL : bus->mapped[page].read_ptr;
+    p->write_ptr = writes ? NULL : bus->mapped[page].write_ptr;
+    p->read = read;
+    p->write = write;
+    p->user = user;
+}
+
+static inline void bus6502_unwatch(bus6502_t *bus, int page) {
+    if (!bus->watched[page]) return;
+    bus->page[page] = bus->mapped[page];
+    bus->watched[page] = 0;
+}
+
+/*cpu6502_bus_t compatible callbacks, user is the bus6502_t*/
+static inline uint8_t bus6502_cpu_read(void *user, uint16_t address) {
+    return bus6502_read((const bus6502_t *)user, address);
+}
+
+static inline void bus6502_cpu_write(void *user, uint16_t address, uint8_t value) {
+    bus6502_write((bus6502_t *)user, address, value);
+}
+
+#endif
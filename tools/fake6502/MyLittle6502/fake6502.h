@@ -84,6 +84,47 @@
  *                                                   *
  * To disable the hook later, pass NULL to it.       *
  *****************************************************
+ * Instanced usage:                                  *
+ *                                                   *
+ * All of the above works on one built-in CPU. To    *
+ * run several CPUs (e.g. one per thread), give each *
+ * one its own cpu6502_t and bus callbacks:          *
+ *                                                   *
+ * void cpu6502_init(cpu6502_t *cpu,                 *
+ *                   const cpu6502_bus_t *bus)       *
+ * void cpu6502_reset(cpu6502_t *cpu)                *
+ * uint32 cpu6502_exec(cpu6502_t *cpu, uint32 ticks) *
+ * uint32 cpu6502_step(cpu6502_t *cpu)               *
+ * void cpu6502_irq(cpu6502_t *cpu)                  *
+ * void cpu6502_nmi(cpu6502_t *cpu)                  *
+ * void cpu6502_hookexternal(cpu6502_t *cpu,         *
+ *                   void (*fn)(cpu6502_t *cpu))     *
+ *                                                   *
+ * The bus user pointer is passed back to the read   *
+ * and write callbacks; the registers are plain      *
+ * fields (cpu->pc, cpu->a, cpu->clockticks6502...). *
+ * read6502()/write6502() must still be provided,    *
+ * the built-in CPU forwards its bus to them.        *
+ *****************************************************
+ * Block cache (#define FAKE6502_BLOCK_CACHE):       *
+ *                                                   *
+ * exec keeps straight-line runs of predecoded       *
+ * instructions keyed by PC, so hot loops are not    *
+ * fetched and decoded again. Allocate a             *
+ * cpu6502_blockcache_t (it is ~1.6MB), then:        *
+ *                                                   *
+ * void cpu6502_cache_attach(cpu6502_t *cpu,         *
+ *                   cpu6502_blockcache_t *cache)    *
+ * void cpu6502_cache_io_page(cache, uint8 page)     *
+ *   - never cache code there, writes end a block.   *
+ * void cpu6502_cache_invalidate(cache, ushort addr) *
+ *   - call after the host writes memory behind the  *
+ *     CPU's back (CPU writes are tracked already).  *
+ * void blockcache6502(cpu6502_blockcache_t *cache)  *
+ *   - attach to the built-in CPU.                   *
+ *                                                   *
+ * Not available together with FAKE6502_SWITCH_CORE. *
+ *****************************************************
  * Useful functions in this emulator:                *
  *                                                   *
  * void reset6502()                                  *
@@ -134,6 +175,7 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #ifdef FAKE6502_USE_STDINT
 #include <stdint.h>
 typedef uint16_t ushort;
@@ -177,22 +219,22 @@ typedef unsigned int uint32;
 
 #define BASE_STACK     0x100
 
-#define saveaccum(n) a = (uint8)((n) & 0x00FF)
+#define saveaccum(n) cpu->a = (uint8)((n) & 0x00FF)
 
 
 /*flag modifier macros*/
-#define setcarry() status |= FLAG_CARRY
-#define clearcarry() status &= (~FLAG_CARRY)
-#define setzero() status |= FLAG_ZERO
-#define clearzero() status &= (~FLAG_ZERO)
-#define setinterrupt() status |= FLAG_INTERRUPT
-#define clearinterrupt() status &= (~FLAG_INTERRUPT)
-#define setdecimal() status |= FLAG_DECIMAL
-#define cleardecimal() status &= (~FLAG_DECIMAL)
-#define setoverflow() status |= FLAG_OVERFLOW
-#define clearoverflow() status &= (~FLAG_OVERFLOW)
-#define setsign() status |= FLAG_SIGN
-#define clearsign() status &= (~FLAG_SIGN)
+#define setcarry() cpu->status |= FLAG_CARRY
+#define clearcarry() cpu->status &= (~FLAG_CARRY)
+#define setzero() cpu->status |= FLAG_ZERO
+#define clearzero() cpu->status &= (~FLAG_ZERO)
+#define setinterrupt() cpu->status |= FLAG_INTERRUPT
+#define clearinterrupt() cpu->status &= (~FLAG_INTERRUPT)
+#define setdecimal() cpu->status |= FLAG_DECIMAL
+#define cleardecimal() cpu->status &= (~FLAG_DECIMAL)
+#define setoverflow() cpu->status |= FLAG_OVERFLOW
+#define clearoverflow() cpu->status &= (~FLAG_OVERFLOW)
+#define setsign() cpu->status |= FLAG_SIGN
+#define clearsign() cpu->status &= (~FLAG_SIGN)
 
 
 /*flag calculation macros*/
@@ -217,6 +259,107 @@ typedef unsigned int uint32;
 }
 
 
+/*
+	CPU CONTEXT:
+	Every register and helper variable of one emulated 6502 lives in a cpu6502_t,
+	and memory goes through the bus callbacks stored in it, so any number of
+	CPUs can run side by side (e.g. one per thread) with no shared mutable state.
+	The tables used by the core are read-only.
+
+	The classic global API below (pc, a, x, ... exec6502(), read6502()) is kept
+	as a thin wrapper around one built-in context.
+*/
+typedef struct cpu6502 cpu6502_t;
+
+#ifdef FAKE6502_BLOCK_CACHE
+#ifdef FAKE6502_SWITCH_CORE
+#error "FAKE6502_BLOCK_CACHE runs on the table core, undefine FAKE6502_SWITCH_CORE"
+#endif
+/*
+	BLOCK CACHE:
+	a block is a run of predecoded instructions starting at one PC. It ends at
+	a branch, jump, JSR/RTS/RTI/BRK, the end of its page or CPU6502_BLOCK_MAX
+	instructions. Pages that hold cached code are flagged in code_pages; a CPU
+	write to such a page bumps page_gen[page], which makes every block on it
+	stale, and stops the block that is running. I/O pages are never cached and
+	a write to one also ends the running block, so devices see the same
+	instruction boundaries as without the cache. Cycle accounting is the same
+	ticktable plus page-crossing penalty as the uncached core.
+*/
+#ifndef CPU6502_BLOCK_MAX
+#define CPU6502_BLOCK_MAX 16
+#endif
+#ifndef CPU6502_CACHE_BLOCKS
+#define CPU6502_CACHE_BLOCKS 4096
+#endif
+
+typedef struct {
+    ushort pc, operand;
+    uint8 opcode, len;
+    void (*mode)(cpu6502_t *cpu, ushort operand);
+    void (*op)(cpu6502_t *cpu);
+} cpu6502_decoded_t;
+
+typedef struct {
+    ushort start;
+    uint8 count;
+    uint8 page[2];
+    uint32 gen[2];
+    cpu6502_decoded_t insn[CPU6502_BLOCK_MAX];
+} cpu6502_block_t;
+
+typedef struct {
+    ushort index[65536];            /*PC -> block number + 1, 0 = none*/
+    uint32 page_gen[256];
+    uint8 code_pages[32];           /*bitmap, writes here invalidate*/
+    uint8 io_pages[32];             /*bitmap, never cached*/
+    uint8 stop;
+    uint32 used;
+    uint32 built, invalidated, flushes;
+    cpu6502_block_t blocks[CPU6502_CACHE_BLOCKS];
+} cpu6502_blockcache_t;
+#endif
+
+typedef struct {
+    uint8 (*read)(void *user, ushort address);
+    void (*write)(void *user, ushort address, uint8 value);
+    void *user;
+} cpu6502_bus_t;
+
+struct cpu6502 {
+    /*6502 CPU registers*/
+    ushort pc;
+    uint8 sp, a, x, y, status;
+    /*helper variables*/
+    uint32 instructions;
+    uint32 clockticks6502;
+    uint32 clockgoal6502;
+    ushort oldpc, ea, reladdr, value, result;
+    uint8 opcode, oldstatus;
+    uint8 penaltyop, penaltyaddr;
+    /*memory bus and optional per-instruction hook*/
+    cpu6502_bus_t bus;
+    void (*loopexternal)(cpu6502_t *cpu);
+#ifdef FAKE6502_BLOCK_CACHE
+    cpu6502_blockcache_t *cache;
+#endif
+};
+
+void cpu6502_init(cpu6502_t *cpu, const cpu6502_bus_t *bus);
+void cpu6502_reset(cpu6502_t *cpu);
+void cpu6502_nmi(cpu6502_t *cpu);
+void cpu6502_irq(cpu6502_t *cpu);
+uint32 cpu6502_exec(cpu6502_t *cpu, uint32 tickcount);
+uint32 cpu6502_step(cpu6502_t *cpu);
+void cpu6502_hookexternal(cpu6502_t *cpu, void (*funcptr)(cpu6502_t *cpu));
+#ifdef FAKE6502_BLOCK_CACHE
+void cpu6502_cache_init(cpu6502_blockcache_t *cache);
+void cpu6502_cache_attach(cpu6502_t *cpu, cpu6502_blockcache_t *cache);
+void cpu6502_cache_io_page(cpu6502_blockcache_t *cache, uint8 page);
+void cpu6502_cache_invalidate(cpu6502_blockcache_t *cache, ushort address);
+#endif
+
+
 #ifdef FAKE6502_NOT_STATIC
 /*6502 CPU registers*/
 ushort pc;
@@ -234,6 +377,9 @@ void irq6502();
 uint32 exec6502(uint32 tickcount);
 uint32 step6502();
 void hookexternal(void *funcptr);
+#ifdef FAKE6502_BLOCK_CACHE
+void blockcache6502(cpu6502_blockcache_t *cache);
+#endif
 #else
 static ushort pc;
 static uint8 sp, a, x, y, status;
@@ -249,177 +395,221 @@ extern void write6502(ushort address, uint8 value);
 
 
 #ifndef FAKE6502_INCLUDE
+/*bus access for one cpu instance*/
+static inline uint8 cpu_read(cpu6502_t *cpu, ushort address) {
+    return cpu->bus.read(cpu->bus.user, address);
+}
+
+#ifdef FAKE6502_BLOCK_CACHE
+#define CACHE_BIT(map, page) ((map)[(page) >> 3] & (1 << ((page) & 7)))
+
+static inline void cache_note_write(cpu6502_blockcache_t *cache, ushort address) {
+    uint8 page = address >> 8;
+    if (CACHE_BIT(cache->code_pages, page)) {
+        cache->code_pages[page >> 3] &= ~(1 << (page & 7));
+        cache->page_gen[page]++;
+        cache->invalidated++;
+        cache->stop = 1;
+    } else if (CACHE_BIT(cache->io_pages, page)) {
+        cache->stop = 1;
+    }
+}
+#endif
+
+static inline void cpu_write(cpu6502_t *cpu, ushort address, uint8 value) {
+    cpu->bus.write(cpu->bus.user, address, value);
+#ifdef FAKE6502_BLOCK_CACHE
+    if (cpu->cache) cache_note_write(cpu->cache, address);
+#endif
+}
+
 /*a few general functions used by various other functions*/
-static void push_6502_16(ushort pushval) {
-    write6502(BASE_STACK + sp, (pushval >> 8) & 0xFF);
-    write6502(BASE_STACK + ((sp - 1) & 0xFF), pushval & 0xFF);
-    sp -= 2;
+static void push_6502_16(cpu6502_t *cpu, ushort pushval) {
+    cpu_write(cpu, BASE_STACK + cpu->sp, (pushval >> 8) & 0xFF);
+    cpu_write(cpu, BASE_STACK + ((cpu->sp - 1) & 0xFF), pushval & 0xFF);
+    cpu->sp -= 2;
 }
 
-static void push_6502_8(uint8 pushval) {
-    write6502(BASE_STACK + sp--, pushval);
+static void push_6502_8(cpu6502_t *cpu, uint8 pushval) {
+    cpu_write(cpu, BASE_STACK + cpu->sp--, pushval);
 }
 
-static ushort pull_6502_16() {
+static ushort pull_6502_16(cpu6502_t *cpu) {
     ushort temp16;
-    temp16 = read6502(BASE_STACK + ((sp + 1) & 0xFF)) | ((ushort)read6502(BASE_STACK + ((sp + 2) & 0xFF)) << 8);
-    sp += 2;
+    temp16 = cpu_read(cpu, BASE_STACK + ((cpu->sp + 1) & 0xFF)) | ((ushort)cpu_read(cpu, BASE_STACK + ((cpu->sp + 2) & 0xFF)) << 8);
+    cpu->sp += 2;
     return(temp16);
 }
 
-static uint8 pull_6502_8() {
-    return (read6502(BASE_STACK + ++sp));
+static uint8 pull_6502_8(cpu6502_t *cpu) {
+    return (cpu_read(cpu, BASE_STACK + ++cpu->sp));
 }
 
-static ushort mem_6502_read16(ushort addr) {
-    return ((ushort)read6502(addr) |
-            ((ushort)read6502(addr + 1) << 8));
+static ushort mem_6502_read16(cpu6502_t *cpu, ushort addr) {
+    return ((ushort)cpu_read(cpu, addr) |
+            ((ushort)cpu_read(cpu, addr + 1) << 8));
 }
 
-void reset6502() {
+void cpu6502_reset(cpu6502_t *cpu) {
 	/*
-	    pc = (ushort)read6502(0xFFFC) | ((ushort)read6502(0xFFFD) << 8);
-	    a = 0;
-	    x = 0;
-	    y = 0;
-	    sp = 0xFD;
-	    status |= FLAG_CONSTANT;
+	    cpu->pc = (ushort)cpu_read(cpu, 0xFFFC) | ((ushort)cpu_read(cpu, 0xFFFD) << 8);
+	    cpu->a = 0;
+	    cpu->x = 0;
+	    cpu->y = 0;
+	    cpu->sp = 0xFD;
+	    cpu->status |= FLAG_CONSTANT;
     */
-    read6502(0x00ff);
-    read6502(0x00ff);
-    read6502(0x00ff);
-    read6502(0x0100);
-    read6502(0x01ff);
-    read6502(0x01fe);
-    pc = mem_6502_read16(0xfffc);
-    sp = 0xfd;
-    status |= FLAG_CONSTANT | FLAG_INTERRUPT;
+    cpu_read(cpu, 0x00ff);
+    cpu_read(cpu, 0x00ff);
+    cpu_read(cpu, 0x00ff);
+    cpu_read(cpu, 0x0100);
+    cpu_read(cpu, 0x01ff);
+    cpu_read(cpu, 0x01fe);
+    cpu->pc = mem_6502_read16(cpu, 0xfffc);
+    cpu->sp = 0xfd;
+    cpu->status |= FLAG_CONSTANT | FLAG_INTERRUPT;
 }
 
 
-static void (*addrtable[256])();
-static void (*optable[256])();
-static uint8 penaltyop, penaltyaddr;
+#ifndef FAKE6502_SWITCH_CORE
+static void (*const addrtable[256])(cpu6502_t *cpu);
+static void (*const optable[256])(cpu6502_t *cpu);
+#endif
 
 /*addressing mode functions, calculates effective addresses*/
-static void imp() { 
+static void imp(cpu6502_t *cpu) { 
+    (void)cpu;
 }
 
 /*addressing mode functions, calculates effective addresses*/
-static void acc() { 
+static void acc(cpu6502_t *cpu) { 
+    (void)cpu;
 }
 
 /*addressing mode functions, calculates effective addresses*/
-static void imm() { 
-    ea = pc++;
+static void imm(cpu6502_t *cpu) { 
+    cpu->ea = cpu->pc++;
 }
 
-static void zp() { /*zero-page*/
-    ea = (ushort)read6502((ushort)pc++);
+static void zp(cpu6502_t *cpu) { /*zero-page*/
+    cpu->ea = (ushort)cpu_read(cpu, (ushort)cpu->pc++);
 }
 
-static void zpx() { /*zero-page,X*/
-    ea = ((ushort)read6502((ushort)pc++) + (ushort)x) & 0xFF; /*zero-page wraparound*/
+static void zpx(cpu6502_t *cpu) { /*zero-page,X*/
+    cpu->ea = ((ushort)cpu_read(cpu, (ushort)cpu->pc++) + (ushort)cpu->x) & 0xFF; /*zero-page wraparound*/
 }
 
-static void zpy() { /*zero-page,Y*/
-    ea = ((ushort)read6502((ushort)pc++) + (ushort)y) & 0xFF; /*zero-page wraparound*/
+static void zpy(cpu6502_t *cpu) { /*zero-page,Y*/
+    cpu->ea = ((ushort)cpu_read(cpu, (ushort)cpu->pc++) + (ushort)cpu->y) & 0xFF; /*zero-page wraparound*/
 }
 
-static void rel() { /*relative for branch ops (8-bit immediate value, sign-extended)*/
-    reladdr = (ushort)read6502(pc++);
-    if (reladdr & 0x80) reladdr |= 0xFF00;
+static void rel(cpu6502_t *cpu) { /*relative for branch ops (8-bit immediate value, sign-extended)*/
+    cpu->reladdr = (ushort)cpu_read(cpu, cpu->pc++);
+    if (cpu->reladdr & 0x80) cpu->reladdr |= 0xFF00;
 }
 
-static void abso() { /*absolute*/
-    ea = (ushort)read6502(pc) | ((ushort)read6502(pc+1) << 8);
-    pc += 2;
+static void abso(cpu6502_t *cpu) { /*absolute*/
+    cpu->ea = (ushort)cpu_read(cpu, cpu->pc) | ((ushort)cpu_read(cpu, cpu->pc+1) << 8);
+    cpu->pc += 2;
 }
 
-static void absx() { /*absolute,X*/
+static void absx(cpu6502_t *cpu) { /*absolute,X*/
     ushort startpage;
-    ea = ((ushort)read6502(pc) | ((ushort)read6502(pc+1) << 8));
-    startpage = ea & 0xFF00;
-    ea += (ushort)x;
+    cpu->ea = ((ushort)cpu_read(cpu, cpu->pc) | ((ushort)cpu_read(cpu, cpu->pc+1) << 8));
+    startpage = cpu->ea & 0xFF00;
+    cpu->ea += (ushort)cpu->x;
 
-    if (startpage != (ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
-        penaltyaddr = 1;
+    if (startpage != (cpu->ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
+        cpu->penaltyaddr = 1;
     }
 
-    pc += 2;
+    cpu->pc += 2;
 }
 
-static void absy() { /*absolute,Y*/
+static void absy(cpu6502_t *cpu) { /*absolute,Y*/
     ushort startpage;
-    ea = ((ushort)read6502(pc) | ((ushort)read6502(pc+1) << 8));
-    startpage = ea & 0xFF00;
-    ea += (ushort)y;
+    cpu->ea = ((ushort)cpu_read(cpu, cpu->pc) | ((ushort)cpu_read(cpu, cpu->pc+1) << 8));
+    startpage = cpu->ea & 0xFF00;
+    cpu->ea += (ushort)cpu->y;
 
-    if (startpage != (ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
-        penaltyaddr = 1;
+    if (startpage != (cpu->ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
+        cpu->penaltyaddr = 1;
     }
 
-    pc += 2;
+    cpu->pc += 2;
 }
 
-static void ind() { /*indirect*/
+static void ind(cpu6502_t *cpu) { /*indirect*/
     ushort eahelp, eahelp2;
-    eahelp = (ushort)read6502(pc) | (ushort)((ushort)read6502(pc+1) << 8);
+    eahelp = (ushort)cpu_read(cpu, cpu->pc) | (ushort)((ushort)cpu_read(cpu, cpu->pc+1) << 8);
     eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); /*replicate 6502 page-boundary wraparound bug*/
-    ea = (ushort)read6502(eahelp) | ((ushort)read6502(eahelp2) << 8);
-    pc += 2;
+    cpu->ea = (ushort)cpu_read(cpu, eahelp) | ((ushort)cpu_read(cpu, eahelp2) << 8);
+    cpu->pc += 2;
 }
 
-static void indx() { /* (indirect,X)*/
+static void indx(cpu6502_t *cpu) { /* (indirect,X)*/
     ushort eahelp;
-    eahelp = (ushort)(((ushort)read6502(pc++) + (ushort)x) & 0xFF); /*zero-page wraparound for table pointer*/
-    ea = (ushort)read6502(eahelp & 0x00FF) | ((ushort)read6502((eahelp+1) & 0x00FF) << 8);
+    eahelp = (ushort)(((ushort)cpu_read(cpu, cpu->pc++) + (ushort)cpu->x) & 0xFF); /*zero-page wraparound for table pointer*/
+    cpu->ea = (ushort)cpu_read(cpu, eahelp & 0x00FF) | ((ushort)cpu_read(cpu, (eahelp+1) & 0x00FF) << 8);
 }
 
-static void indy() { /* (indirect),Y*/
+static void indy(cpu6502_t *cpu) { /* (indirect),Y*/
     ushort eahelp, eahelp2, startpage;
-    eahelp = (ushort)read6502(pc++);
+    eahelp = (ushort)cpu_read(cpu, cpu->pc++);
     eahelp2 = (eahelp & 0xFF00) | ((eahelp + 1) & 0x00FF); /*zero-page wraparound*/
-    ea = (ushort)read6502(eahelp) | ((ushort)read6502(eahelp2) << 8);
-    startpage = ea & 0xFF00;
-    ea += (ushort)y;
+    cpu->ea = (ushort)cpu_read(cpu, eahelp) | ((ushort)cpu_read(cpu, eahelp2) << 8);
+    startpage = cpu->ea & 0xFF00;
+    cpu->ea += (ushort)cpu->y;
 
-    if (startpage != (ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
-        penaltyaddr = 1;
+    if (startpage != (cpu->ea & 0xFF00)) { /*one cycle penlty for page-crossing on some opcodes*/
+        cpu->penaltyaddr = 1;
     }
 }
 
-static ushort getvalue() {
-    if (addrtable[opcode] == acc) return((ushort)a);
-        else return((ushort)read6502(ea));
+#ifdef FAKE6502_SWITCH_CORE
+/*the switch core decodes the accumulator forms separately (see the *_acc handlers)*/
+static ushort getvalue(cpu6502_t *cpu) {
+    return((ushort)cpu_read(cpu, cpu->ea));
 }
+#else
+static ushort getvalue(cpu6502_t *cpu) {
+    if (addrtable[cpu->opcode] == acc) return((ushort)cpu->a);
+        else return((ushort)cpu_read(cpu, cpu->ea));
+}
+#endif
 
-static ushort getvalue16() {
-    return((ushort)read6502(ea) | ((ushort)read6502(ea+1) << 8));
+static ushort getvalue16(cpu6502_t *cpu) {
+    return((ushort)cpu_read(cpu, cpu->ea) | ((ushort)cpu_read(cpu, cpu->ea+1) << 8));
 }
 
-static void putvalue(ushort saveval) {
-    if (addrtable[opcode] == acc) a = (uint8)(saveval & 0x00FF);
-        else write6502(ea, (saveval & 0x00FF));
+#ifdef FAKE6502_SWITCH_CORE
+static void putvalue(cpu6502_t *cpu, ushort saveval) {
+    cpu_write(cpu, cpu->ea, (saveval & 0x00FF));
+}
+#else
+static void putvalue(cpu6502_t *cpu, ushort saveval) {
+    if (addrtable[cpu->opcode] == acc) cpu->a = (uint8)(saveval & 0x00FF);
+        else cpu_write(cpu, cpu->ea, (saveval & 0x00FF));
 }
+#endif
 
 
 /*instruction handler functions*/
-static void adc() {
-    penaltyop = 1;
+static void adc(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
 #ifndef NES_CPU
-    if (status & FLAG_DECIMAL) {
+    if (cpu->status & FLAG_DECIMAL) {
         ushort AL, A, result_dec;
-        A = a;
-        value = getvalue();
-        result_dec = (ushort)A + value + (ushort)(status & FLAG_CARRY); /*dec*/
+        A = cpu->a;
+        cpu->value = getvalue(cpu);
+        result_dec = (ushort)A + cpu->value + (ushort)(cpu->status & FLAG_CARRY); /*dec*/
         
-        AL = (A & 0x0F) + (value & 0x0F) + (ushort)(status & FLAG_CARRY);  /*SEQ 1A OR 2A*/
+        AL = (A & 0x0F) + (cpu->value & 0x0F) + (ushort)(cpu->status & FLAG_CARRY);  /*SEQ 1A OR 2A*/
         if(AL >= 0xA) AL = ((AL + 0x06) & 0x0F) + 0x10; /*SEQ 1B OR SEQ 2B*/
-        A = (A & 0xF0) + (value & 0xF0) + AL; /*SEQ2C OR SEQ 1C*/
+        A = (A & 0xF0) + (cpu->value & 0xF0) + AL; /*SEQ2C OR SEQ 1C*/
         if(A & 0x80) setsign(); else clearsign(); /*SEQ 2E it says "bit 7"*/
         if(A >= 0xA0) A += 0x60; /*SEQ 1E*/
-        result = A; /*1F*/
+        cpu->result = A; /*1F*/
         if(A & 0xff80) setoverflow();else clearoverflow();
         if(A >= 0x100) setcarry(); else clearcarry(); /*SEQ 1G*/
 		
@@ -427,372 +617,372 @@ static void adc() {
     } else 
 #endif
     {
-        value = getvalue();
-        result = (ushort)a + value + (ushort)(status & FLAG_CARRY);
-        carrycalc(result);
-        zerocalc(result);
-        overflowcalc(result, a, value);
-        signcalc(result);
+        cpu->value = getvalue(cpu);
+        cpu->result = (ushort)cpu->a + cpu->value + (ushort)(cpu->status & FLAG_CARRY);
+        carrycalc(cpu->result);
+        zerocalc(cpu->result);
+        overflowcalc(cpu->result, cpu->a, cpu->value);
+        signcalc(cpu->result);
     }
-    saveaccum(result);
+    saveaccum(cpu->result);
 }
 
-static void and() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (ushort)a & value;
+static void and(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->a & cpu->value;
    
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    saveaccum(result);
+    saveaccum(cpu->result);
 }
 
-static void asl() {
-    value = getvalue();
-    result = value << 1;
+static void asl(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = cpu->value << 1;
 
-    carrycalc(result);
-    zerocalc(result);
-    signcalc(result);
+    carrycalc(cpu->result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void bcc() {
-    if ((status & FLAG_CARRY) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bcc(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_CARRY) == 0) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void bcs() {
-    if ((status & FLAG_CARRY) == FLAG_CARRY) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bcs(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_CARRY) == FLAG_CARRY) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void beq() {
-    if ((status & FLAG_ZERO) == FLAG_ZERO) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void beq(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_ZERO) == FLAG_ZERO) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void bit() {
-    value = getvalue();
-    result = (ushort)a & value;
+static void bit(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->a & cpu->value;
    
-    zerocalc(result);
-    status = (status & 0x3F) | (uint8)(value & 0xC0);
+    zerocalc(cpu->result);
+    cpu->status = (cpu->status & 0x3F) | (uint8)(cpu->value & 0xC0);
 }
 
-static void bmi() {
-    if ((status & FLAG_SIGN) == FLAG_SIGN) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bmi(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_SIGN) == FLAG_SIGN) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void bne() {
-    if ((status & FLAG_ZERO) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bne(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_ZERO) == 0) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void bpl() {
-    if ((status & FLAG_SIGN) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bpl(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_SIGN) == 0) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void brk_6502() {
-    pc++;
-    push_6502_16(pc); 
-    push_6502_8(status | FLAG_BREAK); 
+static void brk_6502(cpu6502_t *cpu) {
+    cpu->pc++;
+    push_6502_16(cpu, cpu->pc); 
+    push_6502_8(cpu, cpu->status | FLAG_BREAK); 
     setinterrupt();
-    pc = (ushort)read6502(0xFFFE) | ((ushort)read6502(0xFFFF) << 8);
+    cpu->pc = (ushort)cpu_read(cpu, 0xFFFE) | ((ushort)cpu_read(cpu, 0xFFFF) << 8);
 }
 
-static void bvc() {
-    if ((status & FLAG_OVERFLOW) == 0) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bvc(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_OVERFLOW) == 0) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void bvs() {
-    if ((status & FLAG_OVERFLOW) == FLAG_OVERFLOW) {
-        oldpc = pc;
-        pc += reladdr;
-        if ((oldpc & 0xFF00) != (pc & 0xFF00)) clockticks6502 += 2; /*check if jump crossed a page boundary*/
-            else clockticks6502++;
+static void bvs(cpu6502_t *cpu) {
+    if ((cpu->status & FLAG_OVERFLOW) == FLAG_OVERFLOW) {
+        cpu->oldpc = cpu->pc;
+        cpu->pc += cpu->reladdr;
+        if ((cpu->oldpc & 0xFF00) != (cpu->pc & 0xFF00)) cpu->clockticks6502 += 2; /*check if jump crossed a page boundary*/
+            else cpu->clockticks6502++;
     }
 }
 
-static void clc() {
+static void clc(cpu6502_t *cpu) {
     clearcarry();
 }
 
-static void cld() {
+static void cld(cpu6502_t *cpu) {
     cleardecimal();
 }
 
-static void cli() {
+static void cli(cpu6502_t *cpu) {
     clearinterrupt();
 }
 
-static void clv() {
+static void clv(cpu6502_t *cpu) {
     clearoverflow();
 }
 
-static void cmp() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (ushort)a - value;
+static void cmp(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->a - cpu->value;
    
-    if (a >= (uint8)(value & 0x00FF)) setcarry();
+    if (cpu->a >= (uint8)(cpu->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (a == (uint8)(value & 0x00FF)) setzero();
+    if (cpu->a == (uint8)(cpu->value & 0x00FF)) setzero();
         else clearzero();
-    signcalc(result);
+    signcalc(cpu->result);
 }
 
-static void cpx() {
-    value = getvalue();
-    result = (ushort)x - value;
+static void cpx(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->x - cpu->value;
    
-    if (x >= (uint8)(value & 0x00FF)) setcarry();
+    if (cpu->x >= (uint8)(cpu->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (x == (uint8)(value & 0x00FF)) setzero();
+    if (cpu->x == (uint8)(cpu->value & 0x00FF)) setzero();
         else clearzero();
-    signcalc(result);
+    signcalc(cpu->result);
 }
 
-static void cpy() {
-    value = getvalue();
-    result = (ushort)y - value;
+static void cpy(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->y - cpu->value;
    
-    if (y >= (uint8)(value & 0x00FF)) setcarry();
+    if (cpu->y >= (uint8)(cpu->value & 0x00FF)) setcarry();
         else clearcarry();
-    if (y == (uint8)(value & 0x00FF)) setzero();
+    if (cpu->y == (uint8)(cpu->value & 0x00FF)) setzero();
         else clearzero();
-    signcalc(result);
+    signcalc(cpu->result);
 }
 
-static void dec() {
-    value = getvalue();
-    result = value - 1;
+static void dec(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = cpu->value - 1;
    
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void dex() {
-    x--;
+static void dex(cpu6502_t *cpu) {
+    cpu->x--;
    
-    zerocalc(x);
-    signcalc(x);
+    zerocalc(cpu->x);
+    signcalc(cpu->x);
 }
 
-static void dey() {
-    y--;
+static void dey(cpu6502_t *cpu) {
+    cpu->y--;
    
-    zerocalc(y);
-    signcalc(y);
+    zerocalc(cpu->y);
+    signcalc(cpu->y);
 }
 
-static void eor() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (ushort)a ^ value;
+static void eor(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->a ^ cpu->value;
    
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    saveaccum(result);
+    saveaccum(cpu->result);
 }
 
-static void inc() {
-    value = getvalue();
-    result = value + 1;
+static void inc(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = cpu->value + 1;
    
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void inx() {
-    x++;
+static void inx(cpu6502_t *cpu) {
+    cpu->x++;
    
-    zerocalc(x);
-    signcalc(x);
+    zerocalc(cpu->x);
+    signcalc(cpu->x);
 }
 
-static void iny() {
-    y++;
+static void iny(cpu6502_t *cpu) {
+    cpu->y++;
    
-    zerocalc(y);
-    signcalc(y);
+    zerocalc(cpu->y);
+    signcalc(cpu->y);
 }
 
-static void jmp() {
-    pc = ea;
+static void jmp(cpu6502_t *cpu) {
+    cpu->pc = cpu->ea;
 }
 
-static void jsr() {
-    push_6502_16(pc - 1);
-    pc = ea;
+static void jsr(cpu6502_t *cpu) {
+    push_6502_16(cpu, cpu->pc - 1);
+    cpu->pc = cpu->ea;
 }
 
-static void lda() {
-    penaltyop = 1;
-    value = getvalue();
-    a = (uint8)(value & 0x00FF);
+static void lda(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->a = (uint8)(cpu->value & 0x00FF);
    
-    zerocalc(a);
-    signcalc(a);
+    zerocalc(cpu->a);
+    signcalc(cpu->a);
 }
 
-static void ldx() {
-    penaltyop = 1;
-    value = getvalue();
-    x = (uint8)(value & 0x00FF);
+static void ldx(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->x = (uint8)(cpu->value & 0x00FF);
    
-    zerocalc(x);
-    signcalc(x);
+    zerocalc(cpu->x);
+    signcalc(cpu->x);
 }
 
-static void ldy() {
-    penaltyop = 1;
-    value = getvalue();
-    y = (uint8)(value & 0x00FF);
+static void ldy(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->y = (uint8)(cpu->value & 0x00FF);
    
-    zerocalc(y);
-    signcalc(y);
+    zerocalc(cpu->y);
+    signcalc(cpu->y);
 }
 
-static void lsr() {
-    value = getvalue();
-    result = value >> 1;
+static void lsr(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = cpu->value >> 1;
    
-    if (value & 1) setcarry();
+    if (cpu->value & 1) setcarry();
         else clearcarry();
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void nop() {
-    switch (opcode) {
+static void nop(cpu6502_t *cpu) {
+    switch (cpu->opcode) {
         case 0x1C:
         case 0x3C:
         case 0x5C:
         case 0x7C:
         case 0xDC:
         case 0xFC:
-            penaltyop = 1;
+            cpu->penaltyop = 1;
             break;
     }
 }
 
-static void ora() {
-    penaltyop = 1;
-    value = getvalue();
-    result = (ushort)a | value;
+static void ora(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
+    cpu->value = getvalue(cpu);
+    cpu->result = (ushort)cpu->a | cpu->value;
    
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    saveaccum(result);
+    saveaccum(cpu->result);
 }
 
-static void pha() {
-    push_6502_8(a);
+static void pha(cpu6502_t *cpu) {
+    push_6502_8(cpu, cpu->a);
 }
 
-static void php() {
-    push_6502_8(status | FLAG_BREAK);
+static void php(cpu6502_t *cpu) {
+    push_6502_8(cpu, cpu->status | FLAG_BREAK);
 }
 
-static void pla() {
-    a = pull_6502_8();
+static void pla(cpu6502_t *cpu) {
+    cpu->a = pull_6502_8(cpu);
    
-    zerocalc(a);
-    signcalc(a);
+    zerocalc(cpu->a);
+    signcalc(cpu->a);
 }
 
-static void plp() {
-    status = pull_6502_8() | FLAG_CONSTANT;
+static void plp(cpu6502_t *cpu) {
+    cpu->status = pull_6502_8(cpu) | FLAG_CONSTANT;
 }
 
-static void rol() {
-    value = getvalue();
-    result = (value << 1) | (status & FLAG_CARRY);
+static void rol(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = (cpu->value << 1) | (cpu->status & FLAG_CARRY);
    
-    carrycalc(result);
-    zerocalc(result);
-    signcalc(result);
+    carrycalc(cpu->result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void ror() {
-    value = getvalue();
-    result = (value >> 1) | ((status & FLAG_CARRY) << 7);
+static void ror(cpu6502_t *cpu) {
+    cpu->value = getvalue(cpu);
+    cpu->result = (cpu->value >> 1) | ((cpu->status & FLAG_CARRY) << 7);
    
-    if (value & 1) setcarry();
+    if (cpu->value & 1) setcarry();
         else clearcarry();
-    zerocalc(result);
-    signcalc(result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
    
-    putvalue(result);
+    putvalue(cpu, cpu->result);
 }
 
-static void rti() {
-    status = pull_6502_8();
-    value = pull_6502_16();
-    pc = value;
+static void rti(cpu6502_t *cpu) {
+    cpu->status = pull_6502_8(cpu);
+    cpu->value = pull_6502_16(cpu);
+    cpu->pc = cpu->value;
 }
 
-static void rts() {
-    value = pull_6502_16();
-    pc = value + 1;
+static void rts(cpu6502_t *cpu) {
+    cpu->value = pull_6502_16(cpu);
+    cpu->pc = cpu->value + 1;
 }
 
-static void sbc() {
-    penaltyop = 1;
+static void sbc(cpu6502_t *cpu) {
+    cpu->penaltyop = 1;
 #ifndef NES_CPU
-    if (status & FLAG_DECIMAL) {
+    if (cpu->status & FLAG_DECIMAL) {
     	ushort result_dec, A, AL, B, C;
-    	A = a;
-    	C = (ushort)(status & FLAG_CARRY);
-     	value = getvalue();B = value;value = value ^ 0x00FF;
-    	result_dec = (ushort)a + value + (ushort)(status & FLAG_CARRY); /*dec*/
+    	A = cpu->a;
+    	C = (ushort)(cpu->status & FLAG_CARRY);
+     	cpu->value = getvalue(cpu);B = cpu->value;cpu->value = cpu->value ^ 0x00FF;
+    	result_dec = (ushort)cpu->a + cpu->value + (ushort)(cpu->status & FLAG_CARRY); /*dec*/
 		/*Both Cmos and Nmos*/
     	carrycalc(result_dec); 
-    	overflowcalc(result_dec, a, value); 
+    	overflowcalc(result_dec, cpu->a, cpu->value); 
     	/*NMOS ONLY*/
     	signcalc(result_dec);
     	zerocalc(result_dec);
@@ -801,132 +991,181 @@ static void sbc() {
     	if(AL & 0x8000)  AL =  ((AL - 0x06) & 0x0F) - 0x10; /*3b*/
     	A = (A & 0xF0) - (B & 0xF0) + AL; /*3c*/
     	if(A & 0x8000) A = A - 0x60; /*3d*/
-    	result = A; /*3e*/
+    	cpu->result = A; /*3e*/
     } else 
 #endif
     {
-        value = getvalue() ^ 0x00FF;
-        result = (ushort)a + value + (ushort)(status & FLAG_CARRY);
+        cpu->value = getvalue(cpu) ^ 0x00FF;
+        cpu->result = (ushort)cpu->a + cpu->value + (ushort)(cpu->status & FLAG_CARRY);
 	
-        carrycalc(result);
-        zerocalc(result);
-        overflowcalc(result, a, value);
-        signcalc(result);
+        carrycalc(cpu->result);
+        zerocalc(cpu->result);
+        overflowcalc(cpu->result, cpu->a, cpu->value);
+        signcalc(cpu->result);
     }
-    saveaccum(result);
+    saveaccum(cpu->result);
 }
 
-static void sec() {
+static void sec(cpu6502_t *cpu) {
     setcarry();
 }
 
-static void sed() {
+static void sed(cpu6502_t *cpu) {
     setdecimal();
 }
 
-static void sei() {
+static void sei(cpu6502_t *cpu) {
     setinterrupt();
 }
 
-static void sta() {
-    putvalue(a);
+static void sta(cpu6502_t *cpu) {
+    putvalue(cpu, cpu->a);
 }
 
-static void stx() {
-    putvalue(x);
+static void stx(cpu6502_t *cpu) {
+    putvalue(cpu, cpu->x);
 }
 
-static void sty() {
-    putvalue(y);
+static void sty(cpu6502_t *cpu) {
+    putvalue(cpu, cpu->y);
 }
 
-static void tax() {
-    x = a;
+static void tax(cpu6502_t *cpu) {
+    cpu->x = cpu->a;
    
-    zerocalc(x);
-    signcalc(x);
+    zerocalc(cpu->x);
+    signcalc(cpu->x);
 }
 
-static void tay() {
-    y = a;
+static void tay(cpu6502_t *cpu) {
+    cpu->y = cpu->a;
    
-    zerocalc(y);
-    signcalc(y);
+    zerocalc(cpu->y);
+    signcalc(cpu->y);
 }
 
-static void tsx() {
-    x = sp;
+static void tsx(cpu6502_t *cpu) {
+    cpu->x = cpu->sp;
    
-    zerocalc(x);
-    signcalc(x);
+    zerocalc(cpu->x);
+    signcalc(cpu->x);
 }
 
-static void txa() {
-    a = x;
+static void txa(cpu6502_t *cpu) {
+    cpu->a = cpu->x;
    
-    zerocalc(a);
-    signcalc(a);
+    zerocalc(cpu->a);
+    signcalc(cpu->a);
 }
 
-static void txs() {
-    sp = x;
+static void txs(cpu6502_t *cpu) {
+    cpu->sp = cpu->x;
 }
 
-static void tya() {
-    a = y;
+static void tya(cpu6502_t *cpu) {
+    cpu->a = cpu->y;
    
-    zerocalc(a);
-    signcalc(a);
+    zerocalc(cpu->a);
+    signcalc(cpu->a);
+}
+
+#ifdef FAKE6502_SWITCH_CORE
+/*accumulator forms of the shift/rotate ops, used by the switch core*/
+static void asl_acc(cpu6502_t *cpu) {
+    cpu->value = cpu->a;
+    cpu->result = cpu->value << 1;
+
+    carrycalc(cpu->result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
+
+    saveaccum(cpu->result);
+}
+
+static void lsr_acc(cpu6502_t *cpu) {
+    cpu->value = cpu->a;
+    cpu->result = cpu->value >> 1;
+
+    if (cpu->value & 1) setcarry();
+        else clearcarry();
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
+
+    saveaccum(cpu->result);
+}
+
+static void rol_acc(cpu6502_t *cpu) {
+    cpu->value = cpu->a;
+    cpu->result = (cpu->value << 1) | (cpu->status & FLAG_CARRY);
+
+    carrycalc(cpu->result);
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
+
+    saveaccum(cpu->result);
+}
+
+static void ror_acc(cpu6502_t *cpu) {
+    cpu->value = cpu->a;
+    cpu->result = (cpu->value >> 1) | ((cpu->status & FLAG_CARRY) << 7);
+
+    if (cpu->value & 1) setcarry();
+        else clearcarry();
+    zerocalc(cpu->result);
+    signcalc(cpu->result);
+
+    saveaccum(cpu->result);
 }
+#endif
 
 /*undocumented instructions~~~~~~~~~~~~~~~~~~~~~~~~~*/
 #ifdef UNDOCUMENTED
-    static void lax() {
-        lda();
-        ldx();
+    static void lax(cpu6502_t *cpu) {
+        lda(cpu);
+        ldx(cpu);
     }
 
-    static void sax() {
-        sta();
-        stx();
-        putvalue(a & x);
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void sax(cpu6502_t *cpu) {
+        sta(cpu);
+        stx(cpu);
+        putvalue(cpu, cpu->a & cpu->x);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void dcp() {
-        dec();
-        cmp();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void dcp(cpu6502_t *cpu) {
+        dec(cpu);
+        cmp(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void isb() {
-        inc();
-        sbc();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void isb(cpu6502_t *cpu) {
+        inc(cpu);
+        sbc(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void slo() {
-        asl();
-        ora();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void slo(cpu6502_t *cpu) {
+        asl(cpu);
+        ora(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void rla() {
-        rol();
-        and();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void rla(cpu6502_t *cpu) {
+        rol(cpu);
+        and(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void sre() {
-        lsr();
-        eor();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void sre(cpu6502_t *cpu) {
+        lsr(cpu);
+        eor(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 
-    static void rra() {
-        ror();
-        adc();
-        if (penaltyop && penaltyaddr) clockticks6502--;
+    static void rra(cpu6502_t *cpu) {
+        ror(cpu);
+        adc(cpu);
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502--;
     }
 #else
     #define lax nop
@@ -940,7 +1179,8 @@ static void tya() {
 #endif
 
 
-static void (*addrtable[256])() = {
+#ifndef FAKE6502_SWITCH_CORE
+static void (*const addrtable[256])(cpu6502_t *cpu) = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |     */
 /* 0 */     imp, indx,  imp, indx,   zp,   zp,   zp,   zp,  imp,  imm,  acc,  imm, abso, abso, abso, abso, /* 0 */
 /* 1 */     rel, indy,  imp, indy,  zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absy, absx, absx, absx, absx, /* 1 */
@@ -960,7 +1200,7 @@ static void (*addrtable[256])() = {
 /* F */     rel, indy,  imp, indy,  zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absy, absx, absx, absx, absx  /* F */
 };
 
-static void (*optable[256])() = {
+static void (*const optable[256])(cpu6502_t *cpu) = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |      */
 /* 0 */      brk_6502,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  php,  ora,  asl,  nop,  nop,  ora,  asl,  slo, /* 0 */
 /* 1 */      bpl,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  clc,  ora,  nop,  slo,  nop,  ora,  asl,  slo, /* 1 */
@@ -979,6 +1219,7 @@ static void (*optable[256])() = {
 /* E */      cpx,  sbc,  nop,  isb,  cpx,  sbc,  inc,  isb,  inx,  sbc,  nop,  sbc,  cpx,  sbc,  inc,  isb, /* E */
 /* F */      beq,  sbc,  nop,  isb,  nop,  sbc,  inc,  isb,  sed,  sbc,  nop,  isb,  nop,  sbc,  inc,  isb  /* F */
 };
+#endif
 
 static const uint32 ticktable[256] = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |     */
@@ -1001,33 +1242,536 @@ static const uint32 ticktable[256] = {
 };
 
 
-void nmi6502() {
-    push_6502_16(pc);
-    push_6502_8(status  & ~FLAG_BREAK);
-    status |= FLAG_INTERRUPT;
-    pc = (ushort)read6502(0xFFFA) | ((ushort)read6502(0xFFFB) << 8);
+void cpu6502_nmi(cpu6502_t *cpu) {
+    push_6502_16(cpu, cpu->pc);
+    push_6502_8(cpu, cpu->status  & ~FLAG_BREAK);
+    cpu->status |= FLAG_INTERRUPT;
+    cpu->pc = (ushort)cpu_read(cpu, 0xFFFA) | ((ushort)cpu_read(cpu, 0xFFFB) << 8);
 }
 
-void irq6502() {
+void cpu6502_irq(cpu6502_t *cpu) {
 	/*
-    push_6502_16(pc);
-    push_6502_8(status);
-    status |= FLAG_INTERRUPT;
-    pc = (ushort)read6502(0xFFFE) | ((ushort)read6502(0xFFFF) << 8);
+    push_6502_16(cpu, cpu->pc);
+    push_6502_8(cpu, cpu->status);
+    cpu->status |= FLAG_INTERRUPT;
+    cpu->pc = (ushort)cpu_read(cpu, 0xFFFE) | ((ushort)cpu_read(cpu, 0xFFFF) << 8);
     */
-	if ((status & FLAG_INTERRUPT) == 0) {
-		push_6502_16(pc);
-		push_6502_8(status & ~FLAG_BREAK);
-		status |= FLAG_INTERRUPT;
-		/*pc = mem_6502_read16(0xfffe);*/
-		pc = (ushort)read6502(0xFFFE) | ((ushort)read6502(0xFFFF) << 8);
+	if ((cpu->status & FLAG_INTERRUPT) == 0) {
+		push_6502_16(cpu, cpu->pc);
+		push_6502_8(cpu, cpu->status & ~FLAG_BREAK);
+		cpu->status |= FLAG_INTERRUPT;
+		/*cpu->pc = mem_6502_read16(cpu, 0xfffe);*/
+		cpu->pc = (ushort)cpu_read(cpu, 0xFFFE) | ((ushort)cpu_read(cpu, 0xFFFF) << 8);
 	}
 }
 
-uint8 callexternal = 0;
-void (*loopexternal)();
+#ifdef FAKE6502_SWITCH_CORE
+/*
+	SWITCH CORE:
+	addressing mode and operation are fused into one case per opcode, so an
+	instruction costs a single jump-table dispatch instead of two indirect
+	calls, and the handlers can be inlined into it. Cycle accounting is the
+	same as the table core: ticktable plus the page-crossing penalty.
+*/
+static void cpu6502_dispatch(cpu6502_t *cpu) {
+    cpu->opcode = cpu_read(cpu, cpu->pc++);
+    cpu->status |= FLAG_CONSTANT;
+    cpu->penaltyop = 0;
+    cpu->penaltyaddr = 0;
+    switch (cpu->opcode) {
+        case 0x00: imp(cpu); brk_6502(cpu); break;
+        case 0x01: indx(cpu); ora(cpu); break;
+        case 0x02: imp(cpu); nop(cpu); break;
+        case 0x03: indx(cpu); slo(cpu); break;
+        case 0x04: zp(cpu); nop(cpu); break;
+        case 0x05: zp(cpu); ora(cpu); break;
+        case 0x06: zp(cpu); asl(cpu); break;
+        case 0x07: zp(cpu); slo(cpu); break;
+        case 0x08: imp(cpu); php(cpu); break;
+        case 0x09: imm(cpu); ora(cpu); break;
+        case 0x0A: acc(cpu); asl_acc(cpu); break;
+        case 0x0B: imm(cpu); nop(cpu); break;
+        case 0x0C: abso(cpu); nop(cpu); break;
+        case 0x0D: abso(cpu); ora(cpu); break;
+        case 0x0E: abso(cpu); asl(cpu); break;
+        case 0x0F: abso(cpu); slo(cpu); break;
+        case 0x10: rel(cpu); bpl(cpu); break;
+        case 0x11: indy(cpu); ora(cpu); break;
+        case 0x12: imp(cpu); nop(cpu); break;
+        case 0x13: indy(cpu); slo(cpu); break;
+        case 0x14: zpx(cpu); nop(cpu); break;
+        case 0x15: zpx(cpu); ora(cpu); break;
+        case 0x16: zpx(cpu); asl(cpu); break;
+        case 0x17: zpx(cpu); slo(cpu); break;
+        case 0x18: imp(cpu); clc(cpu); break;
+        case 0x19: absy(cpu); ora(cpu); break;
+        case 0x1A: imp(cpu); nop(cpu); break;
+        case 0x1B: absy(cpu); slo(cpu); break;
+        case 0x1C: absx(cpu); nop(cpu); break;
+        case 0x1D: absx(cpu); ora(cpu); break;
+        case 0x1E: absx(cpu); asl(cpu); break;
+        case 0x1F: absx(cpu); slo(cpu); break;
+        case 0x20: abso(cpu); jsr(cpu); break;
+        case 0x21: indx(cpu); and(cpu); break;
+        case 0x22: imp(cpu); nop(cpu); break;
+        case 0x23: indx(cpu); rla(cpu); break;
+        case 0x24: zp(cpu); bit(cpu); break;
+        case 0x25: zp(cpu); and(cpu); break;
+        case 0x26: zp(cpu); rol(cpu); break;
+        case 0x27: zp(cpu); rla(cpu); break;
+        case 0x28: imp(cpu); plp(cpu); break;
+        case 0x29: imm(cpu); and(cpu); break;
+        case 0x2A: acc(cpu); rol_acc(cpu); break;
+        case 0x2B: imm(cpu); nop(cpu); break;
+        case 0x2C: abso(cpu); bit(cpu); break;
+        case 0x2D: abso(cpu); and(cpu); break;
+        case 0x2E: abso(cpu); rol(cpu); break;
+        case 0x2F: abso(cpu); rla(cpu); break;
+        case 0x30: rel(cpu); bmi(cpu); break;
+        case 0x31: indy(cpu); and(cpu); break;
+        case 0x32: imp(cpu); nop(cpu); break;
+        case 0x33: indy(cpu); rla(cpu); break;
+        case 0x34: zpx(cpu); nop(cpu); break;
+        case 0x35: zpx(cpu); and(cpu); break;
+        case 0x36: zpx(cpu); rol(cpu); break;
+        case 0x37: zpx(cpu); rla(cpu); break;
+        case 0x38: imp(cpu); sec(cpu); break;
+        case 0x39: absy(cpu); and(cpu); break;
+        case 0x3A: imp(cpu); nop(cpu); break;
+        case 0x3B: absy(cpu); rla(cpu); break;
+        case 0x3C: absx(cpu); nop(cpu); break;
+        case 0x3D: absx(cpu); and(cpu); break;
+        case 0x3E: absx(cpu); rol(cpu); break;
+        case 0x3F: absx(cpu); rla(cpu); break;
+        case 0x40: imp(cpu); rti(cpu); break;
+        case 0x41: indx(cpu); eor(cpu); break;
+        case 0x42: imp(cpu); nop(cpu); break;
+        case 0x43: indx(cpu); sre(cpu); break;
+        case 0x44: zp(cpu); nop(cpu); break;
+        case 0x45: zp(cpu); eor(cpu); break;
+        case 0x46: zp(cpu); lsr(cpu); break;
+        case 0x47: zp(cpu); sre(cpu); break;
+        case 0x48: imp(cpu); pha(cpu); break;
+        case 0x49: imm(cpu); eor(cpu); break;
+        case 0x4A: acc(cpu); lsr_acc(cpu); break;
+        case 0x4B: imm(cpu); nop(cpu); break;
+        case 0x4C: abso(cpu); jmp(cpu); break;
+        case 0x4D: abso(cpu); eor(cpu); break;
+        case 0x4E: abso(cpu); lsr(cpu); break;
+        case 0x4F: abso(cpu); sre(cpu); break;
+        case 0x50: rel(cpu); bvc(cpu); break;
+        case 0x51: indy(cpu); eor(cpu); break;
+        case 0x52: imp(cpu); nop(cpu); break;
+        case 0x53: indy(cpu); sre(cpu); break;
+        case 0x54: zpx(cpu); nop(cpu); break;
+        case 0x55: zpx(cpu); eor(cpu); break;
+        case 0x56: zpx(cpu); lsr(cpu); break;
+        case 0x57: zpx(cpu); sre(cpu); break;
+        case 0x58: imp(cpu); cli(cpu); break;
+        case 0x59: absy(cpu); eor(cpu); break;
+        case 0x5A: imp(cpu); nop(cpu); break;
+        case 0x5B: absy(cpu); sre(cpu); break;
+        case 0x5C: absx(cpu); nop(cpu); break;
+        case 0x5D: absx(cpu); eor(cpu); break;
+        case 0x5E: absx(cpu); lsr(cpu); break;
+        case 0x5F: absx(cpu); sre(cpu); break;
+        case 0x60: imp(cpu); rts(cpu); break;
+        case 0x61: indx(cpu); adc(cpu); break;
+        case 0x62: imp(cpu); nop(cpu); break;
+        case 0x63: indx(cpu); rra(cpu); break;
+        case 0x64: zp(cpu); nop(cpu); break;
+        case 0x65: zp(cpu); adc(cpu); break;
+        case 0x66: zp(cpu); ror(cpu); break;
+        case 0x67: zp(cpu); rra(cpu); break;
+        case 0x68: imp(cpu); pla(cpu); break;
+        case 0x69: imm(cpu); adc(cpu); break;
+        case 0x6A: acc(cpu); ror_acc(cpu); break;
+        case 0x6B: imm(cpu); nop(cpu); break;
+        case 0x6C: ind(cpu); jmp(cpu); break;
+        case 0x6D: abso(cpu); adc(cpu); break;
+        case 0x6E: abso(cpu); ror(cpu); break;
+        case 0x6F: abso(cpu); rra(cpu); break;
+        case 0x70: rel(cpu); bvs(cpu); break;
+        case 0x71: indy(cpu); adc(cpu); break;
+        case 0x72: imp(cpu); nop(cpu); break;
+        case 0x73: indy(cpu); rra(cpu); break;
+        case 0x74: zpx(cpu); nop(cpu); break;
+        case 0x75: zpx(cpu); adc(cpu); break;
+        case 0x76: zpx(cpu); ror(cpu); break;
+        case 0x77: zpx(cpu); rra(cpu); break;
+        case 0x78: imp(cpu); sei(cpu); break;
+        case 0x79: absy(cpu); adc(cpu); break;
+        case 0x7A: imp(cpu); nop(cpu); break;
+        case 0x7B: absy(cpu); rra(cpu); break;
+        case 0x7C: absx(cpu); nop(cpu); break;
+        case 0x7D: absx(cpu); adc(cpu); break;
+        case 0x7E: absx(cpu); ror(cpu); break;
+        case 0x7F: absx(cpu); rra(cpu); break;
+        case 0x80: imm(cpu); nop(cpu); break;
+        case 0x81: indx(cpu); sta(cpu); break;
+        case 0x82: imm(cpu); nop(cpu); break;
+        case 0x83: indx(cpu); sax(cpu); break;
+        case 0x84: zp(cpu); sty(cpu); break;
+        case 0x85: zp(cpu); sta(cpu); break;
+        case 0x86: zp(cpu); stx(cpu); break;
+        case 0x87: zp(cpu); sax(cpu); break;
+        case 0x88: imp(cpu); dey(cpu); break;
+        case 0x89: imm(cpu); nop(cpu); break;
+        case 0x8A: imp(cpu); txa(cpu); break;
+        case 0x8B: imm(cpu); nop(cpu); break;
+        case 0x8C: abso(cpu); sty(cpu); break;
+        case 0x8D: abso(cpu); sta(cpu); break;
+        case 0x8E: abso(cpu); stx(cpu); break;
+        case 0x8F: abso(cpu); sax(cpu); break;
+        case 0x90: rel(cpu); bcc(cpu); break;
+        case 0x91: indy(cpu); sta(cpu); break;
+        case 0x92: imp(cpu); nop(cpu); break;
+        case 0x93: indy(cpu); nop(cpu); break;
+        case 0x94: zpx(cpu); sty(cpu); break;
+        case 0x95: zpx(cpu); sta(cpu); break;
+        case 0x96: zpy(cpu); stx(cpu); break;
+        case 0x97: zpy(cpu); sax(cpu); break;
+        case 0x98: imp(cpu); tya(cpu); break;
+        case 0x99: absy(cpu); sta(cpu); break;
+        case 0x9A: imp(cpu); txs(cpu); break;
+        case 0x9B: absy(cpu); nop(cpu); break;
+        case 0x9C: absx(cpu); nop(cpu); break;
+        case 0x9D: absx(cpu); sta(cpu); break;
+        case 0x9E: absy(cpu); nop(cpu); break;
+        case 0x9F: absy(cpu); nop(cpu); break;
+        case 0xA0: imm(cpu); ldy(cpu); break;
+        case 0xA1: indx(cpu); lda(cpu); break;
+        case 0xA2: imm(cpu); ldx(cpu); break;
+        case 0xA3: indx(cpu); lax(cpu); break;
+        case 0xA4: zp(cpu); ldy(cpu); break;
+        case 0xA5: zp(cpu); lda(cpu); break;
+        case 0xA6: zp(cpu); ldx(cpu); break;
+        case 0xA7: zp(cpu); lax(cpu); break;
+        case 0xA8: imp(cpu); tay(cpu); break;
+        case 0xA9: imm(cpu); lda(cpu); break;
+        case 0xAA: imp(cpu); tax(cpu); break;
+        case 0xAB: imm(cpu); nop(cpu); break;
+        case 0xAC: abso(cpu); ldy(cpu); break;
+        case 0xAD: abso(cpu); lda(cpu); break;
+        case 0xAE: abso(cpu); ldx(cpu); break;
+        case 0xAF: abso(cpu); lax(cpu); break;
+        case 0xB0: rel(cpu); bcs(cpu); break;
+        case 0xB1: indy(cpu); lda(cpu); break;
+        case 0xB2: imp(cpu); nop(cpu); break;
+        case 0xB3: indy(cpu); lax(cpu); break;
+        case 0xB4: zpx(cpu); ldy(cpu); break;
+        case 0xB5: zpx(cpu); lda(cpu); break;
+        case 0xB6: zpy(cpu); ldx(cpu); break;
+        case 0xB7: zpy(cpu); lax(cpu); break;
+        case 0xB8: imp(cpu); clv(cpu); break;
+        case 0xB9: absy(cpu); lda(cpu); break;
+        case 0xBA: imp(cpu); tsx(cpu); break;
+        case 0xBB: absy(cpu); lax(cpu); break;
+        case 0xBC: absx(cpu); ldy(cpu); break;
+        case 0xBD: absx(cpu); lda(cpu); break;
+        case 0xBE: absy(cpu); ldx(cpu); break;
+        case 0xBF: absy(cpu); lax(cpu); break;
+        case 0xC0: imm(cpu); cpy(cpu); break;
+        case 0xC1: indx(cpu); cmp(cpu); break;
+        case 0xC2: imm(cpu); nop(cpu); break;
+        case 0xC3: indx(cpu); dcp(cpu); break;
+        case 0xC4: zp(cpu); cpy(cpu); break;
+        case 0xC5: zp(cpu); cmp(cpu); break;
+        case 0xC6: zp(cpu); dec(cpu); break;
+        case 0xC7: zp(cpu); dcp(cpu); break;
+        case 0xC8: imp(cpu); iny(cpu); break;
+        case 0xC9: imm(cpu); cmp(cpu); break;
+        case 0xCA: imp(cpu); dex(cpu); break;
+        case 0xCB: imm(cpu); nop(cpu); break;
+        case 0xCC: abso(cpu); cpy(cpu); break;
+        case 0xCD: abso(cpu); cmp(cpu); break;
+        case 0xCE: abso(cpu); dec(cpu); break;
+        case 0xCF: abso(cpu); dcp(cpu); break;
+        case 0xD0: rel(cpu); bne(cpu); break;
+        case 0xD1: indy(cpu); cmp(cpu); break;
+        case 0xD2: imp(cpu); nop(cpu); break;
+        case 0xD3: indy(cpu); dcp(cpu); break;
+        case 0xD4: zpx(cpu); nop(cpu); break;
+        case 0xD5: zpx(cpu); cmp(cpu); break;
+        case 0xD6: zpx(cpu); dec(cpu); break;
+        case 0xD7: zpx(cpu); dcp(cpu); break;
+        case 0xD8: imp(cpu); cld(cpu); break;
+        case 0xD9: absy(cpu); cmp(cpu); break;
+        case 0xDA: imp(cpu); nop(cpu); break;
+        case 0xDB: absy(cpu); dcp(cpu); break;
+        case 0xDC: absx(cpu); nop(cpu); break;
+        case 0xDD: absx(cpu); cmp(cpu); break;
+        case 0xDE: absx(cpu); dec(cpu); break;
+        case 0xDF: absx(cpu); dcp(cpu); break;
+        case 0xE0: imm(cpu); cpx(cpu); break;
+        case 0xE1: indx(cpu); sbc(cpu); break;
+        case 0xE2: imm(cpu); nop(cpu); break;
+        case 0xE3: indx(cpu); isb(cpu); break;
+        case 0xE4: zp(cpu); cpx(cpu); break;
+        case 0xE5: zp(cpu); sbc(cpu); break;
+        case 0xE6: zp(cpu); inc(cpu); break;
+        case 0xE7: zp(cpu); isb(cpu); break;
+        case 0xE8: imp(cpu); inx(cpu); break;
+        case 0xE9: imm(cpu); sbc(cpu); break;
+        case 0xEA: imp(cpu); nop(cpu); break;
+        case 0xEB: imm(cpu); sbc(cpu); break;
+        case 0xEC: abso(cpu); cpx(cpu); break;
+        case 0xED: abso(cpu); sbc(cpu); break;
+        case 0xEE: abso(cpu); inc(cpu); break;
+        case 0xEF: abso(cpu); isb(cpu); break;
+        case 0xF0: rel(cpu); beq(cpu); break;
+        case 0xF1: indy(cpu); sbc(cpu); break;
+        case 0xF2: imp(cpu); nop(cpu); break;
+        case 0xF3: indy(cpu); isb(cpu); break;
+        case 0xF4: zpx(cpu); nop(cpu); break;
+        case 0xF5: zpx(cpu); sbc(cpu); break;
+        case 0xF6: zpx(cpu); inc(cpu); break;
+        case 0xF7: zpx(cpu); isb(cpu); break;
+        case 0xF8: imp(cpu); sed(cpu); break;
+        case 0xF9: absy(cpu); sbc(cpu); break;
+        case 0xFA: imp(cpu); nop(cpu); break;
+        case 0xFB: absy(cpu); isb(cpu); break;
+        case 0xFC: absx(cpu); nop(cpu); break;
+        case 0xFD: absx(cpu); sbc(cpu); break;
+        case 0xFE: absx(cpu); inc(cpu); break;
+        case 0xFF: absx(cpu); isb(cpu); break;
+    }
+    cpu->clockticks6502 += ticktable[cpu->opcode];
+    if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502++;
+    cpu->instructions++;
+    if (cpu->loopexternal) (*cpu->loopexternal)(cpu);
+}
+#else
+static void cpu6502_dispatch(cpu6502_t *cpu) {
+    cpu->opcode = cpu_read(cpu, cpu->pc++);
+    cpu->status |= FLAG_CONSTANT;
+    cpu->penaltyop = 0;
+    cpu->penaltyaddr = 0;
+    (*addrtable[cpu->opcode])(cpu);
+    (*optable[cpu->opcode])(cpu);
+    cpu->clockticks6502 += ticktable[cpu->opcode];
+    /*The following line goes commented out in Mike Chamber's usage of the 6502 emulator for MOARNES*/
+    if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502++;
+    cpu->instructions++;
+    if (cpu->loopexternal) (*cpu->loopexternal)(cpu);
+}
+#endif
 
-uint32 exec6502(uint32 tickcount) {
+#ifdef FAKE6502_BLOCK_CACHE
+/*effective address from a predecoded operand, same results as the addressing modes above*/
+static void ea_imp(cpu6502_t *cpu, ushort operand) {
+    (void)cpu; (void)operand;
+}
+
+static void ea_imm(cpu6502_t *cpu, ushort operand) {
+    (void)operand;
+    cpu->ea = cpu->pc - 1;
+}
+
+static void ea_zp(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = operand;
+}
+
+static void ea_zpx(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = (operand + (ushort)cpu->x) & 0xFF;
+}
+
+static void ea_zpy(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = (operand + (ushort)cpu->y) & 0xFF;
+}
+
+static void ea_rel(cpu6502_t *cpu, ushort operand) {
+    cpu->reladdr = operand;
+    if (cpu->reladdr & 0x80) cpu->reladdr |= 0xFF00;
+}
+
+static void ea_abso(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = operand;
+}
+
+static void ea_absx(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = operand + (ushort)cpu->x;
+    if ((operand & 0xFF00) != (cpu->ea & 0xFF00)) cpu->penaltyaddr = 1;
+}
+
+static void ea_absy(cpu6502_t *cpu, ushort operand) {
+    cpu->ea = operand + (ushort)cpu->y;
+    if ((operand & 0xFF00) != (cpu->ea & 0xFF00)) cpu->penaltyaddr = 1;
+}
+
+static void ea_ind(cpu6502_t *cpu, ushort operand) {
+    ushort eahelp2 = (operand & 0xFF00) | ((operand + 1) & 0x00FF); /*replicate 6502 page-boundary wraparound bug*/
+    cpu->ea = (ushort)cpu_read(cpu, operand) | ((ushort)cpu_read(cpu, eahelp2) << 8);
+}
+
+static void ea_indx(cpu6502_t *cpu, ushort operand) {
+    ushort eahelp = (operand + (ushort)cpu->x) & 0xFF;
+    cpu->ea = (ushort)cpu_read(cpu, eahelp & 0x00FF) | ((ushort)cpu_read(cpu, (eahelp+1) & 0x00FF) << 8);
+}
+
+static void ea_indy(cpu6502_t *cpu, ushort operand) {
+    ushort eahelp2 = (operand & 0xFF00) | ((operand + 1) & 0x00FF); /*zero-page wraparound*/
+    ushort startpage;
+    cpu->ea = (ushort)cpu_read(cpu, operand) | ((ushort)cpu_read(cpu, eahelp2) << 8);
+    startpage = cpu->ea & 0xFF00;
+    cpu->ea += (ushort)cpu->y;
+    if (startpage != (cpu->ea & 0xFF00)) cpu->penaltyaddr = 1;
+}
+
+/*instruction length and predecoded form of an addressing mode*/
+static uint8 cache_decode_mode(uint8 opcode, void (**mode)(cpu6502_t *cpu, ushort operand)) {
+    void (*am)(cpu6502_t *cpu) = addrtable[opcode];
+    if (am == imm)  { *mode = ea_imm;  return 2; }
+    if (am == zp)   { *mode = ea_zp;   return 2; }
+    if (am == zpx)  { *mode = ea_zpx;  return 2; }
+    if (am == zpy)  { *mode = ea_zpy;  return 2; }
+    if (am == rel)  { *mode = ea_rel;  return 2; }
+    if (am == indx) { *mode = ea_indx; return 2; }
+    if (am == indy) { *mode = ea_indy; return 2; }
+    if (am == abso) { *mode = ea_abso; return 3; }
+    if (am == absx) { *mode = ea_absx; return 3; }
+    if (am == absy) { *mode = ea_absy; return 3; }
+    if (am == ind)  { *mode = ea_ind;  return 3; }
+    *mode = ea_imp; /*imp, acc*/
+    return 1;
+}
+
+static int cache_ends_block(uint8 opcode) {
+    switch (opcode) {
+        case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C: /*BRK JSR RTI JMP RTS JMP()*/
+            return 1;
+        default:
+            return addrtable[opcode] == rel;
+    }
+}
+
+static void cache_flush(cpu6502_blockcache_t *cache) {
+    memset(cache->index, 0, sizeof(cache->index));
+    cache->used = 0;
+    cache->flushes++;
+}
+
+/*decodes the block starting at the current pc into blk, 0 if nothing could be decoded*/
+static int cache_build(cpu6502_t *cpu, cpu6502_blockcache_t *cache, cpu6502_block_t *blk) {
+    ushort addr = cpu->pc;
+    uint8 first = addr >> 8, last = first;
+
+    blk->start = addr;
+    blk->count = 0;
+    while (blk->count < CPU6502_BLOCK_MAX && (addr >> 8) == first) {
+        cpu6502_decoded_t *d = &blk->insn[blk->count];
+        ushort end;
+
+        d->opcode = cpu_read(cpu, addr);
+        d->len = cache_decode_mode(d->opcode, &d->mode);
+        end = addr + d->len - 1;
+        if (CACHE_BIT(cache->io_pages, (uint8)(end >> 8))) break;
+        d->pc = addr;
+        d->op = optable[d->opcode];
+        d->operand = 0;
+        if (d->len > 1) d->operand = cpu_read(cpu, addr + 1);
+        if (d->len > 2) d->operand |= (ushort)cpu_read(cpu, addr + 2) << 8;
+        last = end >> 8;
+        blk->count++;
+        addr += d->len;
+        if (cache_ends_block(d->opcode)) break;
+    }
+    if (blk->count == 0) return 0;
+
+    blk->page[0] = first;
+    blk->page[1] = last;
+    blk->gen[0] = cache->page_gen[first];
+    blk->gen[1] = cache->page_gen[last];
+    cache->code_pages[first >> 3] |= 1 << (first & 7);
+    cache->code_pages[last >> 3] |= 1 << (last & 7);
+    cache->built++;
+    return 1;
+}
+
+/*block starting at the current pc, decoding it if needed; NULL means use the plain dispatch*/
+static cpu6502_block_t *cache_lookup(cpu6502_t *cpu, cpu6502_blockcache_t *cache) {
+    ushort n = cache->index[cpu->pc];
+    cpu6502_block_t *blk;
+
+    if (CACHE_BIT(cache->io_pages, cpu->pc >> 8)) return NULL;
+    if (n) {
+        blk = &cache->blocks[n - 1];
+        if (blk->start == cpu->pc) {
+            if (blk->gen[0] == cache->page_gen[blk->page[0]] &&
+                blk->gen[1] == cache->page_gen[blk->page[1]]) return blk;
+            /*stale, decode again in place*/
+            return cache_build(cpu, cache, blk) ? blk : NULL;
+        }
+    }
+    if (cache->used == CPU6502_CACHE_BLOCKS) cache_flush(cache);
+    blk = &cache->blocks[cache->used];
+    if (!cache_build(cpu, cache, blk)) return NULL;
+    cache->index[cpu->pc] = (ushort)++cache->used;
+    return blk;
+}
+
+/*runs the block at pc one instruction at a time, stopping early exactly where the uncached core would differ*/
+static void cache_run(cpu6502_t *cpu, cpu6502_blockcache_t *cache, cpu6502_block_t *blk) {
+    const cpu6502_decoded_t *d = blk->insn, *end = blk->insn + blk->count;
+
+    cache->stop = 0;
+    for (;;) {
+        cpu->opcode = d->opcode;
+        cpu->pc = d->pc + d->len;
+        cpu->status |= FLAG_CONSTANT;
+        cpu->penaltyop = 0;
+        cpu->penaltyaddr = 0;
+        (*d->mode)(cpu, d->operand);
+        (*d->op)(cpu);
+        cpu->clockticks6502 += ticktable[cpu->opcode];
+        if (cpu->penaltyop && cpu->penaltyaddr) cpu->clockticks6502++;
+        cpu->instructions++;
+        if (cpu->loopexternal) (*cpu->loopexternal)(cpu);
+
+        if (++d == end || cache->stop) break;
+        if (cpu->clockticks6502 >= cpu->clockgoal6502) break;
+        if (cpu->pc != d->pc) break; /*the hook moved pc*/
+    }
+}
+
+void cpu6502_cache_init(cpu6502_blockcache_t *cache) {
+    memset(cache->index, 0, sizeof(cache->index));
+    memset(cache->page_gen, 0, sizeof(cache->page_gen));
+    memset(cache->code_pages, 0, sizeof(cache->code_pages));
+    memset(cache->io_pages, 0, sizeof(cache->io_pages));
+    cache->stop = 0;
+    cache->used = 0;
+    cache->built = cache->invalidated = cache->flushes = 0;
+}
+
+void cpu6502_cache_attach(cpu6502_t *cpu, cpu6502_blockcache_t *cache) {
+    if (cache) cpu6502_cache_init(cache);
+    cpu->cache = cache;
+}
+
+void cpu6502_cache_io_page(cpu6502_blockcache_t *cache, uint8 page) {
+    cache->io_pages[page >> 3] |= 1 << (page & 7);
+    cpu6502_cache_invalidate(cache, (ushort)page << 8);
+}
+
+void cpu6502_cache_invalidate(cpu6502_blockcache_t *cache, ushort address) {
+    uint8 page = address >> 8;
+    cache->code_pages[page >> 3] &= ~(1 << (page & 7));
+    cache->page_gen[page]++;
+    cache->invalidated++;
+    /*a block may also start on the page before and spill its last instruction into this one*/
+    page--;
+    cache->code_pages[page >> 3] &= ~(1 << (page & 7));
+    cache->page_gen[page]++;
+}
+#endif
+
+void cpu6502_init(cpu6502_t *cpu, const cpu6502_bus_t *bus) {
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->bus = *bus;
+}
+
+uint32 cpu6502_exec(cpu6502_t *cpu, uint32 tickcount) {
 	/*
 		BUG FIX:
 		overflow of unsigned 32 bit integer causes emulation to hang.
@@ -1035,40 +1779,122 @@ uint32 exec6502(uint32 tickcount) {
 
 		The system is changed so that now clockticks 6502 is reset every single time that exec is called.
 	*/
-    clockgoal6502 = tickcount;
-    clockticks6502 = 0;
-    while (clockticks6502 < clockgoal6502) {
-        opcode = read6502(pc++);
-        status |= FLAG_CONSTANT;
-        penaltyop = 0;
-        penaltyaddr = 0;
-       	(*addrtable[opcode])();
-        (*optable[opcode])();
-        clockticks6502 += ticktable[opcode];
-        if (penaltyop && penaltyaddr) {clockticks6502++;}
-        instructions++;
-        if (callexternal) (*loopexternal)();
+    cpu->clockgoal6502 = tickcount;
+    cpu->clockticks6502 = 0;
+#ifdef FAKE6502_BLOCK_CACHE
+    if (cpu->cache) {
+        while (cpu->clockticks6502 < cpu->clockgoal6502) {
+            cpu6502_block_t *blk = cache_lookup(cpu, cpu->cache);
+            if (blk) cache_run(cpu, cpu->cache, blk);
+                else cpu6502_dispatch(cpu);
+        }
+        return cpu->clockticks6502;
     }
-	return clockticks6502;
+#endif
+    while (cpu->clockticks6502 < cpu->clockgoal6502) {
+        cpu6502_dispatch(cpu);
+    }
+	return cpu->clockticks6502;
 }
 
-uint32 step6502() {
-    opcode = read6502(pc++);
-    status |= FLAG_CONSTANT;
-
-    penaltyop = 0;
-    penaltyaddr = 0;
-	clockticks6502 = 0;
-    (*addrtable[opcode])();
-    (*optable[opcode])();
-    clockticks6502 += ticktable[opcode];
-    /*The following line goes commented out in Mike Chamber's usage of the 6502 emulator for MOARNES*/
-    if (penaltyop && penaltyaddr) clockticks6502++;
+uint32 cpu6502_step(cpu6502_t *cpu) {
+	cpu->clockticks6502 = 0;
+    cpu6502_dispatch(cpu);
     /*clockgoal6502 = clockticks6502; irrelevant.*/ 
+    return cpu->clockticks6502;
+}
+
+void cpu6502_hookexternal(cpu6502_t *cpu, void (*funcptr)(cpu6502_t *cpu)) {
+    cpu->loopexternal = funcptr;
+}
+
+
+/*
+	GLOBAL API:
+	the original single-instance interface. The globals are copied into a
+	built-in context before each call and copied back afterwards, and the
+	context's bus forwards to the user supplied read6502()/write6502().
+*/
+uint8 callexternal = 0;
+void (*loopexternal)();
+
+static cpu6502_t cpu6502_global;
+
+static uint8 global_read(void *user, ushort address) {
+    (void)user;
+    return read6502(address);
+}
 
-    instructions++;
+static void global_write(void *user, ushort address, uint8 value) {
+    (void)user;
+    write6502(address, value);
+}
+
+static void global_load() {
+    cpu6502_t *cpu = &cpu6502_global;
+    cpu->bus.read = global_read;
+    cpu->bus.write = global_write;
+    cpu->pc = pc; cpu->sp = sp;
+    cpu->a = a; cpu->x = x; cpu->y = y; cpu->status = status;
+    cpu->instructions = instructions;
+    cpu->clockticks6502 = clockticks6502;
+    cpu->clockgoal6502 = clockgoal6502;
+    cpu->oldpc = oldpc; cpu->ea = ea; cpu->reladdr = reladdr;
+    cpu->value = value; cpu->result = result;
+    cpu->opcode = opcode; cpu->oldstatus = oldstatus;
+}
+
+static void global_store() {
+    cpu6502_t *cpu = &cpu6502_global;
+    pc = cpu->pc; sp = cpu->sp;
+    a = cpu->a; x = cpu->x; y = cpu->y; status = cpu->status;
+    instructions = cpu->instructions;
+    clockticks6502 = cpu->clockticks6502;
+    clockgoal6502 = cpu->clockgoal6502;
+    oldpc = cpu->oldpc; ea = cpu->ea; reladdr = cpu->reladdr;
+    value = cpu->value; result = cpu->result;
+    opcode = cpu->opcode; oldstatus = cpu->oldstatus;
+}
 
-    if (callexternal) (*loopexternal)();
+/*the user hook may look at (and change) the globals, so sync around it*/
+static void global_hook(cpu6502_t *cpu) {
+    (void)cpu;
+    global_store();
+    (*loopexternal)();
+    global_load();
+}
+
+void reset6502() {
+    global_load();
+    cpu6502_reset(&cpu6502_global);
+    global_store();
+}
+
+void nmi6502() {
+    global_load();
+    cpu6502_nmi(&cpu6502_global);
+    global_store();
+}
+
+void irq6502() {
+    global_load();
+    cpu6502_irq(&cpu6502_global);
+    global_store();
+}
+
+uint32 exec6502(uint32 tickcount) {
+    global_load();
+    cpu6502_global.loopexternal = callexternal ? global_hook : NULL;
+    cpu6502_exec(&cpu6502_global, tickcount);
+    global_store();
+	return clockticks6502;
+}
+
+uint32 step6502() {
+    global_load();
+    cpu6502_global.loopexternal = callexternal ? global_hook : NULL;
+    cpu6502_step(&cpu6502_global);
+    global_store();
     return clockticks6502;
 }
 
@@ -1078,5 +1904,11 @@ void hookexternal(void *funcptr) {
         callexternal = 1;
     } else callexternal = 0;
 }
+
+#ifdef FAKE6502_BLOCK_CACHE
+void blockcache6502(cpu6502_blockcache_t *cache) {
+    cpu6502_cache_attach(&cpu6502_global, cache);
+}
+#endif
 /*FAKE6502 INCLUDE*/
 #endif
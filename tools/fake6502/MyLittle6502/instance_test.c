@@ -0,0 +1,128 @@
+/*
+	Runs the same program on several cpu6502_t instances, each in its own
+	thread with its own memory, and checks every one of them ends in exactly
+	the state the classic global API reaches for the same input.
+
+	Built with -DFAKE6502_BLOCK_CACHE the instances run with a block cache
+	while the global reference does not, so this also checks the cache is
+	exact, including the self-modifying store in the subroutine.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "fake6502.h"
+
+#define THREADS 8
+#define RUN_TICKS 2000000
+#define SLICE_TICKS 1000
+
+typedef struct {
+    uint8 mem[65536];
+    uint8 seed;
+    uint32 cycles;
+    cpu6502_t cpu;
+#ifdef FAKE6502_BLOCK_CACHE
+    cpu6502_blockcache_t cache;
+#endif
+} machine_t;
+
+/*
+	0200  LDX #seed
+	0202  LDY #0
+	0204  TXA / CLC / ADC $0300,Y / STA $0300,Y / JSR $0220 / INY / BNE $0204
+	0212  INX / JMP $0204
+	0220  PHA / ROR A / STA $0226 / EOR $xx / STA $10 / PLA / RTS
+	      (the STA patches the zero-page operand of the EOR right after it)
+*/
+static const uint8 program[] = {
+    0xA2, 0x00, 0xA0, 0x00, 0x8A, 0x18, 0x79, 0x00, 0x03, 0x99, 0x00, 0x03,
+    0x20, 0x20, 0x02, 0xC8, 0xD0, 0xF2, 0xE8, 0x4C, 0x04, 0x02
+};
+static const uint8 subroutine[] = {
+    0x48, 0x6A, 0x8D, 0x26, 0x02, 0x45, 0x10, 0x85, 0x10, 0x68, 0x60
+};
+
+static void load_program(uint8 *mem, uint8 seed) {
+    memset(mem, 0, 65536);
+    memcpy(&mem[0x0200], program, sizeof(program));
+    memcpy(&mem[0x0220], subroutine, sizeof(subroutine));
+    mem[0x0201] = seed;
+    mem[0xfffc] = 0x00;
+    mem[0xfffd] = 0x02;
+}
+
+/*global API reference run*/
+static uint8 *global_mem;
+
+uint8 read6502(ushort addr) {
+    return global_mem[addr];
+}
+
+void write6502(ushort addr, uint8 val) {
+    global_mem[addr] = val;
+}
+
+static uint8 machine_read(void *user, ushort addr) {
+    return ((machine_t *)user)->mem[addr];
+}
+
+static void machine_write(void *user, ushort addr, uint8 val) {
+    ((machine_t *)user)->mem[addr] = val;
+}
+
+static void *run_machine(void *arg) {
+    machine_t *m = arg;
+    cpu6502_bus_t bus = { machine_read, machine_write, m };
+
+    load_program(m->mem, m->seed);
+    cpu6502_init(&m->cpu, &bus);
+#ifdef FAKE6502_BLOCK_CACHE
+    cpu6502_cache_attach(&m->cpu, &m->cache);
+#endif
+    cpu6502_reset(&m->cpu);
+    for (m->cycles = 0; m->cycles < RUN_TICKS; )
+        m->cycles += cpu6502_exec(&m->cpu, SLICE_TICKS);
+    return NULL;
+}
+
+int main(void) {
+    static machine_t machines[THREADS];
+    static uint8 reference[65536];
+    pthread_t threads[THREADS];
+    int i, failed = 0;
+
+    for (i = 0; i < THREADS; i++) {
+        machines[i].seed = (uint8)(i * 37 + 1);
+        pthread_create(&threads[i], NULL, run_machine, &machines[i]);
+    }
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    global_mem = reference;
+    for (i = 0; i < THREADS; i++) {
+        machine_t *m = &machines[i];
+        uint32 cycles;
+
+        load_program(reference, m->seed);
+        a = x = y = status = 0;
+        instructions = 0;
+        reset6502();
+        for (cycles = 0; cycles < RUN_TICKS; )
+            cycles += exec6502(SLICE_TICKS);
+
+        if (m->cpu.pc != pc || m->cpu.a != a || m->cpu.x != x || m->cpu.y != y ||
+            m->cpu.sp != sp || m->cpu.status != status ||
+            m->cpu.instructions != instructions || m->cycles != cycles ||
+            memcmp(m->mem, reference, sizeof(reference)) != 0) {
+            printf("\033[0;31minstance %d differs from the global cpu\033[0m\n", i);
+            failed = 1;
+        } else {
+            printf("\033[0;33minstance %d okay\033[0m (pc %04x, %u instructions)\n", i, pc, instructions);
+        }
+    }
+
+    printf("\r\n<DONE TESTING>\r\n");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}